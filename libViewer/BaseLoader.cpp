@@ -1,8 +1,10 @@
 #include "BaseLoader.h"
+#include "ModelLoader.h"
 #include "PlatformAdapter.h"
 #include "P3dMap.h"
 
 #include <stdarg.h>
+#include <cstring>
 
 static P3dMap<const char*, BaseLoader*> loaderRegistry(16);
 
@@ -10,16 +12,12 @@ bool BaseLoader::VertexIndex::operator==(const VertexIndex &other) const
 {
     if(type != other.type) return false;
     if(pos != other.pos) return false;
+    // types without normals in the file still use norm for crease split normals, 0 otherwise
+    if(norm != other.norm) return false;
     switch(type)
     {
-    case VT_POS_NORM:
-        if(norm != other.norm) return false;
-        break;
     case VT_POS_UV:
-        if(uv != other.uv) return false;
-        break;
     case VT_POS_UV_NORM:
-        if(norm != other.norm) return false;
         if(uv != other.uv) return false;
         break;
     default:
@@ -44,6 +42,75 @@ BaseLoader::BaseLoader()
     m_modelLoader = 0;
 }
 
+BaseLoader::~BaseLoader()
+{
+    clearStream();
+}
+
+bool BaseLoader::beginLoad(size_t totalSize)
+{
+    clearStream();
+    reserveStream(totalSize);
+    return true;
+}
+
+bool BaseLoader::appendData(const char *data, size_t size)
+{
+    appendStream(data, size);
+    return true;
+}
+
+bool BaseLoader::finishLoad()
+{
+    // all data is here, the caches work as for a load from one buffer
+    m_modelLoader->setSourceData(m_stream, m_stream_size);
+    bool res = m_modelLoader->loadModelCache() || load(m_stream, m_stream_size);
+    clearStream();
+    return res;
+}
+
+void BaseLoader::appendStream(const char *data, size_t size)
+{
+    if(m_stream_size + size > m_stream_capacity)
+    {
+        size_t capacity = m_stream_capacity ? m_stream_capacity * 2 : 64 * 1024;
+        while(capacity < m_stream_size + size) capacity *= 2;
+        reserveStream(capacity);
+    }
+    memcpy(m_stream + m_stream_size, data, size);
+    m_stream_size += size;
+}
+
+void BaseLoader::reserveStream(size_t capacity)
+{
+    if(capacity <= m_stream_capacity)
+    {
+        return;
+    }
+    char* stream = new char[capacity];
+    if(m_stream_size)
+    {
+        memcpy(stream, m_stream, m_stream_size);
+    }
+    delete [] m_stream;
+    m_stream = stream;
+    m_stream_capacity = capacity;
+}
+
+char *BaseLoader::releaseStream()
+{
+    char* stream = m_stream;
+    m_stream = nullptr;
+    m_stream_size = 0;
+    m_stream_capacity = 0;
+    return stream;
+}
+
+void BaseLoader::clearStream()
+{
+    delete [] releaseStream();
+}
+
 BaseLoader *BaseLoader::loaderFromExtension(const char *extension)
 {
     if(loaderRegistry.count(extension))
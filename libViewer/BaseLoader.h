@@ -2,10 +2,21 @@
 #define BASELOADER_H
 
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 
+//! \brief interleaved vertex, banks of these are uploaded as one buffer
+struct MeshVertex
+{
+    float pos[3];
+    float norm[3];
+    float uv[2];
+};
+
 struct MeshChunk
 {
+    static const uint32_t MAX_LODS = 3;
+
     MeshChunk()
     {
         memset(this, 0, sizeof(MeshChunk));
@@ -22,6 +33,63 @@ struct MeshChunk
     uint32_t f4Offset;
 
     uint16_t material;
+
+    // positions the chunk's triangles use, ModelLoader fills them in
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphereCenter[3];
+    float sphereRadius;
+
+    // simplified index ranges, a count of 0 ends the levels of the chunk
+    uint32_t lodOffset[MAX_LODS];
+    uint32_t lodCount[MAX_LODS];
+    //! how far the surface of each level is off the full chunk at most, in model units
+    float lodError[MAX_LODS];
+};
+
+//! \brief how face normals add up when vertex normals are generated
+enum NormalWeighting
+{
+    //! every face counts the same
+    NORMALS_UNIFORM = 0,
+    //! faces count by their area, long thin triangles stop dominating
+    NORMALS_AREA,
+    //! faces count by their angle at the vertex, independent of tessellation
+    NORMALS_ANGLE
+};
+
+//! \brief tunables for loading a model
+struct LoadOptions
+{
+    //! reindex face ranges on worker threads, needs more memory while loading
+    bool parallelReindex = false;
+    //! upload int16 positions, oct encoded normals and unorm16 uvs, decoded in the vertex shader
+    bool quantizeAttributes = false;
+    //! reorder triangles and vertices for the GPU vertex caches, adds load time
+    bool optimizeVertexCache = false;
+    //! buffer bytes an async load uploads per frame, 0 uploads all of it in one frame
+    size_t uploadBudget = 4 * 1024 * 1024;
+    //! weighting of generated normals
+    NormalWeighting normalWeighting = NORMALS_UNIFORM;
+    //! faces meeting at more than this many degrees get separate generated normals, 180 smooths all
+    //! Splitting needs the face list, it is done by loaders that reindex (.bin, .blend).
+    float creaseAngle = 180.0f;
+    //! keep generated normals through PlatformAdapter::saveCache, loads of the same data reuse them
+    //! Needs ModelLoader::setSourceData, P3dViewer calls it.
+    bool cacheNormals = false;
+    //! keep the loaded model as .p3d through PlatformAdapter::saveCache, loads of the same data
+    //! skip parsing, reindexing and normals. Needs ModelLoader::setSourceData.
+    bool cacheModel = false;
+    //! split chunks into spatially coherent clusters of at most this many triangles, so the
+    //! viewer culls and orders them front to back, 0 keeps the chunks of the loader
+    uint32_t clusterTriangles = 0;
+    //! simplified index lists per chunk, up to MeshChunk::MAX_LODS, each with about half the
+    //! triangles of the one before; the viewer draws them when the difference is below a pixel.
+    //! Adds more load time than any other stage, best left to p3d-convert.
+    uint32_t lodLevels = 0;
+    //! streamed .bin loads free the face data once it is reindexed instead of keeping
+    //! all of it, the caches are keyed by all of it and are not used then
+    bool boundedStreaming = false;
 };
 
 class ModelLoader;
@@ -38,11 +106,25 @@ public:
     };
 
     BaseLoader();
-    virtual ~BaseLoader() {}
+    virtual ~BaseLoader();
     void setModelLoader(ModelLoader* modelLoader) { m_modelLoader = modelLoader; }
     static BaseLoader* loaderFromExtension(const char* extension);
     virtual bool load(const char*, size_t) { return false; }
 
+    //! \brief streamed load, for data that arrives in pieces
+    //! Call beginLoad, appendData with every piece in order, then finishLoad.
+    //! After a false return the load is abandoned, the next beginLoad starts over.
+    //! Loaders that can't use partial data keep the pieces and load() them in finishLoad,
+    //! or the model cache entry of all of them. Callers save it with ModelLoader::saveModelCache.
+    //! \arg totalSize bytes that will arrive, 0 if not known
+    virtual bool beginLoad(size_t totalSize);
+    virtual bool appendData(const char* data, size_t size);
+    virtual bool finishLoad();
+    //! \brief appendData creates the model before all data arrived, see P3dLoader
+    //! P3dViewer calls these loaders on the GL thread, uploads read the pieces as they
+    //! come in; the others get their pieces on a worker thread.
+    virtual bool progressive() const { return false; }
+
 protected:
     struct VertexIndex
     {
@@ -54,7 +136,18 @@ protected:
         size_t hash() const;
     };
 
+    //! \brief appends to m_stream, it only moves when it has to grow
+    void appendStream(const char* data, size_t size);
+    void reserveStream(size_t capacity);
+    //! \brief hands m_stream over to the caller, who frees it with delete []
+    char* releaseStream();
+    void clearStream();
+
     ModelLoader* m_modelLoader;
+    // data received by appendData
+    char* m_stream = nullptr;
+    size_t m_stream_size = 0;
+    size_t m_stream_capacity = 0;
 };
 
 class RegisterLoader
@@ -3,6 +3,7 @@
 #define DUMP_LOAD_STATS 0
 
 #include <cfloat>
+#include <algorithm>
 
 #if defined(_WIN32) || defined(_WIN64)
 static inline uint32_t le32toh(uint32_t x) {return x;}
@@ -26,9 +27,15 @@ static float READ_FLOAT(const char& x) {
 
 #include "ModelLoader.h"
 #include "PlatformAdapter.h"
+#include "P3dParallel.h"
+#include "P3dProfiler.h"
+#include "NormalGenerator.h"
 
 static P3dLogger logger("binloader.BinLoader", P3dLogger::LOG_DEBUG);
 
+// face count of the ranges reindexed in parallel, about what fills a 16 bit vertex bank
+static const uint32_t PARALLEL_RANGE_FACES = 131072;
+
 static BinLoader binLoader;
 static RegisterLoader registerBinLoader(&binLoader, ".bin", 0);
 
@@ -41,11 +48,23 @@ BinLoader::BinLoader()
     m_maxY = FLT_MIN;
     m_minZ = FLT_MAX;
     m_maxZ = FLT_MIN;
+    m_vertex_data = 0;
+    for(int vtype = 0; vtype < 4; ++vtype)
+    {
+        m_crease_groups[vtype] = 0;
+        m_crease_normals[vtype] = 0;
+        m_f3_data[vtype] = 0;
+        m_f4_data[vtype] = 0;
+    }
+    for(int section = 0; section < SECTION_COUNT; ++section)
+    {
+        m_section_buffers[section] = 0;
+    }
 }
 
 BinLoader::~BinLoader()
 {
-
+    clearStreamState();
 }
 
 bool BinLoader::load(const char *data, size_t size)
@@ -54,9 +73,135 @@ bool BinLoader::load(const char *data, size_t size)
 
     m_modelLoader->clear();
 
-    m_chunks.clear();
+    size_t fileSize;
+    if(!readHeader(data, size, &fileSize) || fileSize != size)
+    {
+        // wrong data size or some error in header
+        return false;
+    }
+
+    m_vertex_data = data;
+    for(int vtype = 0; vtype < 4; ++vtype)
+    {
+        m_f3_data[vtype] = data + m_f3_start[vtype];
+        m_f4_data[vtype] = data + m_f4_start[vtype];
+    }
+    m_loaded = reindex();
+    m_modelLoader->setIsLoaded(m_loaded);
+
+    return m_loaded;
+}
+
+bool BinLoader::beginLoad(size_t totalSize)
+{
+    (void) totalSize;
+    m_modelLoader->clear();
+    clearStreamState();
+    m_bounded = m_modelLoader->options().boundedStreaming;
+    return true;
+}
+
+bool BinLoader::appendData(const char *data, size_t size)
+{
+    while(size)
+    {
+        size_t count;
+        if(!m_file_size)
+        {
+            // the header tells where everything else goes
+            count = std::min(size, HEADER_SIZE - m_received);
+            appendStream(data, count);
+        }
+        else if(m_received >= m_file_size)
+        {
+            logger.warning("More data than the header announced, %lld bytes", (long long) m_file_size);
+            return false;
+        }
+        else if(!m_bounded || m_received < sectionStart(0))
+        {
+            // reserved with the header, reindexing reads it in place
+            size_t end = m_bounded ? sectionStart(0) : m_file_size;
+            count = std::min(size, end - m_received);
+            appendStream(data, count);
+        }
+        else
+        {
+            // the sections before m_next_section are complete, this one is filling
+            int section = m_next_section;
+            size_t start = sectionStart(section);
+            size_t end = sectionEnd(section);
+            if(!m_section_buffers[section])
+            {
+                m_section_buffers[section] = new char[end - start];
+            }
+            count = std::min(size, end - m_received);
+            memcpy(m_section_buffers[section] + (m_received - start), data, count);
+        }
+        m_received += count;
+        data += count;
+        size -= count;
+
+        if(!m_file_size && m_received == HEADER_SIZE && !startStream())
+        {
+            return false;
+        }
+        if(m_file_size)
+        {
+            consumeSections();
+        }
+    }
+    return true;
+}
+
+bool BinLoader::finishLoad()
+{
+    if(!m_file_size || m_received != m_file_size)
+    {
+        logger.warning("Size mismatch, expected %lld bytes, got %lld", (long long) m_file_size, (long long) m_received);
+        clearStreamState();
+        return false;
+    }
+    if(!m_bounded)
+    {
+        // all data is here, the caches work as for load()
+        m_modelLoader->setSourceData(m_stream, m_stream_size);
+        if(m_modelLoader->loadModelCache())
+        {
+            clearStreamState();
+            return true;
+        }
+    }
+
+    // stitch the sections together in the type order of the index data
+    P3dVector<ReindexContext*> contexts;
+    const VertexType typeOrder[] = {VT_POS_UV_NORM, VT_POS_UV, VT_POS_NORM, VT_POS};
+    for(VertexType type: typeOrder)
+    {
+        int sections[] = {3 - type, SECTION_COUNT - 1 - type};
+        for(int section: sections)
+        {
+            for(ReindexContext* ctx: m_section_contexts[section])
+            {
+                contexts.push_back(ctx);
+            }
+        }
+    }
+    ReindexContext empty;
+    ReindexContext& ctx = contexts.size() ? *contexts[0] : empty;
+    for(size_t i = 1; i < contexts.size(); ++i)
+    {
+        mergeContext(ctx, *contexts[i]);
+    }
+    finishReindex(ctx, m_new_faces);
+    clearStreamState();
+
+    m_loaded = true;
+    m_modelLoader->setIsLoaded(m_loaded);
+    return m_loaded;
+}
 
-    // check header
+bool BinLoader::readHeader(const char *data, size_t size, size_t *fileSize)
+{
     const char magic[] = "Three.js 003";
     size_t magicSize = sizeof(magic) - 1;
     if(size < magicSize)
@@ -152,45 +297,289 @@ bool BinLoader::load(const char *data, size_t size)
     m_f4_start[VT_POS_UV_NORM] = offset;
     offset += addPadding((4 * (4 + 4 + 4) + 2) * m_f4_count[VT_POS_UV_NORM]);
 
-    if(offset != size)
+    *fileSize = offset;
+    return true;
+}
+
+size_t BinLoader::addPadding(size_t size)
+{
+    return size + ( ( size % 4 ) ? ( 4 - size % 4 ) : 0 );
+}
+
+size_t BinLoader::sectionStart(int section) const
+{
+    return section < SECTION_COUNT / 2 ? m_f3_start[sectionType(section)] : m_f4_start[sectionType(section)];
+}
+
+size_t BinLoader::sectionEnd(int section) const
+{
+    return section + 1 < SECTION_COUNT ? sectionStart(section + 1) : m_file_size;
+}
+
+bool BinLoader::startStream()
+{
+    size_t fileSize;
+    if(!readHeader(m_stream, m_stream_size, &fileSize))
     {
-        // wrong data size or some error in header
         return false;
     }
+    m_file_size = fileSize;
+    logger.debug("Streaming %lld bytes%s", (long long) m_file_size, m_bounded ? ", bounded" : "");
+
+    // the final size, the buffer doesn't move after this
+    reserveStream(m_bounded ? sectionStart(0) : m_file_size);
+    m_vertex_data = m_stream;
+    prepareReindex();
+    m_new_faces = new uint32_t[m_total_index_count];
+    return true;
+}
 
-    m_loaded = reindex(data);
-    m_modelLoader->setBoundingBox(m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ);
-    m_modelLoader->setIsLoaded(m_loaded);
+void BinLoader::consumeSections()
+{
+    while(m_next_section < SECTION_COUNT && m_received >= sectionEnd(m_next_section))
+    {
+        int section = m_next_section++;
+        VertexType type = sectionType(section);
+        bool quads = section >= SECTION_COUNT / 2;
+        const char* data = m_bounded ? m_section_buffers[section] : m_stream + sectionStart(section);
+        if(quads)
+        {
+            m_f4_data[type] = data;
+        }
+        else
+        {
+            m_f3_data[type] = data;
+        }
 
-    return m_loaded;
+        if(needsCreaseNormals(type))
+        {
+            // crease normals need the faces of both sections, the tris wait for the quads
+            if(!quads && m_f4_count[type])
+            {
+                continue;
+            }
+            if(quads && !m_f4_count[type])
+            {
+                // the tris had nothing to wait for
+                continue;
+            }
+            float* positions = 0;
+            creaseNormals(type, &positions);
+            delete [] positions;
+            if(quads)
+            {
+                reindexSection(section - SECTION_COUNT / 2);
+                dropSection(section - SECTION_COUNT / 2);
+            }
+        }
+        reindexSection(section);
+        dropSection(section);
+    }
 }
 
-size_t BinLoader::addPadding(size_t size)
+void BinLoader::reindexSection(int section)
 {
-    return size + ( ( size % 4 ) ? ( 4 - size % 4 ) : 0 );
+    VertexType type = sectionType(section);
+    bool quads = section >= SECTION_COUNT / 2;
+    uint32_t firstFace = quads ? m_f3_count[type] : 0;
+    uint32_t endFace = quads ? m_f3_count[type] + m_f4_count[type] : m_f3_count[type];
+    P3dVector<ReindexContext*>& contexts = m_section_contexts[section];
+    if(firstFace >= endFace)
+    {
+        return;
+    }
+
+    bool parallel = m_modelLoader->options().parallelReindex && P3dParallel::workerCount() > 1;
+    if(!parallel)
+    {
+        // one context per type, the quads go on where the tris ended as in load()
+        P3dVector<ReindexContext*>& tris = m_section_contexts[section - SECTION_COUNT / 2];
+        if(quads && tris.size())
+        {
+            ReindexRange range = {type, firstFace, endFace, true};
+            reindexRange(*tris[0], range, m_new_faces);
+            finishContexts(tris);
+            return;
+        }
+        ReindexRange range = {type, firstFace, endFace, false};
+        contexts.push_back(new ReindexContext());
+        reindexRange(*contexts[0], range, m_new_faces);
+        if(quads || !m_f4_count[type])
+        {
+            finishContexts(contexts);
+        }
+        return;
+    }
+
+    P3dVector<ReindexRange> ranges;
+    for(uint32_t first = firstFace; first < endFace; first = ranges[ranges.size() - 1].endFace)
+    {
+        ReindexRange range;
+        range.vtype = type;
+        range.firstFace = first;
+        range.endFace = endFace - first > PARALLEL_RANGE_FACES ? first + PARALLEL_RANGE_FACES : endFace;
+        range.continues = false;
+        ranges.push_back(range);
+        contexts.push_back(new ReindexContext());
+    }
+    P3dParallel::forEach(ranges.size(), [&](size_t i)
+    {
+        reindexRange(*contexts[i], ranges[i], m_new_faces);
+    });
+    finishContexts(contexts);
 }
 
-bool BinLoader::reindex(const char *data)
+void BinLoader::finishContexts(P3dVector<ReindexContext *> &contexts)
 {
-    uint64_t start = PlatformAdapter::currentMillis();
+    for(size_t i = 0; i < contexts.size(); ++i)
+    {
+        ReindexContext* ctx = contexts[i];
+        P3dProfiler::add(P3dProfiler::COUNTER_MAP_LOOKUPS, ctx->vertexMap->lookupCount());
+        P3dProfiler::add(P3dProfiler::COUNTER_MAP_PROBES, ctx->vertexMap->probeCount());
+        delete ctx->vertexMap;
+        ctx->vertexMap = 0;
+    }
+}
 
-    m_mat_count = 1;
-    m_maxX = 0.0f;
-    m_minX = 0.0f;
-    m_maxY = 0.0f;
-    m_minY = 0.0f;
-    m_maxZ = 0.0f;
-    m_minZ = 0.0f;
+void BinLoader::dropSection(int section)
+{
+    if(m_bounded)
+    {
+        delete [] m_section_buffers[section];
+        m_section_buffers[section] = 0;
+        if(section < SECTION_COUNT / 2)
+        {
+            m_f3_data[sectionType(section)] = 0;
+        }
+        else
+        {
+            m_f4_data[sectionType(section)] = 0;
+        }
+    }
+}
 
-    m_new_pos_count = 0;
-    m_new_norm_count = 0;
-    m_new_empty_norm_count = 0;
-    m_new_uv_count = 0;
+void BinLoader::clearStreamState()
+{
+    clearStream();
+    for(int section = 0; section < SECTION_COUNT; ++section)
+    {
+        delete [] m_section_buffers[section];
+        m_section_buffers[section] = 0;
+        for(ReindexContext* ctx: m_section_contexts[section])
+        {
+            delete ctx;
+        }
+        m_section_contexts[section].clear();
+    }
+    delete [] m_new_faces;
+    m_new_faces = nullptr;
+    clearCreaseNormals();
+    m_file_size = 0;
+    m_received = 0;
+    m_next_section = 0;
+    m_vertex_data = 0;
+    for(int vtype = 0; vtype < 4; ++vtype)
+    {
+        m_f3_data[vtype] = 0;
+        m_f4_data[vtype] = 0;
+    }
+}
 
-    m_total_index_count = 0;
+BinLoader::ReindexContext::ReindexContext()
+{
+    emptyNormCount = 0;
+    matCount = 1;
+    maxX = 0.0f;
+    minX = 0.0f;
+    maxY = 0.0f;
+    minY = 0.0f;
+    maxZ = 0.0f;
+    minZ = 0.0f;
+    vertexMap = 0;
+}
 
-    uint32_t chunk = 0;
+BinLoader::ReindexContext::~ReindexContext()
+{
+    delete vertexMap;
+}
 
+bool BinLoader::reindex()
+{
+    size_t vertEstimate = prepareReindex();
+
+    // split the work into ranges, in the same type order as the index data
+    bool parallel = m_modelLoader->options().parallelReindex && P3dParallel::workerCount() > 1;
+    uint32_t rangeFaces = parallel ? PARALLEL_RANGE_FACES : UINT32_MAX;
+    const VertexType typeOrder[] = {VT_POS_UV_NORM, VT_POS_UV, VT_POS_NORM, VT_POS};
+    P3dVector<ReindexRange> ranges;
+    for(VertexType type: typeOrder)
+    {
+        uint32_t fcount = m_f3_count[type] + m_f4_count[type];
+        for(uint32_t first = 0; first < fcount; first += rangeFaces)
+        {
+            ReindexRange range;
+            range.vtype = type;
+            range.firstFace = first;
+            range.endFace = fcount - first > rangeFaces ? first + rangeFaces : fcount;
+            range.continues = false;
+            ranges.push_back(range);
+        }
+    }
+
+    creaseNormals();
+
+    uint32_t* new_faces = new uint32_t[m_total_index_count];
+
+    ReindexContext* contexts;
+    if(parallel)
+    {
+        logger.debug("reindexing %d ranges on %d threads", ranges.size(), P3dParallel::workerCount());
+        contexts = new ReindexContext[ranges.size()];
+        P3dParallel::forEach(ranges.size(), [&](size_t i)
+        {
+            reindexRange(contexts[i], ranges[i], new_faces);
+        });
+
+        // stitch vertex banks and chunks together in range order
+        for(size_t i = 1; i < ranges.size(); ++i)
+        {
+            mergeContext(contexts[0], contexts[i]);
+        }
+    }
+    else
+    {
+        contexts = new ReindexContext[1];
+        contexts[0].vertices.reserve(vertEstimate);
+
+        for(size_t i = 0; i < ranges.size(); ++i)
+        {
+            reindexRange(contexts[0], ranges[i], new_faces);
+        }
+        if(contexts[0].vertexMap) contexts[0].vertexMap->dumpBucketLoad();
+    }
+
+    for(size_t i = 0, il = parallel ? ranges.size() : 1; i < il; ++i)
+    {
+        if(contexts[i].vertexMap)
+        {
+            P3dProfiler::add(P3dProfiler::COUNTER_MAP_LOOKUPS, contexts[i].vertexMap->lookupCount());
+            P3dProfiler::add(P3dProfiler::COUNTER_MAP_PROBES, contexts[i].vertexMap->probeCount());
+        }
+    }
+
+    finishReindex(contexts[0], new_faces);
+
+    delete [] contexts;
+    delete [] new_faces;
+    clearCreaseNormals();
+
+    return true;
+
+}
+
+size_t BinLoader::prepareReindex()
+{
+    m_total_index_count = 0;
     for(int vtype = 0; vtype < 4; vtype++)
     {
         m_new_index_count[vtype] = m_f3_count[vtype] * 3 + m_f4_count[vtype] * 6;
@@ -199,164 +588,234 @@ bool BinLoader::reindex(const char *data)
         m_total_index_count += m_new_index_count[vtype];
     }
 
-    uint16_t* new_faces = new uint16_t[m_total_index_count];
-    uint16_t* new_mats = new uint16_t[m_total_index_count / 3];
+    // guess the unique vertex count to avoid most reallocs, seams add some vertices
+    size_t vertEstimate = m_pos_count + m_pos_count / 8;
+    if(vertEstimate > m_total_index_count) vertEstimate = m_total_index_count;
 
-    reindexType(chunk, VT_POS_UV_NORM, data, new_faces, new_mats);
-    reindexType(chunk, VT_POS_UV, data, new_faces, new_mats);
-    reindexType(chunk, VT_POS_NORM, data, new_faces, new_mats);
-    reindexType(chunk, VT_POS, data, new_faces, new_mats);
-
-    logger.debug("mat count: %d", m_mat_count);
-    logger.debug("new pos size: %d", m_new_pos_count);
-    logger.debug("new uv size: %d", m_new_uv_count);
-    logger.debug("new norm size: %d", m_new_norm_count);
+    if(m_modelLoader->uint32Indices())
+    {
+        m_max_bank_vertices = UINT32_MAX - 1;
+        m_bank_size_hint = vertEstimate;
+    }
+    else
+    {
+        // a bank never gets much over 65530 vertices, sizing for that avoids rehashing
+        m_max_bank_vertices = 65530;
+        m_bank_size_hint = 65536;
+    }
+    return vertEstimate;
+}
 
-    logger.debug("total new size: %d", (m_new_pos_count + m_new_norm_count + m_new_uv_count) * 4 + m_total_index_count * 2);
+void BinLoader::finishReindex(ReindexContext &ctx, uint32_t *new_faces)
+{
+    m_mat_count = ctx.matCount;
+    m_minX = ctx.minX;
+    m_maxX = ctx.maxX;
+    m_minY = ctx.minY;
+    m_maxY = ctx.maxY;
+    m_minZ = ctx.minZ;
+    m_maxZ = ctx.maxZ;
 
+    logger.debug("mat count: %d", m_mat_count);
+    logger.debug("new vertex count: %d", ctx.vertices.size());
 
-    GLfloat* new_pos = new GLfloat[m_new_pos_count];
-    GLfloat* new_uv = new GLfloat[m_new_uv_count];
-    GLfloat* new_norm = new GLfloat[m_new_norm_count];
+    logger.debug("total new size: %d", ctx.vertices.size() * sizeof(MeshVertex) + m_total_index_count * 4);
 
-    for(chunk = 0; chunk < m_chunks.size(); ++chunk)
+    for(uint32_t chunk = 0; chunk < ctx.chunks.size(); ++chunk)
     {
         logger.verbose("chunk: %d", chunk);
-        logger.verbose(" index count: %d", m_chunks[chunk].indexCount);
-        logger.verbose(" vert count: %d", m_chunks[chunk].vertCount);
-        logger.verbose(" f3 offset: %d", m_chunks[chunk].f3Offset);
-        logger.verbose(" f4 offset: %d", m_chunks[chunk].f4Offset);
-        logger.verbose(" material: %d", m_chunks[chunk].material);
+        logger.verbose(" index count: %d", ctx.chunks[chunk].indexCount);
+        logger.verbose(" vert count: %d", ctx.chunks[chunk].vertCount);
+        logger.verbose(" vert offset: %d", ctx.chunks[chunk].vertOffset);
+        logger.verbose(" f3 offset: %d", ctx.chunks[chunk].f3Offset);
+        logger.verbose(" f4 offset: %d", ctx.chunks[chunk].f4Offset);
+        logger.verbose(" material: %d", ctx.chunks[chunk].material);
     }
 
-    for(auto item: m_vertex_maps)
+    // createModel quantizes against the box
+    m_modelLoader->setBoundingBox(m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ);
+    m_modelLoader->createModel(ctx.vertices.size(), ctx.emptyNormCount, ctx.vertices.data(),
+                m_total_index_count, new_faces, ctx.chunks.size(), ctx.chunks.data());
+}
+
+bool BinLoader::needsCreaseNormals(VertexType type) const
+{
+    if(type != VT_POS_UV && type != VT_POS)
     {
-        logger.verbose("vertex bank:");
-        logger.verbose(" offset: %d", item.first);
-        logger.verbose(" count: %d", item.second->size());
-        copyVertData(item.first, item.second, data, new_norm, new_uv, new_pos);
-        item.second->dumpBucketLoad();
-        delete item.second;
+        return false;
     }
-    m_vertex_maps.clear();
+    return m_modelLoader->options().creaseAngle < 180.0f && (m_f3_count[type] || m_f4_count[type]);
+}
 
-    m_modelLoader->createModel(m_new_pos_count, m_new_norm_count, m_new_empty_norm_count, m_new_uv_count,
-                new_pos, new_norm, new_uv, m_total_index_count,
-                new_faces, m_chunks.size(), m_chunks.data());
+void BinLoader::creaseNormals()
+{
+    clearCreaseNormals();
+    float* positions = 0;
+    creaseNormals(VT_POS_UV, &positions);
+    creaseNormals(VT_POS, &positions);
+    delete [] positions;
+}
 
-    delete [] new_norm;
-    delete [] new_uv;
-    delete [] new_pos;
+void BinLoader::creaseNormals(VertexType type, float **positions)
+{
+    if(!needsCreaseNormals(type))
+    {
+        return;
+    }
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_NORMALS_CREASE);
+    const LoadOptions& options = m_modelLoader->options();
+    uint32_t triCount = m_f3_count[type];
+    uint32_t quadCount = m_f4_count[type];
 
-    delete [] new_mats;
-    delete [] new_faces;
+    uint32_t i;
+    if(!*positions)
+    {
+        *positions = new float[size_t(m_pos_count) * 3];
+        for(i = 0; i < m_pos_count * 3; ++i)
+        {
+            (*positions)[i] = READ_FLOAT(m_vertex_data[m_pos_start + i * 4]);
+        }
+    }
 
-    logger.debug("reindex took %lldms", PlatformAdapter::durationMillis(start));
-    return true;
+    // position indices come first in both the tri and the quad section
+    uint32_t cornerCount = triCount * 3 + quadCount * 4;
+    uint32_t* cornerPositions = new uint32_t[cornerCount];
+    for(i = 0; i < triCount * 3; ++i)
+    {
+        cornerPositions[i] = READ_U32(m_f3_data[type][i * 4]);
+    }
+    for(i = 0; i < quadCount * 4; ++i)
+    {
+        cornerPositions[triCount * 3 + i] = READ_U32(m_f4_data[type][i * 4]);
+    }
+
+    m_crease_groups[type] = new uint32_t[cornerCount];
+    m_crease_normals[type] = new float[size_t(cornerCount) * 3];
+    NormalGenerator::creaseNormals(*positions, m_pos_count, cornerPositions, triCount, quadCount,
+                                   options.normalWeighting, options.creaseAngle,
+                                   m_crease_groups[type], m_crease_normals[type]);
+    delete [] cornerPositions;
+}
 
+void BinLoader::clearCreaseNormals()
+{
+    for(int vtype = 0; vtype < 4; ++vtype)
+    {
+        delete [] m_crease_groups[vtype];
+        m_crease_groups[vtype] = 0;
+        delete [] m_crease_normals[vtype];
+        m_crease_normals[vtype] = 0;
+    }
 }
 
-uint32_t BinLoader::reindexType(uint32_t &chunk, BaseLoader::VertexType vtype, const char *data, uint16_t *new_faces, uint16_t *new_mats)
+void BinLoader::reindexRange(ReindexContext &ctx, const ReindexRange &range, uint32_t *new_faces)
 {
-    uint32_t pos_offset;
-    uint32_t uv_offset;
-    uint32_t norm_offset;
-    uint32_t mat_offset;
+    VertexType vtype = range.vtype;
+    const char* data = 0;
+    // set when the tri or quad section (re)starts on the first face, zeroed for the compiler
+    uint32_t pos_offset = 0;
+    uint32_t uv_offset = 0;
+    uint32_t norm_offset = 0;
+    uint32_t mat_offset = 0;
     uint16_t mat;
     uint32_t f;
-    uint32_t fcount;
     uint32_t v;
-    uint32_t verts;
-    uint32_t new_offset;
-    uint32_t new_mat_offset;
+    uint32_t verts = 0;
+    uint32_t new_offset = 0;
     uint32_t f4_offset;
-    uint32_t result = 0;
-    P3dMap<VertexIndex, uint32_t>* vertexMap = 0;
+    uint32_t face_count;
+    uint32_t first;
+    uint32_t corner = 0;
     bool in_f4 = false;
 
-    f4_offset = m_f3_count[vtype];
-    fcount = f4_offset + m_f4_count[vtype];
-    if(fcount == 0)
+    if(range.firstFace >= range.endFace)
     {
         // no faces of this type
-        return result;
+        return;
     }
 
-    // tris
-    pos_offset = m_f3_start[vtype];
-    norm_offset = pos_offset + m_f3_count[vtype] * 3 * 4;
-    if(vtype == VT_POS_NORM || vtype == VT_POS_UV_NORM)
-    {
-        uv_offset = norm_offset + m_f3_count[vtype] * 3 * 4;
-    } else {
-        uv_offset = norm_offset;
-    }
-    if(vtype == VT_POS_UV || vtype == VT_POS_UV_NORM)
+    // reindex stages are in VertexType order
+    P3dProfiler::Scope scope(static_cast<P3dProfiler::Stage>(P3dProfiler::STAGE_REINDEX_POS_UV_NORM + vtype));
+
+    f4_offset = m_f3_count[vtype];
+    if(!ctx.vertexMap)
     {
-        mat_offset = uv_offset + m_f3_count[vtype] * 3 * 4;
-    } else {
-        mat_offset = uv_offset;
+        uint32_t corners = 4 * (range.endFace - range.firstFace);
+        ctx.vertexMap = new P3dMap<VertexIndex, uint32_t>(corners < m_bank_size_hint ? corners : m_bank_size_hint);
     }
 
     VertexIndex index;
     index.type = vtype;
-    uint32_t new_index;
-    new_offset = 0; //TODO: should be passed in?
-    new_mat_offset = 0;
+    index.uv = 0;
+    index.norm = 0;
+    const uint32_t* creaseGroups = m_crease_groups[vtype];
 
-    for(f = 0; f < fcount; ++f)
+    for(f = range.firstFace; f < range.endFace; ++f)
     {
-        if(!in_f4 && f >= f4_offset)
+        if(f == range.firstFace || f == f4_offset)
         {
-            in_f4 = true;
-            // quads
-            pos_offset = m_f4_start[vtype];
-            norm_offset = pos_offset + m_f4_count[vtype] * 4 * 4;
+            // (re)start reading the tri or quad section
+            in_f4 = f >= f4_offset;
+            verts = in_f4 ? 4 : 3;
+            face_count = in_f4 ? m_f4_count[vtype] : m_f3_count[vtype];
+            first = in_f4 ? f - f4_offset : f;
+
+            data = in_f4 ? m_f4_data[vtype] : m_f3_data[vtype];
+            pos_offset = 0;
+            norm_offset = pos_offset + face_count * verts * 4;
             if(vtype == VT_POS_NORM || vtype == VT_POS_UV_NORM)
             {
-                uv_offset = norm_offset + m_f4_count[vtype] * 4 * 4;
+                uv_offset = norm_offset + face_count * verts * 4;
             } else {
                 uv_offset = norm_offset;
             }
             if(vtype == VT_POS_UV || vtype == VT_POS_UV_NORM)
             {
-                mat_offset = uv_offset + m_f4_count[vtype] * 4 * 4;
+                mat_offset = uv_offset + face_count * verts * 4;
             } else {
                 mat_offset = uv_offset;
             }
+
+            pos_offset += first * verts * 4;
+            norm_offset += first * verts * 4;
+            uv_offset += first * verts * 4;
+            mat_offset += first * 2;
+            new_offset = in_f4 ? m_new_f4_start[vtype] + first * 6 : m_new_f3_start[vtype] + first * 3;
+            corner = in_f4 ? m_f3_count[vtype] * 3 + first * 4 : first * 3;
         }
 
         // material
         mat = READ_U16(data[mat_offset]);
         mat_offset += 2;
-        new_mats[new_mat_offset++] = mat;
-        if(mat + 1> m_mat_count)
+        if(mat + 1> ctx.matCount)
         {
-            m_mat_count = mat + 1;
+            ctx.matCount = mat + 1;
         }
 
-        if(f == 0)
+        if(f == range.firstFace && !(range.continues && ctx.chunks.size()))
         {
-            nextChunk(chunk, vtype, in_f4, new_offset, m_new_pos_count / 3, true);
-            m_chunks[chunk].material = mat;
-            vertexMap = m_vertex_maps[m_chunks[chunk].vertOffset];
+            // 16 bit indices start a bank per type, 32 bit ones keep filling the current bank
+            uint32_t vertOffset = ctx.vertices.size();
+            if(m_max_bank_vertices > 65530 && ctx.chunks.size() != 0)
+            {
+                vertOffset = ctx.chunks[ctx.chunks.size() - 1].vertOffset;
+            }
+            nextChunk(ctx, vtype, in_f4, new_offset, vertOffset);
+            ctx.chunks[ctx.chunks.size() - 1].material = mat;
         }
-        else if(mat != m_chunks[chunk].material)
+        else if(mat != ctx.chunks[ctx.chunks.size() - 1].material)
         {
-            nextChunk(chunk, vtype, in_f4, new_offset, m_chunks[chunk].vertOffset, false);
-            m_chunks[chunk].material = mat;
-            vertexMap = m_vertex_maps[m_chunks[chunk].vertOffset];
+            nextChunk(ctx, vtype, in_f4, new_offset, ctx.chunks[ctx.chunks.size() - 1].vertOffset);
+            ctx.chunks[ctx.chunks.size() - 1].material = mat;
         }
 
-        if(vertexMap->size() > 65530)
+        if(ctx.vertexMap->size() > m_max_bank_vertices)
         {
             // next chunk
-            nextChunk(chunk, vtype, in_f4, new_offset, m_new_pos_count / 3, false);
-            m_chunks[chunk].material = mat;
-            vertexMap = m_vertex_maps[m_chunks[chunk].vertOffset];
+            nextChunk(ctx, vtype, in_f4, new_offset, ctx.vertices.size());
+            ctx.chunks[ctx.chunks.size() - 1].material = mat;
         }
 
-        verts = in_f4 ? 4 : 3;
         for(v = 0; v < verts; ++v)
         {
             index.pos = READ_U32(data[pos_offset]);
@@ -371,30 +830,19 @@ uint32_t BinLoader::reindexType(uint32_t &chunk, BaseLoader::VertexType vtype, c
                 index.norm = READ_U32(data[norm_offset]);
                 norm_offset += 4;
             }
-            if(vertexMap->count(index))
+            else if(creaseGroups)
             {
-                new_index = (*vertexMap)[index];
+                index.norm = creaseGroups[corner];
             }
-            else
+            ++corner;
+            bool inserted;
+            auto slot = ctx.vertexMap->findOrInsert(index, &inserted);
+            if(inserted)
             {
-                new_index = vertexMap->size();
-                vertexMap->insert(index, new_index);
-
-                m_new_pos_count += 3;
-
-                // uv
-                if(vtype == VT_POS_UV || vtype == VT_POS_UV_NORM)
-                {
-                    m_new_uv_count += 2;
-                }
-
-                m_new_norm_count += 3;
-                if(vtype == VT_POS || vtype == VT_POS_UV)
-                {
-                    m_new_empty_norm_count += 3;
-                }
+                slot->second = ctx.vertexMap->size() - 1;
+                emitVertex(ctx, index);
             }
-            new_faces[new_offset] = new_index;
+            new_faces[new_offset] = slot->second;
             ++new_offset;
         }
 
@@ -405,123 +853,131 @@ uint32_t BinLoader::reindexType(uint32_t &chunk, BaseLoader::VertexType vtype, c
             ++new_offset;
             new_faces[new_offset] = new_faces[new_offset - 3];
             ++new_offset;
-
-            new_mats[new_mat_offset++] = mat;
         }
     }
 
-    m_chunks[chunk].vertCount = (m_new_pos_count - 3 * m_chunks[chunk].vertOffset) / 3;
-    return result;
+    MeshChunk& lastChunk = ctx.chunks[ctx.chunks.size() - 1];
+    lastChunk.indexCount = new_offset - lastChunk.f3Offset;
+    lastChunk.vertCount = ctx.vertices.size() - lastChunk.vertOffset;
 }
 
-void BinLoader::copyVertData(uint32_t vertOffset, P3dMap<VertexIndex, uint32_t> *vertexMap, const char *data, GLfloat *new_norm, GLfloat *new_uv, GLfloat *new_pos)
+void BinLoader::emitVertex(ReindexContext &ctx, const VertexIndex &index)
 {
+    const char* data = m_vertex_data;
     static const float norm_scale = 1.0f / 127.0f;
-    uint32_t new_offset;
     uint32_t vert_offset;
     float x;
     float y;
     float z;
-    int vertCount = 0;
-    for(auto item: *vertexMap)
-    {
-        const VertexIndex& index = item.first;
-        uint32_t new_index = item.second;
-        //P3D_LOGD("%d: %d/%d/%d > %d", vertCount, index.pos, index.uv, index.norm, new_index);
-
-        ++vertCount;
-        // pos
-        new_offset = (new_index + vertOffset) * 3;
-        vert_offset = m_pos_start + 4 * (3 * index.pos);
-        x = READ_FLOAT(data[vert_offset]);
-        vert_offset += 4;
-        y = READ_FLOAT(data[vert_offset]);
+    MeshVertex vertex;
+
+    // pos
+    vert_offset = m_pos_start + 4 * (3 * index.pos);
+    x = READ_FLOAT(data[vert_offset]);
+    vert_offset += 4;
+    y = READ_FLOAT(data[vert_offset]);
+    vert_offset += 4;
+    z = READ_FLOAT(data[vert_offset]);
+    if(x > ctx.maxX) ctx.maxX = x;
+    if(x < ctx.minX) ctx.minX = x;
+    if(y > ctx.maxY) ctx.maxY = y;
+    if(y < ctx.minY) ctx.minY = y;
+    if(z > ctx.maxZ) ctx.maxZ = z;
+    if(z < ctx.minZ) ctx.minZ = z;
+    vertex.pos[0] = x;
+    vertex.pos[1] = y;
+    vertex.pos[2] = z;
+
+    // uv
+    if(index.type == VT_POS_UV || index.type == VT_POS_UV_NORM)
+    {
+        vert_offset = m_tex_start + 4 * (2 * index.uv);
+        vertex.uv[0] = READ_FLOAT(data[vert_offset]);
         vert_offset += 4;
-        z = READ_FLOAT(data[vert_offset]);
-        if(x > m_maxX) m_maxX = x;
-        if(x < m_minX) m_minX = x;
-        if(y > m_maxY) m_maxY = y;
-        if(y < m_minY) m_minY = y;
-        if(z > m_maxZ) m_maxZ = z;
-        if(z < m_minZ) m_minZ = z;
-        new_pos[new_offset++] = x;
-        new_pos[new_offset++] = y;
-        new_pos[new_offset++] = z;
-
-        // uv
-        if(index.type == VT_POS_UV || index.type == VT_POS_UV_NORM)
-        {
-            new_offset = (new_index + vertOffset) * 2;
-            vert_offset = m_tex_start + 4 * (2 * index.uv);
-            new_uv[new_offset++] = READ_FLOAT(data[vert_offset]);
-            vert_offset += 4;
-            new_uv[new_offset++] = READ_FLOAT(data[vert_offset]);
-        }
-
-        // norm
-        new_offset = (new_index + vertOffset) * 3;
-        if(index.type == VT_POS_NORM || index.type == VT_POS_UV_NORM)
-        {
-            vert_offset = m_norm_start + (3 * index.norm);
-            new_norm[new_offset++] = static_cast<signed char>(data[vert_offset]) * norm_scale;
-            vert_offset += 1;
-            new_norm[new_offset++] = static_cast<signed char>(data[vert_offset]) * norm_scale;
-            vert_offset += 1;
-            new_norm[new_offset++] = static_cast<signed char>(data[vert_offset]) * norm_scale;
-        }
-        else
-        {
-            // store emtpy normal
-            new_norm[new_offset++] = 0.0f;
-            new_norm[new_offset++] = 0.0f;
-            new_norm[new_offset++] = 0.0f;
-        }
+        vertex.uv[1] = READ_FLOAT(data[vert_offset]);
+    }
+    else
+    {
+        vertex.uv[0] = 0.0f;
+        vertex.uv[1] = 0.0f;
     }
-}
 
-void BinLoader::nextChunk(uint32_t &chunk, BaseLoader::VertexType vtype, bool in_f4, uint32_t new_offset, uint32_t vertOffset, bool firstOfType)
-{
-    if(m_chunks.size() != 0)
+    // norm
+    if(index.type == VT_POS_NORM || index.type == VT_POS_UV_NORM)
     {
-        ++chunk;
+        vert_offset = m_norm_start + (3 * index.norm);
+        vertex.norm[0] = static_cast<signed char>(data[vert_offset]) * norm_scale;
+        vert_offset += 1;
+        vertex.norm[1] = static_cast<signed char>(data[vert_offset]) * norm_scale;
+        vert_offset += 1;
+        vertex.norm[2] = static_cast<signed char>(data[vert_offset]) * norm_scale;
     }
-    if(chunk >= m_chunks.size())
+    else if(m_crease_normals[index.type])
     {
-        while(chunk >= m_chunks.size()) m_chunks.push_back(MeshChunk());
+        const float* normal = m_crease_normals[index.type] + size_t(index.norm) * 3;
+        vertex.norm[0] = normal[0];
+        vertex.norm[1] = normal[1];
+        vertex.norm[2] = normal[2];
     }
     else
     {
-        m_chunks[chunk] = MeshChunk();
+        // store emtpy normal
+        vertex.norm[0] = 0.0f;
+        vertex.norm[1] = 0.0f;
+        vertex.norm[2] = 0.0f;
+        ctx.emptyNormCount += 3;
     }
-    MeshChunk& newChunk = m_chunks[chunk];
-    newChunk.f3Offset = new_offset;
-    newChunk.f4Offset = new_offset;
-
-    newChunk.validNormals = vtype == VT_POS_NORM || vtype == VT_POS_UV_NORM;
-    newChunk.hasUvs = vtype == VT_POS_UV || vtype == VT_POS_UV_NORM;
 
-    newChunk.vertOffset = vertOffset;
+    ctx.vertices.push_back(vertex);
+}
 
-    if(firstOfType)
+void BinLoader::nextChunk(ReindexContext &ctx, BaseLoader::VertexType vtype, bool in_f4, uint32_t new_offset, uint32_t vertOffset)
+{
+    // a chunk either continues the current vertex bank or starts a new one at the end
+    bool newBank = true;
+    if(ctx.chunks.size() != 0)
     {
-        newChunk.indexCount = m_new_index_count[vtype];
-        newChunk.f3Offset = m_new_f3_start[vtype];
-        newChunk.f4Offset = m_new_f4_start[vtype];
+        MeshChunk& oldChunk = ctx.chunks[ctx.chunks.size() - 1];
+        oldChunk.indexCount = new_offset - oldChunk.f3Offset;
+        oldChunk.vertCount = ctx.vertices.size() - oldChunk.vertOffset;
+        newBank = vertOffset != oldChunk.vertOffset;
     }
-    else
+    if(newBank)
     {
-        MeshChunk& oldChunk = m_chunks[chunk - 1];
-        if(!in_f4)
-        {
-            newChunk.f4Offset = oldChunk.f4Offset - new_offset;
-        }
-        newChunk.indexCount = oldChunk.indexCount - (new_offset - oldChunk.f3Offset);
-        oldChunk.indexCount = new_offset - oldChunk.f3Offset;
-        oldChunk.vertCount = (m_new_pos_count - oldChunk.vertOffset * 3) / 3;
+        ctx.vertexMap->clear();
     }
 
-    if(m_vertex_maps.count(newChunk.vertOffset) == 0)
+    MeshChunk newChunk;
+    newChunk.f3Offset = new_offset;
+    newChunk.f4Offset = in_f4 ? new_offset : m_new_f4_start[vtype];
+
+    newChunk.validNormals = vtype == VT_POS_NORM || vtype == VT_POS_UV_NORM || m_crease_groups[vtype];
+    newChunk.hasUvs = vtype == VT_POS_UV || vtype == VT_POS_UV_NORM;
+
+    newChunk.vertOffset = vertOffset;
+    ctx.chunks.push_back(newChunk);
+}
+
+void BinLoader::mergeContext(ReindexContext &into, ReindexContext &from)
+{
+    size_t i;
+    uint32_t vertBase = into.vertices.size();
+    size_t chunkBase = into.chunks.size();
+    into.chunks.append(from.chunks.data(), from.chunks.size());
+    for(i = chunkBase; i < into.chunks.size(); ++i)
     {
-        m_vertex_maps[newChunk.vertOffset] = new P3dMap<VertexIndex, uint32_t>(8192);
+        into.chunks[i].vertOffset += vertBase;
     }
+
+    into.vertices.append(from.vertices.data(), from.vertices.size());
+    from.vertices.clear();
+    into.emptyNormCount += from.emptyNormCount;
+
+    if(from.matCount > into.matCount) into.matCount = from.matCount;
+    if(from.maxX > into.maxX) into.maxX = from.maxX;
+    if(from.minX < into.minX) into.minX = from.minX;
+    if(from.maxY > into.maxY) into.maxY = from.maxY;
+    if(from.minY < into.minY) into.minY = from.minY;
+    if(from.maxZ > into.maxZ) into.maxZ = from.maxZ;
+    if(from.minZ < into.minZ) into.minZ = from.minZ;
 }
@@ -10,6 +10,12 @@
 #include "P3dVector.h"
 #include "glwrapper.h"
 
+//! \brief loads three.js binary models, reindexing their per attribute indices
+//! Streamed loads reindex a face section as soon as it is complete. A section
+//! has all position indices before the normal, uv and material ones, so it is
+//! the smallest part that can be reindexed; types that get crease normals also
+//! wait for their quad section. With LoadOptions::boundedStreaming only the
+//! vertex sections and the sections waiting for crease normals are kept.
 class BinLoader : public BaseLoader
 {
 public:
@@ -17,19 +23,90 @@ public:
     virtual ~BinLoader();
 
     bool load(const char* data, size_t size);
+    bool beginLoad(size_t totalSize);
+    bool appendData(const char* data, size_t size);
+    bool finishLoad();
 private:
-    size_t addPadding(size_t size);
+    //! \brief output of reindexing one or more face ranges
+    struct ReindexContext
+    {
+        ReindexContext();
+        ~ReindexContext();
+
+        P3dVector<MeshChunk> chunks;
+
+        // deduplicated vertices, written as they are first seen
+        P3dVector<MeshVertex> vertices;
+        uint32_t emptyNormCount;
+
+        uint16_t matCount;
+
+        // bounding box
+        float maxX;
+        float minX;
+        float maxY;
+        float minY;
+        float maxZ;
+        float minZ;
+
+        // vertex index map of the bank being filled
+        P3dMap<VertexIndex, uint32_t>* vertexMap;
+    };
+
+    //! \brief faces [firstFace, endFace) of a vertex type, tris are counted before quads
+    struct ReindexRange
+    {
+        VertexType vtype;
+        uint32_t firstFace;
+        uint32_t endFace;
+        //! goes on with the chunk and bank of the range before it in the same context
+        bool continues;
+    };
+
+    static const size_t HEADER_SIZE = 64;
+    //! face sections in file order: tris of VT_POS to VT_POS_UV_NORM, then quads
+    static const int SECTION_COUNT = 8;
 
-    bool reindex(const char *data);
-    uint32_t reindexType(uint32_t &chunk, VertexType vtype, const char* data,
-                         uint16_t *new_faces, uint16_t *new_mats);
-    void copyVertData(uint32_t vertOffset, P3dMap<VertexIndex, uint32_t>* vertexMap, const char* data,
-                      GLfloat* new_norm, GLfloat* new_uv, GLfloat* new_pos);
-    void nextChunk(uint32_t &chunk, VertexType vtype, bool in_f4, uint32_t new_offset,
-                   uint32_t vertOffset, bool firstOfType = false);
+    size_t addPadding(size_t size);
+    //! \brief reads counts and section offsets from the header
+    //! \arg fileSize receives the size the header describes
+    bool readHeader(const char* data, size_t size, size_t* fileSize);
+    static VertexType sectionType(int section) { return VertexType(3 - section % 4); }
+    size_t sectionStart(int section) const;
+    size_t sectionEnd(int section) const;
+
+    bool reindex();
+    //! \brief index layout and bank limits, returns a guess of the unique vertex count
+    size_t prepareReindex();
+    //! \brief hands the reindexed model to the ModelLoader
+    void finishReindex(ReindexContext& ctx, uint32_t* new_faces);
+    bool needsCreaseNormals(VertexType type) const;
+    void creaseNormals();
+    //! \arg positions decoded positions, decoded on the first call that needs them
+    void creaseNormals(VertexType type, float** positions);
+    void clearCreaseNormals();
+    void reindexRange(ReindexContext& ctx, const ReindexRange& range, uint32_t *new_faces);
+    void emitVertex(ReindexContext& ctx, const VertexIndex& index);
+    void nextChunk(ReindexContext& ctx, VertexType vtype, bool in_f4, uint32_t new_offset,
+                   uint32_t vertOffset);
+    void mergeContext(ReindexContext& into, ReindexContext& from);
+
+    bool startStream();
+    //! \brief reindexes the sections that arrived completely
+    void consumeSections();
+    void reindexSection(int section);
+    //! \brief frees the vertex maps of contexts that are done
+    void finishContexts(P3dVector<ReindexContext*>& contexts);
+    void dropSection(int section);
+    void clearStreamState();
 
     bool m_loaded;
 
+    // where reindexing reads, the loaded data or the kept parts of a streamed load
+    const char* m_vertex_data;
+    const char* m_f3_data[4];
+    const char* m_f4_data[4];
+
     uint32_t m_pos_count;
     uint32_t m_norm_count;
     uint32_t m_tex_count;
@@ -55,20 +132,31 @@ private:
     float m_minZ;
 
     // new data
-    P3dVector<MeshChunk> m_chunks;
-
-    P3dMap<uint32_t, P3dMap<VertexIndex, uint32_t>*> m_vertex_maps;
-
     uint32_t m_new_index_count[4];
     uint32_t m_new_f3_start[4];
     uint32_t m_new_f4_start[4];
 
     size_t m_total_index_count;
 
-    uint32_t m_new_pos_count;
-    uint32_t m_new_norm_count;
-    uint32_t m_new_empty_norm_count;
-    uint32_t m_new_uv_count;
+    // vertex bank limits, banks only split for 16 bit indices
+    uint32_t m_max_bank_vertices;
+    uint32_t m_bank_size_hint;
+
+    // normals split at creases for the types without normals, by corner in file order,
+    // the reindex keys vertices by corner group so split vertices come out as separate ones
+    uint32_t* m_crease_groups[4];
+    float* m_crease_normals[4];
+
+    // streamed load, m_file_size is 0 until the header arrived; m_stream keeps all data,
+    // or only the vertex sections when bounded and the face sections get a buffer each
+    size_t m_file_size = 0;
+    size_t m_received = 0;
+    bool m_bounded = false;
+    int m_next_section = 0;
+    uint32_t* m_new_faces = nullptr;
+    char* m_section_buffers[SECTION_COUNT];
+    //! reindexed ranges of each section, merged in index order by finishLoad
+    P3dVector<ReindexContext*> m_section_contexts[SECTION_COUNT];
 
 };
 
@@ -1,6 +1,17 @@
 #include "BlendLoader.h"
 #include "ModelLoader.h"
 #include "IMaterialsInfo.h"
+#include "P3dProfiler.h"
+#include "NormalGenerator.h"
+#include "P3dParallel.h"
+
+#if P3D_USE_THREADS
+#include <mutex>
+
+// fbt was written for one file at a time and nothing checks it for concurrent parses,
+// serialize them; loaders on other threads still reindex in parallel
+static std::mutex parseMutex;
+#endif
 
 static BlendLoader blendLoader;
 static RegisterLoader registerBlendLoader(&blendLoader, ".blend", 0);
@@ -15,22 +26,25 @@ bool BlendLoader::load(const char *data, size_t length)
 	m_modelLoader->clear();
 	m_chunks.clear();
 
-	logger.debug("Ready for  parsing blend\n");
-	converter.parse_blend(data, length);
-	logger.debug("Done parsing blend\n");
-	logger.debug("Initing blend data\n");
-	blendData.initBlendData(converter);
-	logger.debug("Done initing blend data\n");
+	{
+#if P3D_USE_THREADS
+		std::lock_guard<std::mutex> lock(parseMutex);
+#endif
+		logger.debug("Ready for  parsing blend\n");
+		converter.parse_blend(data, length);
+		logger.debug("Done parsing blend\n");
+		logger.debug("Initing blend data\n");
+		blendData.initBlendData(converter);
+		logger.debug("Done initing blend data\n");
+	}
 
-	uint64_t start = PlatformAdapter::currentMillis();
 	uint32_t chunk = 0;
 
-	uint16_t* new_faces = new uint16_t[blendData.totface*STRIDE];
+	uint32_t* new_faces = new uint32_t[blendData.totface*STRIDE];
 
 	/* initialize counters and indices */
 	m_new_pos_count = 0;
-	m_new_norm_count = 0;
-	m_new_uv_count = 0;
+	m_new_empty_norm_count = 0;
 	m_total_index_count = 0;
 
 	/* CANDIDATE FOR REMOVAL
@@ -47,16 +61,26 @@ bool BlendLoader::load(const char *data, size_t length)
 	m_new_f3_start[VT_POS] = 0;
 	m_total_index_count += m_new_index_count[VT_POS];
 
+	const LoadOptions& options = m_modelLoader->options();
+	if(options.creaseAngle < 180.0f && blendData.totface)
+	{
+		P3dProfiler::Scope scope(P3dProfiler::STAGE_NORMALS_CREASE);
+		m_crease_groups = new uint32_t[blendData.totface * 3];
+		m_crease_normals = new float[blendData.totface * 9];
+		NormalGenerator::creaseNormals(blendData.verts, blendData.totvert, blendData.faces, blendData.totface, 0,
+									   options.normalWeighting, options.creaseAngle,
+									   m_crease_groups, m_crease_normals);
+	}
+
 	/* reindex VT_POS */
 	reindexType(chunk, VT_POS, &blendData, new_faces);
 
-	GLfloat* new_pos = new GLfloat[blendData.totvert * STRIDE];
-	GLfloat* new_uv = new GLfloat[blendData.totuv * UVSTRIDE];
-	GLfloat* new_norm = new GLfloat[blendData.totvert * STRIDE];
+	uint32_t new_vert_count = m_new_pos_count / STRIDE;
+	MeshVertex* new_verts = new MeshVertex[new_vert_count]();
 
-	if(new_pos==NULL || new_uv==NULL || new_norm==NULL) return false;
+	if(new_verts==NULL) return false;
 
-	logger.debug("GLfloat buffers allocated");
+	logger.debug("vertex buffer allocated");
 
 	for(chunk = 0; chunk < m_chunks.size(); ++chunk)
 	{
@@ -75,40 +99,46 @@ bool BlendLoader::load(const char *data, size_t length)
 		logger.debug("vertex bank:");
 		logger.debug(" offset: %d", item.first);
 		logger.debug(" count: %d", item.second->size());
-		copyVertData(item.first, item.second, blendData, new_norm, new_uv, new_pos);
+		{
+			P3dProfiler::Scope scope(P3dProfiler::STAGE_COPY_VERT_DATA);
+			copyVertData(item.first, item.second, blendData, new_verts);
+		}
 		item.second->dumpBucketLoad();
+		P3dProfiler::add(P3dProfiler::COUNTER_MAP_LOOKUPS, item.second->lookupCount());
+		P3dProfiler::add(P3dProfiler::COUNTER_MAP_PROBES, item.second->probeCount());
 		delete item.second;
 	}
 
 	logger.debug("data copied");
 	m_vertex_maps.clear();
 
-	m_modelLoader->createModel(m_new_pos_count, m_new_norm_count, m_new_empty_norm_count, m_new_uv_count,
-				new_pos, new_norm, new_uv, m_total_index_count,
-				new_faces, m_chunks.size(), m_chunks.data());
+	// createModel quantizes against the box
+	m_modelLoader->setBoundingBox(m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ);
+	m_modelLoader->createModel(new_vert_count, m_new_empty_norm_count, new_verts,
+				m_total_index_count, new_faces, m_chunks.size(), m_chunks.data());
 
 	if(blendData.uvimage && strlen(blendData.uvimage)>0) {
-		m_modelLoader->materialsInfo()->setMaterialProperty(0, "diffuseTexture", blendData.uvimage);
+		m_modelLoader->setMaterialProperty(0, "diffuseTexture", blendData.uvimage);
 	}
 
-	delete [] new_norm;
-	delete [] new_uv;
-	delete [] new_pos;
+	delete [] new_verts;
 
 	delete [] new_faces;
 
+	delete [] m_crease_groups;
+	m_crease_groups = nullptr;
+	delete [] m_crease_normals;
+	m_crease_normals = nullptr;
+
 	m_loaded = true;
 
-	m_modelLoader->setBoundingBox(m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ);
 	m_modelLoader->setIsLoaded(m_loaded);
 
-	logger.debug("reindex took %lldms", PlatformAdapter::durationMillis(start));
-
 	return m_loaded;
 }
 
 void BlendLoader::reindexType(uint32_t &chunk, BlendLoader::VertexType vtype, const BlendData *blendData,
-								  uint16_t* new_faces)
+								  uint32_t* new_faces)
 {
 	uint32_t pos_offset;
 	uint16_t mat = 0;
@@ -118,7 +148,8 @@ void BlendLoader::reindexType(uint32_t &chunk, BlendLoader::VertexType vtype, co
 	uint32_t verts;
 	uint32_t new_offset;
 
-	uint64_t start = PlatformAdapter::currentMillis();
+	// reindex stages are in VertexType order
+	P3dProfiler::Scope scope(static_cast<P3dProfiler::Stage>(P3dProfiler::STAGE_REINDEX_POS_UV_NORM + vtype));
 
 	P3dMap<VertexIndex, uint32_t>* vertexMap = nullptr;
 
@@ -129,7 +160,6 @@ void BlendLoader::reindexType(uint32_t &chunk, BlendLoader::VertexType vtype, co
 
 	VertexIndex index;
 	index.type = vtype;
-	uint16_t new_index;
 	new_offset = 0; //TODO: should be passed in?
 
 	for(face = 0; face < fcount; ++face)
@@ -151,8 +181,9 @@ void BlendLoader::reindexType(uint32_t &chunk, BlendLoader::VertexType vtype, co
 			vertexMap = m_vertex_maps[m_chunks[chunk].vertOffset];
 		}
 
-		/* if we get more than 65530 vertices in map we need start new chunk. */
-		if(vertexMap->size() > 65530)
+		/* if we get more than 65530 vertices in map we need start new chunk,
+		 * unless the indices are 32 bit. */
+		if(!m_modelLoader->uint32Indices() && vertexMap->size() > 65530)
 		{
 			// next chunk
 			nextChunk(chunk, vtype, new_offset, m_new_pos_count / 3, false);
@@ -165,37 +196,26 @@ void BlendLoader::reindexType(uint32_t &chunk, BlendLoader::VertexType vtype, co
 		for(vert = 0; vert < verts; ++vert)
 		{
 			index.pos = blendData->faces[pos_offset];
+			index.norm = m_crease_groups ? m_crease_groups[pos_offset] : 0;
 			pos_offset++;
-
-			/* TODO: norm */
-			index.norm = 0;
 			index.uv = index.pos;
 
-			if(vertexMap->count(index))
-			{
-				new_index = (*vertexMap)[index];
-			}
-			else
+			bool inserted;
+			auto slot = vertexMap->findOrInsert(index, &inserted);
+			if(inserted)
 			{
-				new_index = vertexMap->size();
-				vertexMap->insert(index, new_index);
+				slot->second = vertexMap->size() - 1;
 
 				m_new_pos_count += 3;
-
-				m_new_norm_count += 3;
-				m_new_empty_norm_count += 3;
-
-				m_new_uv_count += 2;
+				if(!m_crease_groups) m_new_empty_norm_count += 3;
 			}
 
-			new_faces[new_offset] = (uint16_t)new_index;
+			new_faces[new_offset] = slot->second;
 			++new_offset;
 		}
 	}
 
 	m_chunks[chunk].vertCount = (m_new_pos_count - STRIDE * m_chunks[chunk].vertOffset) / 3;
-
-	logger.debug("reindex type Blender took: %lldms", PlatformAdapter::durationMillis(start));
 }
 
 void BlendLoader::nextChunk(uint32_t &chunk, BlendLoader::VertexType vtype, uint32_t new_offset,
@@ -220,7 +240,7 @@ void BlendLoader::nextChunk(uint32_t &chunk, BlendLoader::VertexType vtype, uint
 	newChunk.indexCount = m_new_index_count[vtype];
 	newChunk.f3Offset = new_offset;
 
-	newChunk.validNormals = vtype == VT_POS_NORM || vtype == VT_POS_UV_NORM;
+	newChunk.validNormals = vtype == VT_POS_NORM || vtype == VT_POS_UV_NORM || m_crease_groups;
 	newChunk.hasUvs = vtype == VT_POS_UV || vtype == VT_POS_UV_NORM;
 
 	newChunk.vertOffset = vertOffset;
@@ -241,16 +261,18 @@ void BlendLoader::nextChunk(uint32_t &chunk, BlendLoader::VertexType vtype, uint
 
 	if(m_vertex_maps.count(newChunk.vertOffset) == 0)
 	{
-		m_vertex_maps[newChunk.vertOffset] = new P3dMap<VertexIndex, uint32_t>(8192);
+		// a 16 bit bank never gets much over 65530 vertices, sizing for that avoids rehashing
+		uint32_t capacity = m_new_index_count[vtype];
+		if(!m_modelLoader->uint32Indices() && capacity > 65536) capacity = 65536;
+		m_vertex_maps[newChunk.vertOffset] = new P3dMap<VertexIndex, uint32_t>(capacity);
 	}
 }
 
 
 
 void BlendLoader::copyVertData(uint32_t vertOffset, P3dMap<VertexIndex, uint32_t>* vertexMap, const BlendData& data,
-							   GLfloat* new_norm, GLfloat* new_uv, GLfloat* new_pos)
+							   MeshVertex* new_verts)
 {
-	uint32_t new_offset = 0;
 	uint32_t vert_offset = vertOffset;
 	float x;
 	float y;
@@ -264,9 +286,10 @@ void BlendLoader::copyVertData(uint32_t vertOffset, P3dMap<VertexIndex, uint32_t
 		uint32_t new_index = item.second;
 		//logger.debug("%u: %u/%u/%u > %u", vertCount, index.pos, index.uv, index.norm, new_index);
 
+		MeshVertex& vertex = new_verts[new_index + vertOffset];
+
 		// pos
 		vert_offset = index.pos * STRIDE;
-		new_offset = (new_index + vertOffset) * STRIDE;
 
 		x = data.verts[vert_offset];
 		++vert_offset;
@@ -283,26 +306,33 @@ void BlendLoader::copyVertData(uint32_t vertOffset, P3dMap<VertexIndex, uint32_t
 		if(y < m_minY) m_minY = y;
 		if(z > m_maxZ) m_maxZ = z;
 		if(z < m_minZ) m_minZ = z;
-		new_pos[new_offset++] = x;
-		new_pos[new_offset++] = y;
-		new_pos[new_offset] = z;
+		vertex.pos[0] = x;
+		vertex.pos[1] = y;
+		vertex.pos[2] = z;
 
 		// norm
-		vert_offset = index.pos * STRIDE;
-		new_offset = (new_index + vertOffset) * STRIDE;
-		// store empty normal
-		// TODO: actual normal storage if present in BlendData
-		new_norm[new_offset] = .5f;
-		new_norm[new_offset] = .5f;
-		new_norm[new_offset] = .5f;
+		if(m_crease_normals)
+		{
+			const float* normal = m_crease_normals + size_t(index.norm) * 3;
+			vertex.norm[0] = normal[0];
+			vertex.norm[1] = normal[1];
+			vertex.norm[2] = normal[2];
+		}
+		else
+		{
+			// store empty normal
+			// TODO: actual normal storage if present in BlendData
+			vertex.norm[0] = .5f;
+			vertex.norm[1] = .5f;
+			vertex.norm[2] = .5f;
+		}
 
 		// uv
 		if(data.uvs)
 		{
 			vert_offset = index.pos * UVSTRIDE;
-			new_offset = (new_index + vertOffset) * UVSTRIDE;
-			new_uv[new_offset++] = data.uvs[vert_offset++];
-			new_uv[new_offset++] = data.uvs[vert_offset++];
+			vertex.uv[0] = data.uvs[vert_offset++];
+			vertex.uv[1] = data.uvs[vert_offset++];
 		}
 
 	}
@@ -150,9 +150,9 @@ public:
 
 private:
 	void reindexType(uint32_t &chunk, VertexType vtype, const BlendData *blendData,
-						 uint16_t *new_faces);
+						 uint32_t *new_faces);
 	void copyVertData(uint32_t vertOffset, P3dMap<VertexIndex, uint32_t>* vertexMap, const BlendData& data,
-					  GLfloat* new_norm, GLfloat* new_uv, GLfloat* new_pos);
+					  MeshVertex* new_verts);
 	void nextChunk(uint32_t &chunk, BaseLoader::VertexType vtype, uint32_t new_offset,
 				   uint32_t vertOffset, bool firstOfType = false);
 
@@ -178,9 +178,11 @@ private:
 	size_t m_total_index_count = 0;
 
 	uint32_t m_new_pos_count = 0;
-	uint32_t m_new_norm_count = 0;
 	uint32_t m_new_empty_norm_count = 0;
-	uint32_t m_new_uv_count = 0;
+
+	// normals split at creases, per face corner, only when LoadOptions::creaseAngle < 180
+	uint32_t* m_crease_groups = nullptr;
+	float* m_crease_normals = nullptr;
 };
 
 #endif // BLENDLOADER_H
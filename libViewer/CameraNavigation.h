@@ -36,6 +36,7 @@ public:
 
     //! \brief camera distance from origin
     float cameraDist() const { return glm::length(m_pos); }
+    glm::vec3 position() const { return m_pos; }
 
 protected:
     glm::vec3 getArcballVector(float x, float y);
@@ -0,0 +1,245 @@
+#include "MeshOptimizer.h"
+#include "BaseLoader.h"
+#include <algorithm>
+#include <cstring>
+
+float MeshOptimizer::acmr(const uint32_t *indices, uint32_t indexCount, uint32_t cacheSize)
+{
+    if(indexCount < 3)
+    {
+        return 0.0f;
+    }
+
+    // ring buffer FIFO, small enough to search linearly
+    uint32_t* cache = new uint32_t[cacheSize];
+    uint32_t cached = 0;
+    uint32_t head = 0;
+    uint32_t misses = 0;
+
+    for(uint32_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t index = indices[i];
+        bool hit = false;
+        for(uint32_t c = 0; c < cached; ++c)
+        {
+            if(cache[c] == index)
+            {
+                hit = true;
+                break;
+            }
+        }
+        if(!hit)
+        {
+            ++misses;
+            cache[head] = index;
+            head = (head + 1) % cacheSize;
+            if(cached < cacheSize) ++cached;
+        }
+    }
+
+    delete [] cache;
+    return static_cast<float>(misses) / (indexCount / 3);
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t *indices, uint32_t indexCount, uint32_t vertexCount,
+                                        uint32_t cacheSize)
+{
+    // Sander, Nehab, Barczak: Fast Triangle Reordering for Vertex Locality and Reduced Overdraw
+    uint32_t triCount = indexCount / 3;
+    if(triCount < 2 || vertexCount == 0)
+    {
+        return;
+    }
+
+    uint32_t i;
+    uint32_t v;
+
+    // vertex to triangle adjacency as offsets into one array
+    uint32_t* live = new uint32_t[vertexCount]();
+    for(i = 0; i < triCount * 3; ++i)
+    {
+        ++live[indices[i]];
+    }
+    uint32_t* adjOffset = new uint32_t[vertexCount + 1];
+    adjOffset[0] = 0;
+    for(v = 0; v < vertexCount; ++v)
+    {
+        adjOffset[v + 1] = adjOffset[v] + live[v];
+    }
+    uint32_t* adjFill = new uint32_t[vertexCount];
+    memcpy(adjFill, adjOffset, vertexCount * sizeof(uint32_t));
+    uint32_t* adjacency = new uint32_t[triCount * 3];
+    for(i = 0; i < triCount * 3; ++i)
+    {
+        adjacency[adjFill[indices[i]]++] = i / 3;
+    }
+    delete [] adjFill;
+
+    uint32_t* cacheTime = new uint32_t[vertexCount]();
+    bool* emitted = new bool[triCount]();
+    uint32_t* deadEnd = new uint32_t[triCount * 3];
+    uint32_t deadEndSize = 0;
+    uint32_t* candidates = new uint32_t[triCount * 3];
+    uint32_t* result = new uint32_t[triCount * 3];
+    uint32_t resultSize = 0;
+
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+    int64_t fan = indices[0];
+
+    while(fan >= 0)
+    {
+        uint32_t candidateCount = 0;
+
+        // emit all remaining triangles around the fanning vertex
+        for(uint32_t a = adjOffset[fan]; a < adjOffset[fan + 1]; ++a)
+        {
+            uint32_t tri = adjacency[a];
+            if(emitted[tri])
+            {
+                continue;
+            }
+            emitted[tri] = true;
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                v = indices[3 * tri + k];
+                result[resultSize++] = v;
+                deadEnd[deadEndSize++] = v;
+                candidates[candidateCount++] = v;
+                --live[v];
+                if(time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time;
+                    ++time;
+                }
+            }
+        }
+
+        // next fan: the candidate that stays in cache longest and still has triangles
+        fan = -1;
+        int64_t best = -1;
+        for(uint32_t c = 0; c < candidateCount; ++c)
+        {
+            v = candidates[c];
+            if(live[v] == 0)
+            {
+                continue;
+            }
+            int64_t priority = 0;
+            if(time - cacheTime[v] + 2 * live[v] <= cacheSize)
+            {
+                priority = time - cacheTime[v];
+            }
+            if(priority > best)
+            {
+                best = priority;
+                fan = v;
+            }
+        }
+
+        // dead end, go back to recently used vertices and then to the input order
+        while(fan < 0 && deadEndSize)
+        {
+            v = deadEnd[--deadEndSize];
+            if(live[v] > 0)
+            {
+                fan = v;
+            }
+        }
+        while(fan < 0 && cursor < vertexCount)
+        {
+            if(live[cursor] > 0)
+            {
+                fan = cursor;
+            }
+            ++cursor;
+        }
+    }
+
+    memcpy(indices, result, resultSize * sizeof(uint32_t));
+
+    delete [] result;
+    delete [] candidates;
+    delete [] deadEnd;
+    delete [] emitted;
+    delete [] cacheTime;
+    delete [] adjacency;
+    delete [] adjOffset;
+    delete [] live;
+}
+
+void MeshOptimizer::optimizeBankVertexCache(uint32_t *indices, uint32_t indexCount, uint32_t bankVertexCount,
+                                            uint32_t cacheSize)
+{
+    // renumbering sorts the list, per index that costs about as much as 20 bank vertices
+    if(indexCount >= bankVertexCount / 32)
+    {
+        optimizeVertexCache(indices, indexCount, bankVertexCount, cacheSize);
+        return;
+    }
+
+    // ascending like the bank, so the input order fallback visits vertices in the same order
+    uint32_t i;
+    uint32_t* used = new uint32_t[indexCount];
+    memcpy(used, indices, indexCount * sizeof(uint32_t));
+    std::sort(used, used + indexCount);
+    uint32_t vertexCount = std::unique(used, used + indexCount) - used;
+    for(i = 0; i < indexCount; ++i)
+    {
+        indices[i] = std::lower_bound(used, used + vertexCount, indices[i]) - used;
+    }
+
+    optimizeVertexCache(indices, indexCount, vertexCount, cacheSize);
+
+    for(i = 0; i < indexCount; ++i)
+    {
+        indices[i] = used[indices[i]];
+    }
+    delete [] used;
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshVertex *vertices, uint32_t vertexCount,
+                                        uint32_t **lists, const uint32_t *listCounts, size_t listCount)
+{
+    if(vertexCount == 0)
+    {
+        return;
+    }
+
+    uint32_t v;
+    uint32_t* remap = new uint32_t[vertexCount];
+    memset(remap, 0xff, vertexCount * sizeof(uint32_t));
+    uint32_t next = 0;
+
+    for(size_t list = 0; list < listCount; ++list)
+    {
+        uint32_t* indices = lists[list];
+        for(uint32_t i = 0; i < listCounts[list]; ++i)
+        {
+            uint32_t& target = remap[indices[i]];
+            if(target == UINT32_MAX)
+            {
+                target = next++;
+            }
+            indices[i] = target;
+        }
+    }
+
+    for(v = 0; v < vertexCount; ++v)
+    {
+        if(remap[v] == UINT32_MAX)
+        {
+            remap[v] = next++;
+        }
+    }
+
+    MeshVertex* reordered = new MeshVertex[vertexCount];
+    for(v = 0; v < vertexCount; ++v)
+    {
+        reordered[remap[v]] = vertices[v];
+    }
+    memcpy(vertices, reordered, vertexCount * sizeof(MeshVertex));
+
+    delete [] reordered;
+    delete [] remap;
+}
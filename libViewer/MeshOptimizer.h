@@ -0,0 +1,37 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <cstdint>
+#include <cstdlib>
+
+struct MeshVertex;
+
+//! \brief reorders reindexed triangle lists for the GPU vertex caches
+class MeshOptimizer
+{
+public:
+    //! \brief average cache miss ratio, transformed vertices per triangle with a FIFO cache
+    //! 0.5 is the best possible for big regular meshes, 3 means no reuse at all
+    static float acmr(const uint32_t* indices, uint32_t indexCount, uint32_t cacheSize = 16);
+
+    //! \brief reorders the triangles of a list for post-transform cache hits (Tipsify)
+    //! \arg vertexCount must be larger than any index in the list
+    static void optimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+                                    uint32_t cacheSize = 16);
+
+    //! \brief optimizeVertexCache for a list that draws from part of a vertex bank
+    //! optimizeVertexCache sizes its per vertex state by the vertex count. Lists that
+    //! use a small part of their bank are renumbered to their own vertices first, so
+    //! the cost follows the list and not the bank.
+    //! \arg bankVertexCount must be larger than any index in the list
+    static void optimizeBankVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t bankVertexCount,
+                                        uint32_t cacheSize = 16);
+
+    //! \brief renumbers vertices in the order the index lists first use them
+    //! Lists share the vertex range, unused vertices are moved to the end.
+    //! \arg lists index lists as (pointer, count) pairs, all are remapped
+    static void optimizeVertexFetch(MeshVertex* vertices, uint32_t vertexCount,
+                                    uint32_t** lists, const uint32_t* listCounts, size_t listCount);
+};
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,372 @@
+#include "MeshSimplifier.h"
+#include "BaseLoader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+static const uint32_t NO_COLLAPSE = UINT32_MAX;
+static const int MAX_PASSES = 32;
+// squared cosine of the largest turn of a triangle's normal in a collapse, 75 degrees
+static const float MIN_COS2 = 0.067f;
+
+//! \brief sum of squared distances to the planes of a vertex's triangles
+//! The symmetric matrix of n * n^T, the vector of n * d and d * d, all weighted
+//! by triangle area; divided by the weight it is a mean squared distance.
+struct Quadric
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+static void addPlane(Quadric& q, const double* n, double d, double weight)
+{
+    q.a00 += weight * n[0] * n[0];
+    q.a01 += weight * n[0] * n[1];
+    q.a02 += weight * n[0] * n[2];
+    q.a11 += weight * n[1] * n[1];
+    q.a12 += weight * n[1] * n[2];
+    q.a22 += weight * n[2] * n[2];
+    q.b0 += weight * n[0] * d;
+    q.b1 += weight * n[1] * d;
+    q.b2 += weight * n[2] * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+static void addQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a22 += other.a22;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+//! \brief mean squared distance of p to the planes of both quadrics
+static float collapseError(const Quadric& q, const Quadric& r, const float* p)
+{
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    double sum = (q.a00 + r.a00) * x * x + 2.0 * (q.a01 + r.a01) * x * y + 2.0 * (q.a02 + r.a02) * x * z
+            + (q.a11 + r.a11) * y * y + 2.0 * (q.a12 + r.a12) * y * z + (q.a22 + r.a22) * z * z
+            + 2.0 * ((q.b0 + r.b0) * x + (q.b1 + r.b1) * y + (q.b2 + r.b2) * z) + q.c + r.c;
+    double weight = q.weight + r.weight;
+    return weight > 0.0 && sum > 0.0 ? float(sum / weight) : 0.0f;
+}
+
+static void cross(const float* a, const float* b, const float* c, float* n)
+{
+    float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+uint32_t MeshSimplifier::simplify(uint32_t *destination, const uint32_t *indices, uint32_t indexCount,
+                                  const MeshVertex *vertices, uint32_t targetIndexCount, float *error)
+{
+    *error = 0.0f;
+    if(indexCount <= targetIndexCount || indexCount % 3)
+    {
+        memcpy(destination, indices, indexCount * sizeof(uint32_t));
+        return indexCount;
+    }
+
+    uint32_t i;
+    uint32_t t;
+    int c;
+
+    // the vertices of the list numbered from 0, banks can be far bigger than one list
+    uint32_t* used = new uint32_t[indexCount];
+    memcpy(used, indices, indexCount * sizeof(uint32_t));
+    std::sort(used, used + indexCount);
+    uint32_t vertexCount = std::unique(used, used + indexCount) - used;
+    uint32_t* tris = new uint32_t[indexCount];
+    for(i = 0; i < indexCount; ++i)
+    {
+        tris[i] = std::lower_bound(used, used + vertexCount, indices[i]) - used;
+    }
+    auto pos = [vertices, used](uint32_t vertex)
+    {
+        return vertices[used[vertex]].pos;
+    };
+
+    // vertices sharing a position are the two sides of a seam, both stay
+    uint32_t* position = new uint32_t[vertexCount];
+    bool* locked = new bool[vertexCount];
+    for(i = 0; i < vertexCount; ++i)
+    {
+        position[i] = i;
+    }
+    std::sort(position, position + vertexCount, [&pos](uint32_t a, uint32_t b)
+    {
+        const float* pa = pos(a);
+        const float* pb = pos(b);
+        if(pa[0] != pb[0]) return pa[0] < pb[0];
+        if(pa[1] != pb[1]) return pa[1] < pb[1];
+        return pa[2] < pb[2];
+    });
+    uint32_t* sorted = position;
+    position = new uint32_t[vertexCount];
+    for(i = 0; i < vertexCount; )
+    {
+        const float* first = pos(sorted[i]);
+        uint32_t end = i + 1;
+        while(end < vertexCount && pos(sorted[end])[0] == first[0] && pos(sorted[end])[1] == first[1]
+              && pos(sorted[end])[2] == first[2])
+        {
+            ++end;
+        }
+        for(uint32_t j = i; j < end; ++j)
+        {
+            position[sorted[j]] = sorted[i];
+            locked[sorted[j]] = end - i > 1;
+        }
+        i = end;
+    }
+    delete [] sorted;
+
+    // edges between positions, open borders belong to one triangle and
+    // non manifold edges to more than two, their ends stay as well
+    uint64_t* edges = new uint64_t[indexCount];
+    for(t = 0; t < indexCount / 3; ++t)
+    {
+        for(c = 0; c < 3; ++c)
+        {
+            uint64_t a = position[tris[t * 3 + c]];
+            uint64_t b = position[tris[t * 3 + (c + 1) % 3]];
+            edges[t * 3 + c] = a < b ? (a << 32 | b) : (b << 32 | a);
+        }
+    }
+    std::sort(edges, edges + indexCount);
+    for(i = 0; i < indexCount; )
+    {
+        uint32_t end = i + 1;
+        while(end < indexCount && edges[end] == edges[i])
+        {
+            ++end;
+        }
+        if(end - i != 2)
+        {
+            locked[edges[i] >> 32] = true;
+            locked[edges[i] & 0xffffffffu] = true;
+        }
+        i = end;
+    }
+    delete [] edges;
+    for(i = 0; i < vertexCount; ++i)
+    {
+        locked[i] = locked[i] || locked[position[i]];
+    }
+    delete [] position;
+
+    // planes of the triangles around every vertex
+    Quadric* quadrics = new Quadric[vertexCount];
+    memset(quadrics, 0, vertexCount * sizeof(Quadric));
+    for(t = 0; t < indexCount / 3; ++t)
+    {
+        const float* p0 = pos(tris[t * 3]);
+        float normal[3];
+        cross(p0, pos(tris[t * 3 + 1]), pos(tris[t * 3 + 2]), normal);
+        double n[3] = {normal[0], normal[1], normal[2]};
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if(length <= 0.0)
+        {
+            continue;
+        }
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for(c = 0; c < 3; ++c)
+        {
+            addPlane(quadrics[tris[t * 3 + c]], n, d, length * 0.5);
+        }
+    }
+
+    // passes of the cheapest collapses that don't share triangles, the
+    // adjacency and the costs are rebuilt between them
+    uint32_t* collapse = new uint32_t[vertexCount];
+    float* cost = new float[vertexCount];
+    uint32_t* remap = new uint32_t[vertexCount];
+    bool* touched = new bool[vertexCount];
+    uint32_t* candidates = new uint32_t[vertexCount];
+    uint32_t* adjacencyOffsets = new uint32_t[vertexCount + 1];
+    uint32_t* adjacency = new uint32_t[indexCount];
+    uint32_t triCount = indexCount / 3;
+    float maxError = 0.0f;
+    for(int pass = 0; pass < MAX_PASSES && triCount * 3 > targetIndexCount; ++pass)
+    {
+        memset(adjacencyOffsets, 0, (vertexCount + 1) * sizeof(uint32_t));
+        for(i = 0; i < triCount * 3; ++i)
+        {
+            ++adjacencyOffsets[tris[i] + 1];
+        }
+        for(i = 0; i < vertexCount; ++i)
+        {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        for(t = 0; t < triCount; ++t)
+        {
+            for(c = 0; c < 3; ++c)
+            {
+                adjacency[adjacencyOffsets[tris[t * 3 + c]]++] = t;
+            }
+        }
+        // filling moved every offset to the start of the next vertex
+        for(i = vertexCount; i > 0; --i)
+        {
+            adjacencyOffsets[i] = adjacencyOffsets[i - 1];
+        }
+        adjacencyOffsets[0] = 0;
+
+        for(i = 0; i < vertexCount; ++i)
+        {
+            collapse[i] = NO_COLLAPSE;
+            cost[i] = FLT_MAX;
+            remap[i] = i;
+            touched[i] = false;
+        }
+        for(t = 0; t < triCount; ++t)
+        {
+            for(c = 0; c < 3; ++c)
+            {
+                uint32_t a = tris[t * 3 + c];
+                if(locked[a])
+                {
+                    continue;
+                }
+                for(int other = 1; other < 3; ++other)
+                {
+                    uint32_t b = tris[t * 3 + (c + other) % 3];
+                    float e = collapseError(quadrics[a], quadrics[b], pos(b));
+                    if(e < cost[a])
+                    {
+                        cost[a] = e;
+                        collapse[a] = b;
+                    }
+                }
+            }
+        }
+        uint32_t candidateCount = 0;
+        for(i = 0; i < vertexCount; ++i)
+        {
+            if(collapse[i] != NO_COLLAPSE)
+            {
+                candidates[candidateCount++] = i;
+            }
+        }
+        std::sort(candidates, candidates + candidateCount, [cost](uint32_t a, uint32_t b)
+        {
+            return cost[a] < cost[b];
+        });
+
+        // interior collapses remove two triangles each
+        uint32_t limit = (triCount - targetIndexCount / 3 + 1) / 2;
+        uint32_t collapsed = 0;
+        for(uint32_t candidate = 0; candidate < candidateCount && collapsed < limit; ++candidate)
+        {
+            uint32_t a = candidates[candidate];
+            uint32_t b = collapse[a];
+            if(touched[a] || touched[b])
+            {
+                continue;
+            }
+            // triangles that stay must not turn over or stand up on their edge
+            bool flips = false;
+            for(uint32_t adj = adjacencyOffsets[a]; adj < adjacencyOffsets[a + 1] && !flips; ++adj)
+            {
+                const uint32_t* tri = tris + adjacency[adj] * 3;
+                if(tri[0] == b || tri[1] == b || tri[2] == b)
+                {
+                    continue;
+                }
+                const float* p[3];
+                const float* moved[3];
+                for(c = 0; c < 3; ++c)
+                {
+                    p[c] = pos(tri[c]);
+                    moved[c] = tri[c] == a ? pos(b) : p[c];
+                }
+                float before[3];
+                float after[3];
+                cross(p[0], p[1], p[2], before);
+                cross(moved[0], moved[1], moved[2], after);
+                float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                float lengths = (before[0] * before[0] + before[1] * before[1] + before[2] * before[2])
+                        * (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+                flips = dot <= 0.0f || dot * dot < MIN_COS2 * lengths;
+            }
+            if(flips)
+            {
+                continue;
+            }
+
+            remap[a] = b;
+            addQuadric(quadrics[b], quadrics[a]);
+            maxError = std::max(maxError, cost[a]);
+            touched[a] = true;
+            touched[b] = true;
+            for(uint32_t adj = adjacencyOffsets[a]; adj < adjacencyOffsets[a + 1]; ++adj)
+            {
+                for(c = 0; c < 3; ++c)
+                {
+                    touched[tris[adjacency[adj] * 3 + c]] = true;
+                }
+            }
+            ++collapsed;
+        }
+        if(!collapsed)
+        {
+            break;
+        }
+
+        // triangles that lost an edge are gone
+        uint32_t write = 0;
+        for(t = 0; t < triCount; ++t)
+        {
+            uint32_t v0 = remap[tris[t * 3]];
+            uint32_t v1 = remap[tris[t * 3 + 1]];
+            uint32_t v2 = remap[tris[t * 3 + 2]];
+            if(v0 != v1 && v1 != v2 && v0 != v2)
+            {
+                tris[write * 3] = v0;
+                tris[write * 3 + 1] = v1;
+                tris[write * 3 + 2] = v2;
+                ++write;
+            }
+        }
+        triCount = write;
+    }
+
+    for(i = 0; i < triCount * 3; ++i)
+    {
+        destination[i] = used[tris[i]];
+    }
+    *error = sqrtf(maxError);
+
+    delete [] adjacency;
+    delete [] adjacencyOffsets;
+    delete [] candidates;
+    delete [] touched;
+    delete [] remap;
+    delete [] cost;
+    delete [] collapse;
+    delete [] quadrics;
+    delete [] locked;
+    delete [] tris;
+    delete [] used;
+    return triCount * 3;
+}
@@ -0,0 +1,26 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstdint>
+#include <cstdlib>
+
+struct MeshVertex;
+
+//! \brief reduces reindexed triangle lists for coarser levels of detail
+class MeshSimplifier
+{
+public:
+    //! \brief collapses edges by quadric error (Garland, Heckbert) until at most
+    //! targetIndexCount indices are left, or no collapse is possible
+    //! Vertices on open borders and on seams, where reindexing split a position
+    //! into several vertices for different normals or uvs, never move, so
+    //! outlines and texture or shading discontinuities stay where they are.
+    //! \arg destination room for indexCount indices, not the same memory as indices
+    //! \arg vertices the indices point into, only positions are read
+    //! \arg error receives the distance the surface moved at most, in model units
+    //! \return index count of the simplified list
+    static uint32_t simplify(uint32_t* destination, const uint32_t* indices, uint32_t indexCount,
+                             const MeshVertex* vertices, uint32_t targetIndexCount, float* error);
+};
+
+#endif // MESHSIMPLIFIER_H
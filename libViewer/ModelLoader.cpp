@@ -1,7 +1,18 @@
 #include "ModelLoader.h"
 #include "PlatformAdapter.h"
 #include "glwrapper.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "P3dParallel.h"
+#include "P3dProfiler.h"
+#include "NormalGenerator.h"
+#include "P3dLoader.h"
+#include "IMaterialsInfo.h"
 #include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -9,6 +20,25 @@
 
 #define STRIDE 3
 
+// weld entry of vertices that keep their normal
+static const uint32_t NO_POSITION = UINT32_MAX;
+
+// chunks smaller than this are drawn in full detail at any distance
+static const uint32_t MIN_LOD_INDICES = 3 * 256;
+
+// normals cache file: header, then xyz of every generated normal in vertex order
+static const char NORMALS_CACHE_MAGIC[4] = {'P', '3', 'D', 'N'};
+static const uint32_t NORMALS_CACHE_VERSION = 1;
+
+struct NormalsCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t vertCount;
+    uint32_t normalCount;
+};
+
 static P3dLogger logger("core.ModelLoader", P3dLogger::LOG_DEBUG);
 
 struct GLBuffers
@@ -18,9 +48,8 @@ struct GLBuffers
         memset(this, 0, sizeof(GLBuffers));
     }
 
-    GLuint posBuffer;
-    GLuint uvBuffer;
-    GLuint normBuffer;
+    GLuint vertexBuffer;
+    GLuint vertexArray;
     uint32_t vertCount;
 };
 
@@ -57,20 +86,6 @@ size_t ModelLoader::VertexIndex::hash() const
     return h1;
 }
 
-template<>
-struct P3dHash<glm::vec3>
-{
-    size_t operator() (const glm::vec3& k) const
-    {
-        size_t h1 = *((uint32_t*) &k.x);
-        size_t h2 = *((uint32_t*) &k.y);
-        h1 ^= h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2);
-        h2 = *((uint32_t*) &k.z);
-        h1 ^= h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2);
-        return h1;
-    }
-};
-
 ModelLoader::ModelLoader(IMaterialsInfo *materialsInfo)
 {
     m_materialInfo = materialsInfo;
@@ -93,18 +108,20 @@ void ModelLoader::clear()
     if(m_loaded)
     {
         m_loaded = false;
+        // buffers stay 0 while uploads are pending, e.g. offline conversion never uploads
         for(auto item: m_gl_buffers)
         {
-            glDeleteBuffers(1, &item.second->posBuffer);
-            glDeleteBuffers(1, &item.second->uvBuffer);
-            glDeleteBuffers(1, &item.second->normBuffer);
+            if(item.second->vertexBuffer) glDeleteBuffers(1, &item.second->vertexBuffer);
+#if P3D_VERTEX_ARRAYS
+            if(item.second->vertexArray) p3dDeleteVertexArrays(1, &item.second->vertexArray);
+#endif
             delete item.second;
         }
         m_gl_buffers.clear();
 
         m_chunks.clear();
 
-        glDeleteBuffers(1, &m_index_buffer);
+        if(m_index_buffer) glDeleteBuffers(1, &m_index_buffer);
         m_index_buffer = 0;
 
         for(auto item: m_vertex_maps)
@@ -114,22 +131,70 @@ void ModelLoader::clear()
         m_vertex_maps.clear();
 
         m_mat_count = 1;
+        m_quantized = false;
+        m_clustered = false;
+        m_bvh.clear();
     }
+    m_stream_end = nullptr;
+    clearPending();
+    clearModelFile();
 }
 
-GLuint ModelLoader::posBuffer(uint32_t chunk)
+GLuint ModelLoader::vertexBuffer(uint32_t chunk)
 {
-    return m_gl_buffers[m_chunks[chunk].vertOffset]->posBuffer;
+    return m_gl_buffers[m_chunks[chunk].vertOffset]->vertexBuffer;
 }
 
-GLuint ModelLoader::uvBuffer(uint32_t chunk)
+GLuint ModelLoader::vertexArray(uint32_t chunk)
 {
-    return m_gl_buffers[m_chunks[chunk].vertOffset]->uvBuffer;
+    return m_gl_buffers[m_chunks[chunk].vertOffset]->vertexArray;
 }
 
-GLuint ModelLoader::normBuffer(uint32_t chunk)
+void ModelLoader::setAttribPointers()
 {
-    return m_gl_buffers[m_chunks[chunk].vertOffset]->normBuffer;
+    if(m_quantized)
+    {
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_SHORT, GL_TRUE, sizeof(MeshVertexQuantized),
+                              (GLvoid*)offsetof(MeshVertexQuantized, pos));
+        glVertexAttribPointer(ATTRIB_NORMAL, 2, GL_BYTE, GL_TRUE, sizeof(MeshVertexQuantized),
+                              (GLvoid*)offsetof(MeshVertexQuantized, norm));
+        glVertexAttribPointer(ATTRIB_UV, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(MeshVertexQuantized),
+                              (GLvoid*)offsetof(MeshVertexQuantized, uv));
+    }
+    else
+    {
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                              (GLvoid*)offsetof(MeshVertex, pos));
+        glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                              (GLvoid*)offsetof(MeshVertex, norm));
+        glVertexAttribPointer(ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex),
+                              (GLvoid*)offsetof(MeshVertex, uv));
+    }
+}
+
+void ModelLoader::createVertexArrays()
+{
+#if P3D_VERTEX_ARRAYS
+    // the draw loop then binds one object per bank instead of buffers and attributes
+    for(auto item: m_gl_buffers)
+    {
+        GLBuffers* glbufs = item.second;
+        if(glbufs->vertexArray)
+        {
+            continue;
+        }
+        p3dGenVertexArrays(1, &glbufs->vertexArray);
+        p3dBindVertexArray(glbufs->vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, glbufs->vertexBuffer);
+        setAttribPointers();
+        glEnableVertexAttribArray(ATTRIB_POSITION);
+        glEnableVertexAttribArray(ATTRIB_NORMAL);
+        glEnableVertexAttribArray(ATTRIB_UV);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+    }
+    p3dBindVertexArray(0);
+    GL_CHECK_ERROR;
+#endif
 }
 
 float ModelLoader::boundingRadius()
@@ -158,9 +223,7 @@ size_t ModelLoader::addPadding(size_t size)
     return size + ( ( size % 4 ) ? ( 4 - size % 4 ) : 0 );
 }
 
-void ModelLoader::createModel(uint32_t posCount, uint32_t normCount, uint32_t emptyNormCount, uint32_t uvCount,
-                              float* posBuffer, float* normBuffer, float* uvBuffer, uint32_t indexCount,
-                              uint16_t* indexBuffer, uint32_t chunkCount, const MeshChunk* chunks)
+void ModelLoader::addChunks(const MeshChunk *chunks, uint32_t chunkCount)
 {
     uint32_t chunk;
     m_mat_count = 1;
@@ -177,8 +240,6 @@ void ModelLoader::createModel(uint32_t posCount, uint32_t normCount, uint32_t em
         }
     }
 
-    generateNormals(indexBuffer, posBuffer, normBuffer, emptyNormCount);
-
     for(chunk = 0; chunk < m_chunks.size(); ++chunk)
     {
         if(m_gl_buffers.count(m_chunks[chunk].vertOffset) == 0)
@@ -196,139 +257,1370 @@ void ModelLoader::createModel(uint32_t posCount, uint32_t normCount, uint32_t em
             }
         }
     }
+}
+
+void ModelLoader::createModel(uint32_t vertCount, uint32_t emptyNormCount, MeshVertex* vertices, uint32_t indexCount,
+                              uint32_t* indexBuffer, uint32_t chunkCount, const MeshChunk* chunks)
+{
+    addChunks(chunks, chunkCount);
+
+    P3dProfiler::add(P3dProfiler::COUNTER_VERTICES, vertCount);
+    P3dProfiler::add(P3dProfiler::COUNTER_INDICES, indexCount);
+
+    generateNormals(indexBuffer, vertices, vertCount, emptyNormCount);
+
+    if(m_options.clusterTriangles)
+    {
+        clusterChunks(vertices, indexBuffer);
+    }
+    P3dProfiler::add(P3dProfiler::COUNTER_CHUNKS, m_chunks.size());
+
+    if(m_options.optimizeVertexCache)
+    {
+        optimizeMeshes(vertices, indexBuffer);
+    }
+    groupChunks(indexBuffer, indexCount);
+
+    // the loader's buffer has no room for the simplified lists
+    uint32_t* lodBuffer = 0;
+    if(m_options.lodLevels)
+    {
+        lodBuffer = simplifyMeshes(vertices, indexBuffer, indexCount);
+        indexBuffer = lodBuffer;
+    }
+
+    MeshVertexQuantized* quantized = 0;
+    if(m_options.quantizeAttributes)
+    {
+        // loaders set the bounding box before createModel, it holds every vertex
+        const float posMin[3] = {m_minX, m_minY, m_minZ};
+        const float posMax[3] = {m_maxX, m_maxY, m_maxZ};
+        quantized = quantizeVertices(vertices, vertCount, posMin, posMax);
+    }
+    m_quantized = quantized != 0;
+    chunkBounds(vertices, indexBuffer);
+    m_bvh.build(m_chunks.data(), m_chunks.size());
+
+    if(m_uint32_indices)
+    {
+        m_index_type = GL_UNSIGNED_INT;
+    }
+    else
+    {
+        // banks were split to fit, narrow in place, each write lands on an already read index
+        m_index_type = GL_UNSIGNED_SHORT;
+        char* narrow = reinterpret_cast<char*>(indexBuffer);
+        for(uint32_t i = 0; i < indexCount; ++i)
+        {
+            uint16_t index = indexBuffer[i];
+            memcpy(narrow + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+        }
+    }
 
+    const char* vertexData = quantized ? reinterpret_cast<const char*>(quantized) : reinterpret_cast<const char*>(vertices);
+    size_t vertexSize = quantized ? sizeof(MeshVertexQuantized) : sizeof(MeshVertex);
+    size_t indexBytes = indexCount * indexSize();
+    if(m_keep_model_file || (m_options.cacheModel && m_source_hash))
+    {
+        keepModelFile(vertexData, vertCount * vertexSize, vertCount, reinterpret_cast<const char*>(indexBuffer), indexCount);
+    }
+    if(m_defer_uploads)
+    {
+        // the loader frees its buffers on return, keep copies until the GL thread takes them
+        if(quantized)
+        {
+            m_staged_quantized = quantized;
+            quantized = 0;
+        }
+        else
+        {
+            m_staged_vertices = new MeshVertex[vertCount];
+            memcpy(m_staged_vertices, vertices, vertCount * sizeof(MeshVertex));
+            vertexData = reinterpret_cast<const char*>(m_staged_vertices);
+        }
+        m_staged_indices = new char[indexBytes];
+        memcpy(m_staged_indices, indexBuffer, indexBytes);
+    }
+
+    queueUploads(vertexData, vertexSize, vertCount,
+                 m_defer_uploads ? m_staged_indices : reinterpret_cast<const char*>(indexBuffer), indexBytes);
+    delete [] quantized;
+    delete [] lodBuffer;
+}
+
+void ModelLoader::createModel(const P3dFileHeader &header, const MeshChunk *chunks, const char *vertexData,
+                              const char *indexData)
+{
+    addChunks(chunks, header.chunkCount);
+
+    P3dProfiler::add(P3dProfiler::COUNTER_CHUNKS, m_chunks.size());
+    P3dProfiler::add(P3dProfiler::COUNTER_VERTICES, header.vertCount);
+    P3dProfiler::add(P3dProfiler::COUNTER_INDICES, header.indexCount);
+
+    m_quantized = header.flags & P3dFileHeader::FLAG_QUANTIZED;
+    m_clustered = header.flags & P3dFileHeader::FLAG_CLUSTERED;
+    m_bvh.build(m_chunks.data(), m_chunks.size());
+    memcpy(m_pos_offset, header.posOffset, sizeof(m_pos_offset));
+    memcpy(m_pos_scale, header.posScale, sizeof(m_pos_scale));
+    memcpy(m_uv_offset, header.uvOffset, sizeof(m_uv_offset));
+    memcpy(m_uv_scale, header.uvScale, sizeof(m_uv_scale));
+    m_index_type = header.flags & P3dFileHeader::FLAG_UINT32_INDICES ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+    size_t vertexSize = m_quantized ? sizeof(MeshVertexQuantized) : sizeof(MeshVertex);
+    size_t indexBytes = header.indexCount * indexSize();
+    if(m_defer_uploads && !m_stream_end)
+    {
+        // the file may be unmapped once the loader returns
+        if(m_quantized)
+        {
+            m_staged_quantized = new MeshVertexQuantized[header.vertCount];
+            memcpy(m_staged_quantized, vertexData, header.vertCount * vertexSize);
+            vertexData = reinterpret_cast<const char*>(m_staged_quantized);
+        }
+        else
+        {
+            m_staged_vertices = new MeshVertex[header.vertCount];
+            memcpy(m_staged_vertices, vertexData, header.vertCount * vertexSize);
+            vertexData = reinterpret_cast<const char*>(m_staged_vertices);
+        }
+        m_staged_indices = new char[indexBytes];
+        memcpy(m_staged_indices, indexData, indexBytes);
+        indexData = m_staged_indices;
+    }
+
+    queueUploads(vertexData, vertexSize, header.vertCount, indexData, indexBytes);
+}
+
+void ModelLoader::queueUploads(const char *vertexData, size_t vertexSize, uint32_t vertCount,
+                               const char *indexData, size_t indexBytes)
+{
     for(auto item: m_gl_buffers)
     {
         GLBuffers* glbufs = item.second;
 
-        logger.verbose("Creating gl buf, vertOffset: %d, vertCount: %d", item.first, glbufs->vertCount);
+        logger.verbose("Staging gl buf, vertOffset: %d, vertCount: %d", item.first, glbufs->vertCount);
 
-        if(3 * (item.first + glbufs->vertCount) <= posCount)
+        if(item.first + glbufs->vertCount <= vertCount)
         {
-            glGenBuffers(1, &glbufs->posBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, glbufs->posBuffer);
-            glBufferData(GL_ARRAY_BUFFER, 3 * glbufs->vertCount * sizeof(GLfloat),
-                         posBuffer + 3 * item.first, GL_STATIC_DRAW);
+            PendingBuffer pending;
+            pending.target = GL_ARRAY_BUFFER;
+            pending.buffer = &glbufs->vertexBuffer;
+            pending.data = vertexData + item.first * vertexSize;
+            pending.size = glbufs->vertCount * vertexSize;
+            pending.done = 0;
+            m_pending.push_back(pending);
         }
+    }
 
-        if(2 * (item.first + glbufs->vertCount) <= uvCount)
+    PendingBuffer pending;
+    pending.target = GL_ELEMENT_ARRAY_BUFFER;
+    pending.buffer = &m_index_buffer;
+    pending.data = indexData;
+    pending.size = indexBytes;
+    pending.done = 0;
+    m_pending.push_back(pending);
+
+    if(!m_defer_uploads)
+    {
+        uploadPending(0);
+    }
+}
+
+void ModelLoader::setMaterialProperty(int materialIndex, const char *property, const char *value)
+{
+    Property item;
+    item.materialIndex = materialIndex;
+    item.property = new char[strlen(property) + 1];
+    strcpy(item.property, property);
+    item.value = new char[strlen(value) + 1];
+    strcpy(item.value, value);
+    m_properties.push_back(item);
+    if(m_materialInfo)
+    {
+        m_materialInfo->setMaterialProperty(materialIndex, property, value);
+    }
+}
+
+void ModelLoader::keepModelFile(const char *vertexData, size_t vertexBytes, uint32_t vertCount,
+                                const char *indexData, uint32_t indexCount)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_MODEL_CACHE);
+    // properties are set around createModel, keep them
+    delete [] m_model_file;
+    m_model_file_done = false;
+    P3dFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, P3dLoader::MAGIC, sizeof(header.magic));
+    header.version = P3dLoader::VERSION;
+    header.flags = (m_index_type == GL_UNSIGNED_INT ? P3dFileHeader::FLAG_UINT32_INDICES : 0)
+            | (m_quantized ? P3dFileHeader::FLAG_QUANTIZED : 0)
+            | (m_clustered ? P3dFileHeader::FLAG_CLUSTERED : 0);
+    header.vertCount = vertCount;
+    header.indexCount = indexCount;
+    header.chunkCount = m_chunks.size();
+
+    // sections without properties, modelFile adds them and completes the header
+    size_t chunkBytes = header.chunkCount * sizeof(P3dFileChunk);
+    size_t indexBytes = P3dLoader::indexBytes(header);
+    m_model_file_size = sizeof(header) + chunkBytes + vertexBytes + indexBytes;
+    m_model_file = new char[m_model_file_size]();
+    memcpy(m_model_file, &header, sizeof(header));
+    char* p = m_model_file + sizeof(header);
+    for(uint32_t chunk = 0; chunk < header.chunkCount; ++chunk)
+    {
+        const MeshChunk& meshChunk = m_chunks[chunk];
+        P3dFileChunk fileChunk;
+        memset(&fileChunk, 0, sizeof(fileChunk));
+        fileChunk.vertCount = meshChunk.vertCount;
+        fileChunk.vertOffset = meshChunk.vertOffset;
+        fileChunk.indexCount = meshChunk.indexCount;
+        fileChunk.f3Offset = meshChunk.f3Offset;
+        // BlendLoader leaves it at 0, BinLoader past the end of chunks without quads
+        uint32_t chunkEnd = meshChunk.f3Offset + meshChunk.indexCount;
+        fileChunk.f4Offset = meshChunk.f4Offset < meshChunk.f3Offset ? meshChunk.f3Offset
+                : meshChunk.f4Offset > chunkEnd ? chunkEnd : meshChunk.f4Offset;
+        fileChunk.material = meshChunk.material;
+        fileChunk.hasUvs = meshChunk.hasUvs;
+        memcpy(fileChunk.boundsMin, meshChunk.boundsMin, sizeof(fileChunk.boundsMin));
+        memcpy(fileChunk.boundsMax, meshChunk.boundsMax, sizeof(fileChunk.boundsMax));
+        memcpy(fileChunk.sphereCenter, meshChunk.sphereCenter, sizeof(fileChunk.sphereCenter));
+        fileChunk.sphereRadius = meshChunk.sphereRadius;
+        memcpy(fileChunk.lodOffset, meshChunk.lodOffset, sizeof(fileChunk.lodOffset));
+        memcpy(fileChunk.lodCount, meshChunk.lodCount, sizeof(fileChunk.lodCount));
+        memcpy(fileChunk.lodError, meshChunk.lodError, sizeof(fileChunk.lodError));
+        memcpy(p, &fileChunk, sizeof(fileChunk));
+        p += sizeof(fileChunk);
+    }
+    memcpy(p, vertexData, vertexBytes);
+    p += vertexBytes;
+    // the padding after the indices stays zero
+    memcpy(p, indexData, indexCount * indexSize());
+}
+
+const char *ModelLoader::modelFile(size_t *size)
+{
+    if(!m_model_file)
+    {
+        return 0;
+    }
+    if(!m_model_file_done)
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_MODEL_CACHE);
+        P3dFileHeader header;
+        memcpy(&header, m_model_file, sizeof(header));
+
+        uint32_t i;
+        for(i = 0; i < m_properties.size(); ++i)
         {
-            glGenBuffers(1, &glbufs->uvBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, glbufs->uvBuffer);
-            glBufferData(GL_ARRAY_BUFFER, 2 * glbufs->vertCount * sizeof(GLfloat),
-                         uvBuffer + 2 * item.first, GL_STATIC_DRAW);
+            header.propertyBytes += sizeof(int32_t) + strlen(m_properties[i].property) + strlen(m_properties[i].value) + 2;
         }
+        char* data = new char[m_model_file_size + header.propertyBytes];
+        memcpy(data, m_model_file, m_model_file_size);
+        char* p = data + m_model_file_size;
+        for(i = 0; i < m_properties.size(); ++i)
+        {
+            const Property& item = m_properties[i];
+            int32_t materialIndex = item.materialIndex;
+            memcpy(p, &materialIndex, sizeof(materialIndex));
+            p += sizeof(materialIndex);
+            size_t length = strlen(item.property) + 1;
+            memcpy(p, item.property, length);
+            p += length;
+            length = strlen(item.value) + 1;
+            memcpy(p, item.value, length);
+            p += length;
+        }
+        delete [] m_model_file;
+        m_model_file = data;
+        m_model_file_size += header.propertyBytes;
 
-        if(3 * (item.first + glbufs->vertCount) <= normCount)
+        const float boundingBox[6] = {m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ};
+        memcpy(header.boundingBox, boundingBox, sizeof(boundingBox));
+        // only quantizeVertices sets them, they stay 0 in files with float attributes
+        if(header.flags & P3dFileHeader::FLAG_QUANTIZED)
         {
-            glGenBuffers(1, &glbufs->normBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, glbufs->normBuffer);
-            glBufferData(GL_ARRAY_BUFFER, 3 * glbufs->vertCount * sizeof(GLfloat),
-                         normBuffer + 3 * item.first, GL_STATIC_DRAW);
+            memcpy(header.posOffset, m_pos_offset, sizeof(header.posOffset));
+            memcpy(header.posScale, m_pos_scale, sizeof(header.posScale));
+            memcpy(header.uvOffset, m_uv_offset, sizeof(header.uvOffset));
+            memcpy(header.uvScale, m_uv_scale, sizeof(header.uvScale));
         }
+        header.checksum = hashData(m_model_file + sizeof(header), m_model_file_size - sizeof(header));
+        memcpy(m_model_file, &header, sizeof(header));
+        m_model_file_done = true;
+    }
+    *size = m_model_file_size;
+    return m_model_file;
+}
+
+void ModelLoader::clearModelFile()
+{
+    delete [] m_model_file;
+    m_model_file = nullptr;
+    m_model_file_size = 0;
+    m_model_file_done = false;
+    for(uint32_t i = 0; i < m_properties.size(); ++i)
+    {
+        delete [] m_properties[i].property;
+        delete [] m_properties[i].value;
     }
+    m_properties.clear();
+}
 
-    glGenBuffers(1, &m_index_buffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t), indexBuffer, GL_STATIC_DRAW);
+bool ModelLoader::uploadPending(size_t byteBudget)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_UPLOAD);
+    size_t uploaded = 0;
+    while(m_pending_next < m_pending.size())
+    {
+        PendingBuffer& pending = m_pending[m_pending_next];
+        size_t part = pending.size - pending.done;
+        if(byteBudget && part > byteBudget - uploaded)
+        {
+            part = byteBudget - uploaded;
+        }
+        if(m_stream_end)
+        {
+            // buffers are queued in file order, the ones after this haven't arrived either
+            const char* next = pending.data + pending.done;
+            size_t arrived = m_stream_end > next ? m_stream_end - next : 0;
+            if(part > arrived)
+            {
+                part = arrived;
+            }
+            if(!part)
+            {
+                break;
+            }
+        }
+
+        if(!*pending.buffer)
+        {
+            glGenBuffers(1, pending.buffer);
+            glBindBuffer(pending.target, *pending.buffer);
+            // whole buffers in one call when they fit, otherwise allocate and fill over several frames
+            glBufferData(pending.target, pending.size, part == pending.size ? pending.data : 0, GL_STATIC_DRAW);
+            if(part == pending.size)
+            {
+                pending.done = part;
+            }
+        }
+        else
+        {
+            glBindBuffer(pending.target, *pending.buffer);
+        }
+
+        if(pending.done < pending.size)
+        {
+            glBufferSubData(pending.target, pending.done, part, pending.data + pending.done);
+            pending.done += part;
+        }
+        uploaded += part;
+
+        if(pending.done == pending.size)
+        {
+            ++m_pending_next;
+        }
+        if(byteBudget && uploaded >= byteBudget)
+        {
+            break;
+        }
+    }
     GL_CHECK_ERROR;
+    P3dProfiler::add(P3dProfiler::COUNTER_UPLOAD_BYTES, uploaded);
+
+    if(m_pending_next < m_pending.size())
+    {
+        return false;
+    }
+    clearPending();
+    if(m_vertex_arrays)
+    {
+        createVertexArrays();
+    }
+    return true;
 }
 
-void ModelLoader::generateNormals(uint16_t *new_faces, GLfloat *new_pos, GLfloat *new_norm, uint32_t emptyNormCount)
+bool ModelLoader::verticesUploaded()
 {
-    logger.debug("Generating normals");
-    uint64_t start = PlatformAdapter::currentMillis();
+    // vertex buffers are queued before the index buffer
+    return m_pending_next >= m_pending.size() || m_pending[m_pending_next].target == GL_ELEMENT_ARRAY_BUFFER;
+}
 
-    uint32_t i;
-    uint32_t il;
+uint32_t ModelLoader::uploadedIndexCount()
+{
+    if(m_pending_next >= m_pending.size())
+    {
+        return UINT32_MAX;
+    }
+    return m_pending[m_pending.size() - 1].done / indexSize();
+}
+
+void ModelLoader::finishStream(char *data)
+{
+    m_stream_end = nullptr;
+    if(hasPendingUploads())
+    {
+        m_staged_stream = data;
+    }
+    else
+    {
+        delete [] data;
+    }
+}
+
+void ModelLoader::clearPending()
+{
+    m_pending.clear();
+    m_pending_next = 0;
+    delete [] m_staged_stream;
+    m_staged_stream = nullptr;
+    delete [] m_staged_vertices;
+    m_staged_vertices = nullptr;
+    delete [] m_staged_quantized;
+    m_staged_quantized = nullptr;
+    delete [] m_staged_indices;
+    m_staged_indices = nullptr;
+}
+
+void ModelLoader::setSourceData(const char *data, size_t size)
+{
+    m_source_hash = 0;
+    if((m_options.cacheNormals || m_options.cacheModel) && data && size)
+    {
+        P3dProfiler::Scope scope(m_options.cacheModel ? P3dProfiler::STAGE_MODEL_CACHE : P3dProfiler::STAGE_NORMALS_CACHE);
+        m_source_hash = hashData(data, size);
+    }
+}
+
+void ModelLoader::modelCacheKey(char *key)
+{
+    // everything that changes what createModel uploads selects another entry
+    struct
+    {
+        uint64_t sourceHash;
+        uint32_t version;
+        uint32_t uint32Indices;
+        uint32_t quantizeAttributes;
+        uint32_t optimizeVertexCache;
+        uint32_t normalWeighting;
+        float creaseAngle;
+        uint32_t clusterTriangles;
+        uint32_t lodLevels;
+    } settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.sourceHash = m_source_hash;
+    settings.version = P3dLoader::VERSION;
+    settings.uint32Indices = m_uint32_indices;
+    settings.quantizeAttributes = m_options.quantizeAttributes;
+    settings.optimizeVertexCache = m_options.optimizeVertexCache;
+    settings.normalWeighting = m_options.normalWeighting;
+    settings.creaseAngle = m_options.creaseAngle;
+    settings.clusterTriangles = m_options.clusterTriangles;
+    settings.lodLevels = m_options.lodLevels;
+    sprintf(key, "%016llx.p3d",
+            (unsigned long long) hashData(reinterpret_cast<const char*>(&settings), sizeof(settings)));
+}
+
+bool ModelLoader::loadModelCache()
+{
+    if(!m_options.cacheModel || !m_source_hash || !PlatformAdapter::adapter)
+    {
+        return false;
+    }
+    char key[32];
+    modelCacheKey(key);
+    MappedFile* file;
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_MODEL_CACHE);
+        file = PlatformAdapter::adapter->mapCache(key);
+    }
+    if(!file)
+    {
+        return false;
+    }
+    P3dLoader loader;
+    loader.setModelLoader(this);
+    bool res = loader.load(file->data(), file->size());
+    delete file;
+    if(res)
+    {
+        logger.debug("Loaded model from cache %s", key);
+    }
+    else
+    {
+        logger.warning("Ignoring invalid model cache %s", key);
+        clear();
+    }
+    return res;
+}
 
-    uint32_t a;
-    uint32_t b;
-    uint32_t c;
+void ModelLoader::saveModelCache()
+{
+    if(!m_options.cacheModel || !m_source_hash || !PlatformAdapter::adapter)
+    {
+        return;
+    }
+    size_t size;
+    const char* data = modelFile(&size);
+    if(!data)
+    {
+        return;
+    }
+    char key[32];
+    modelCacheKey(key);
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_MODEL_CACHE);
+    if(PlatformAdapter::adapter->saveCache(key, data, size))
+    {
+        logger.debug("Saved model to cache %s", key);
+    }
+    if(!m_keep_model_file)
+    {
+        clearModelFile();
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
 
-    uint32_t a_offset;
-    uint32_t b_offset;
-    uint32_t c_offset;
+static inline uint64_t read64(const char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-    P3dMap<glm::vec3, glm::vec3> normalsMap(emptyNormCount < 128
-                                            ? 1
-                                            : emptyNormCount / 128);
+uint64_t ModelLoader::hashData(const char *data, size_t size, uint64_t seed)
+{
+    const uint64_t P1 = 11400714785074694791ULL;
+    const uint64_t P2 = 14029467366897019727ULL;
+    const uint64_t P3 = 1609587929392839161ULL;
+    const uint64_t P4 = 9650029242287828579ULL;
+    const uint64_t P5 = 2870177450012600261ULL;
+    const char* p = data;
+    const char* end = data + size;
+    uint64_t h;
 
-    // calc
-    for(uint32_t chunk = 0, chunkl = m_chunks.size(); chunk < chunkl; ++chunk)
+    if(size >= 32)
     {
-        if(m_chunks[chunk].validNormals)
+        // four independent lanes, runs at memory speed
+        uint64_t v[4] = {seed + P1 + P2, seed + P2, seed, seed - P1};
+        for(; p + 32 <= end; p += 32)
         {
-            continue;
+            for(int lane = 0; lane < 4; ++lane)
+            {
+                v[lane] = rotl64(v[lane] + read64(p + lane * 8) * P2, 31) * P1;
+            }
+        }
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        for(int lane = 0; lane < 4; ++lane)
+        {
+            h ^= rotl64(v[lane] * P2, 31) * P1;
+            h = h * P1 + P4;
+        }
+    }
+    else
+    {
+        h = seed + P5;
+    }
+    h += size;
+
+    for(; p + 8 <= end; p += 8)
+    {
+        h ^= rotl64(read64(p) * P2, 31) * P1;
+        h = rotl64(h, 27) * P1 + P4;
+    }
+    if(p + 4 <= end)
+    {
+        uint32_t k;
+        memcpy(&k, p, sizeof(k));
+        h ^= uint64_t(k) * P1;
+        h = rotl64(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for(; p < end; ++p)
+    {
+        h ^= uint8_t(*p) * P5;
+        h = rotl64(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+void ModelLoader::normalsCacheKey(char *key, uint32_t vertCount)
+{
+    // everything that changes the vertex order or the normals selects another entry
+    struct
+    {
+        uint64_t sourceHash;
+        uint32_t vertCount;
+        uint32_t uint32Indices;
+        uint32_t parallelReindex;
+        uint32_t normalWeighting;
+        float creaseAngle;
+    } settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.sourceHash = m_source_hash;
+    settings.vertCount = vertCount;
+    settings.uint32Indices = m_uint32_indices;
+    settings.parallelReindex = m_options.parallelReindex;
+    settings.normalWeighting = m_options.normalWeighting;
+    settings.creaseAngle = m_options.creaseAngle;
+    sprintf(key, "%016llx.normals",
+            (unsigned long long) hashData(reinterpret_cast<const char*>(&settings), sizeof(settings)));
+}
+
+bool ModelLoader::loadNormalsCache(P3dVector<uint32_t>& chunks, const uint32_t *new_faces,
+                                   MeshVertex *vertices, uint32_t vertCount)
+{
+    if(!m_options.cacheNormals || !m_source_hash || !PlatformAdapter::adapter)
+    {
+        return false;
+    }
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_NORMALS_CACHE);
+    char key[32];
+    normalsCacheKey(key, vertCount);
+    size_t size;
+    const char* data = PlatformAdapter::adapter->loadCache(key, &size);
+    if(!data)
+    {
+        return false;
+    }
+
+    NormalsCacheHeader header;
+    bool valid = size >= sizeof(header);
+    if(valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        valid = !memcmp(header.magic, NORMALS_CACHE_MAGIC, sizeof(header.magic))
+                && header.version == NORMALS_CACHE_VERSION && header.sourceHash == m_source_hash
+                && header.vertCount == vertCount
+                && size == sizeof(header) + size_t(header.normalCount) * 3 * sizeof(float);
+    }
+    if(valid)
+    {
+        // the vertices generateNormals would write, saved in ascending order
+        uint8_t* generated = new uint8_t[vertCount]();
+        uint32_t generatedCount = 0;
+        for(uint32_t chunk = 0; chunk < chunks.size(); ++chunk)
+        {
+            const MeshChunk& meshChunk = m_chunks[chunks[chunk]];
+            for(uint32_t i = meshChunk.f3Offset, il = i + meshChunk.indexCount; i < il; ++i)
+            {
+                uint32_t vertex = new_faces[i] + meshChunk.vertOffset;
+                generatedCount += !generated[vertex];
+                generated[vertex] = 1;
+            }
+        }
+        valid = generatedCount == header.normalCount;
+        const char* normal = data + sizeof(header);
+        for(uint32_t i = 0; valid && i < vertCount; ++i)
+        {
+            if(generated[i])
+            {
+                memcpy(vertices[i].norm, normal, sizeof(vertices[i].norm));
+                normal += sizeof(vertices[i].norm);
+            }
+        }
+        delete [] generated;
+    }
+    delete [] data;
+
+    if(!valid)
+    {
+        logger.warning("Ignoring stale normals cache %s", key);
+        return false;
+    }
+    for(uint32_t chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        m_chunks[chunks[chunk]].validNormals = true;
+    }
+    logger.debug("Loaded %d normals from cache %s", header.normalCount, key);
+    return true;
+}
+
+void ModelLoader::saveNormalsCache(const uint32_t *weld, const MeshVertex *vertices, uint32_t vertCount)
+{
+    if(!m_options.cacheNormals || !m_source_hash || !PlatformAdapter::adapter)
+    {
+        return;
+    }
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_NORMALS_CACHE);
+    NormalsCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NORMALS_CACHE_MAGIC, sizeof(header.magic));
+    header.version = NORMALS_CACHE_VERSION;
+    header.sourceHash = m_source_hash;
+    header.vertCount = vertCount;
+    uint32_t i;
+    for(i = 0; i < vertCount; ++i)
+    {
+        header.normalCount += weld[i] != NO_POSITION;
+    }
+
+    size_t size = sizeof(header) + size_t(header.normalCount) * 3 * sizeof(float);
+    char* data = new char[size];
+    memcpy(data, &header, sizeof(header));
+    char* normal = data + sizeof(header);
+    for(i = 0; i < vertCount; ++i)
+    {
+        if(weld[i] != NO_POSITION)
+        {
+            memcpy(normal, vertices[i].norm, sizeof(vertices[i].norm));
+            normal += sizeof(vertices[i].norm);
+        }
+    }
+    char key[32];
+    normalsCacheKey(key, vertCount);
+    if(PlatformAdapter::adapter->saveCache(key, data, size))
+    {
+        logger.debug("Saved %d normals to cache %s", header.normalCount, key);
+    }
+    delete [] data;
+}
+
+void ModelLoader::generateNormals(uint32_t *new_faces, MeshVertex *vertices, uint32_t vertCount, uint32_t emptyNormCount)
+{
+    uint32_t i;
+    uint32_t il;
+    uint32_t chunk;
+    uint32_t chunkCount = m_chunks.size();
+
+    P3dVector<uint32_t> chunks;
+    uint32_t triangleCount = 0;
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        if(!m_chunks[chunk].validNormals)
+        {
+            chunks.push_back(chunk);
+            triangleCount += m_chunks[chunk].indexCount / 3;
         }
+    }
+    if(chunks.size() == 0)
+    {
+        return;
+    }
+    if(loadNormalsCache(chunks, new_faces, vertices, vertCount))
+    {
+        return;
+    }
+    logger.debug("Generating normals");
 
-        for(i = m_chunks[chunk].f3Offset, il =  i + m_chunks[chunk].indexCount; i < il;)
+    // weld, one hash lookup per vertex instead of one per triangle corner
+    uint64_t start = P3dProfiler::nowNanos();
+    uint32_t* weld = new uint32_t[vertCount];
+    for(i = 0; i < vertCount; ++i)
+    {
+        weld[i] = NO_POSITION;
+    }
+    uint32_t positionCount = 0;
+    P3dMap<glm::vec3, uint32_t> positions(emptyNormCount / 3);
+    for(chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        const MeshChunk& meshChunk = m_chunks[chunks[chunk]];
+        for(i = meshChunk.f3Offset, il = i + meshChunk.indexCount; i < il; ++i)
         {
-            a = new_faces[i++];
-            b = new_faces[i++];
-            c = new_faces[i++];
-            a_offset = 3 * (a + m_chunks[chunk].vertOffset);
-            b_offset = 3 * (b + m_chunks[chunk].vertOffset);
-            c_offset = 3 * (c + m_chunks[chunk].vertOffset);
-            glm::vec3 posa(new_pos[a_offset], new_pos[a_offset + 1], new_pos[a_offset + 2]);
-            glm::vec3 posb(new_pos[b_offset], new_pos[b_offset + 1], new_pos[b_offset + 2]);
-            glm::vec3 posc(new_pos[c_offset], new_pos[c_offset + 1], new_pos[c_offset + 2]);
-            glm::vec3 fnormal = glm::cross(posa - posb, posb - posc);
-            if(!isnan(fnormal.x) && !isnan(fnormal.y) && !isnan(fnormal.z))
+            uint32_t vertex = new_faces[i] + meshChunk.vertOffset;
+            if(weld[vertex] == NO_POSITION)
             {
-                if(fnormal.x || fnormal.y || fnormal.z)
+                const float* pos = vertices[vertex].pos;
+                bool inserted;
+                P3dPair<glm::vec3, uint32_t>* item = positions.findOrInsert(glm::vec3(pos[0], pos[1], pos[2]), &inserted);
+                if(inserted)
                 {
-                    fnormal = glm::normalize(fnormal);
-                    normalsMap[posa] += fnormal;
-                    normalsMap[posb] += fnormal;
-                    normalsMap[posc] += fnormal;
+                    item->second = positionCount++;
                 }
+                weld[vertex] = item->second;
             }
         }
     }
-    logger.debug("calc took: %lldms", PlatformAdapter::durationMillis(start));
+    P3dProfiler::addTime(P3dProfiler::STAGE_NORMALS_WELD, P3dProfiler::nowNanos() - start);
+
+    // calc, triangles are split in slices over all chunks, each slice sums into its own array
+    start = P3dProfiler::nowNanos();
+    const uint32_t minSliceTriangles = 32 * 1024;
+    uint32_t sliceCount = triangleCount / minSliceTriangles;
+    if(sliceCount > P3dParallel::workerCount()) sliceCount = P3dParallel::workerCount();
+    if(sliceCount < 1) sliceCount = 1;
+    float* sums = new float[size_t(sliceCount) * positionCount * 4]();
+    NormalWeighting weighting = m_options.normalWeighting;
+    P3dParallel::forEach(sliceCount, [&](size_t slice)
+    {
+        uint32_t first = uint64_t(triangleCount) * slice / sliceCount;
+        uint32_t last = uint64_t(triangleCount) * (slice + 1) / sliceCount;
+        float* sum = sums + slice * positionCount * 4;
+        uint32_t chunkFirst = 0;
+        for(uint32_t n = 0; n < chunks.size() && chunkFirst < last; ++n)
+        {
+            const MeshChunk& meshChunk = m_chunks[chunks[n]];
+            uint32_t chunkTriangles = meshChunk.indexCount / 3;
+            uint32_t from = first > chunkFirst ? first - chunkFirst : 0;
+            uint32_t to = last - chunkFirst < chunkTriangles ? last - chunkFirst : chunkTriangles;
+            chunkFirst += chunkTriangles;
+            const uint32_t* faces = new_faces + meshChunk.f3Offset;
+            const MeshVertex* chunkVertices = vertices + meshChunk.vertOffset;
+            const uint32_t* chunkWeld = weld + meshChunk.vertOffset;
+            for(uint32_t t = from; t < to; ++t)
+            {
+                uint32_t a = faces[t * 3];
+                uint32_t b = faces[t * 3 + 1];
+                uint32_t c = faces[t * 3 + 2];
+                NormalGenerator::addTriangle(chunkVertices[a].pos, chunkVertices[b].pos, chunkVertices[c].pos,
+                                             weighting, sum + chunkWeld[a] * 4, sum + chunkWeld[b] * 4,
+                                             sum + chunkWeld[c] * 4);
+            }
+        }
+    });
+    P3dProfiler::addTime(P3dProfiler::STAGE_NORMALS_CALC, P3dProfiler::nowNanos() - start);
 
-    start = PlatformAdapter::currentMillis();
-    // normalize
-    for(auto item: normalsMap)
+    // normalize, slices are added in order so the result only depends on the slice count
+    start = P3dProfiler::nowNanos();
+    for(uint32_t slice = 1; slice < sliceCount; ++slice)
     {
-        glm::vec3& normal = item.second;
-        if(!isnan(normal.x) && !isnan(normal.y) && !isnan(normal.z))
+        const float* sum = sums + size_t(slice) * positionCount * 4;
+        for(i = 0; i < positionCount * 4; i += 4)
         {
-            normal = glm::normalize(normal);
+            P3dSimd::store4(sums + i, P3dSimd::add(P3dSimd::load4(sums + i), P3dSimd::load4(sum + i)));
+        }
+    }
+    const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for(i = 0; i < positionCount * 4; i += 4)
+    {
+        P3dSimd::Vec4 normal = P3dSimd::load4(sums + i);
+        float length2 = P3dSimd::dot3(normal, normal);
+        if(length2 > 0.0f && !isinf(length2))
+        {
+            normal = P3dSimd::mul(normal, 1.0f / sqrtf(length2));
         }
         else
         {
-            normal = glm::vec3();
+            normal = P3dSimd::load4(zero);
         }
+        P3dSimd::store4(sums + i, normal);
     }
-    logger.debug("normalize took: %lldms", PlatformAdapter::durationMillis(start));
+    P3dProfiler::addTime(P3dProfiler::STAGE_NORMALS_NORMALIZE, P3dProfiler::nowNanos() - start);
 
-    start = PlatformAdapter::currentMillis();
     // store new normals
-    for(uint32_t chunk = 0, chunkl = m_chunks.size(); chunk < chunkl; ++chunk)
+    start = P3dProfiler::nowNanos();
+    for(i = 0; i < vertCount; ++i)
     {
-        if(m_chunks[chunk].validNormals)
+        if(weld[i] != NO_POSITION)
         {
-            continue;
+            memcpy(vertices[i].norm, sums + weld[i] * 4, sizeof(vertices[i].norm));
         }
+    }
+    for(chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        m_chunks[chunks[chunk]].validNormals = true;
+    }
+    P3dProfiler::addTime(P3dProfiler::STAGE_NORMALS_STORE, P3dProfiler::nowNanos() - start);
+
+    logger.debug("Calculated %d new normals in %d slices", positionCount, sliceCount);
+    positions.dumpBucketLoad();
+    P3dProfiler::add(P3dProfiler::COUNTER_MAP_LOOKUPS, positions.lookupCount());
+    P3dProfiler::add(P3dProfiler::COUNTER_MAP_PROBES, positions.probeCount());
+
+    saveNormalsCache(weld, vertices, vertCount);
+
+    delete [] sums;
+    delete [] weld;
+}
+
+MeshVertexQuantized* ModelLoader::quantizeVertices(const MeshVertex *vertices, uint32_t vertCount,
+                                                  const float* posMin, const float* posMax)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_QUANTIZE);
+    uint32_t i;
+    int c;
+
+    if(vertCount == 0)
+    {
+        return 0;
+    }
 
-        for(i = m_chunks[chunk].f3Offset, il = i + m_chunks[chunk].indexCount; i < il; ++i)
+    // positions use the loader's bounding box, only the uv range is unknown
+    float uvMin[2];
+    float uvMax[2];
+    for(c = 0; c < 2; ++c)
+    {
+        uvMin[c] = uvMax[c] = vertices[0].uv[c];
+    }
+    for(i = 1; i < vertCount; ++i)
+    {
+        const MeshVertex& vertex = vertices[i];
+        for(c = 0; c < 2; ++c)
         {
-            a = new_faces[i];
-            a_offset = 3 * (a + m_chunks[chunk].vertOffset);
-            glm::vec3 posa(new_pos[a_offset], new_pos[a_offset + 1], new_pos[a_offset + 2]);
-            const glm::vec3& normal = normalsMap[posa];
-            a_offset = 3 * (a + m_chunks[chunk].vertOffset);
-            new_norm[a_offset] = normal.x;
-            new_norm[a_offset + 1] = normal.y;
-            new_norm[a_offset + 2] = normal.z;
+            if(vertex.uv[c] < uvMin[c]) uvMin[c] = vertex.uv[c];
+            if(vertex.uv[c] > uvMax[c]) uvMax[c] = vertex.uv[c];
         }
+    }
 
-        m_chunks[chunk].validNormals = true;
+    // positions map to [-1, 1] around the box center, uvs to [0, 1]
+    for(c = 0; c < 3; ++c)
+    {
+        m_pos_offset[c] = 0.5f * (posMin[c] + posMax[c]);
+        m_pos_scale[c] = 0.5f * (posMax[c] - posMin[c]);
+        if(m_pos_scale[c] <= 0.0f) m_pos_scale[c] = 1.0f;
+    }
+    for(c = 0; c < 2; ++c)
+    {
+        m_uv_offset[c] = uvMin[c];
+        m_uv_scale[c] = uvMax[c] - uvMin[c];
+        if(m_uv_scale[c] <= 0.0f) m_uv_scale[c] = 1.0f;
     }
-    logger.debug("store took: %lldms", PlatformAdapter::durationMillis(start));
 
-    logger.debug("Calculated %d new normals", normalsMap.size());
-    normalsMap.dumpBucketLoad();
+    MeshVertexQuantized* result = new MeshVertexQuantized[vertCount];
+    for(i = 0; i < vertCount; ++i)
+    {
+        const MeshVertex& vertex = vertices[i];
+        MeshVertexQuantized& packed = result[i];
+
+        for(c = 0; c < 3; ++c)
+        {
+            float value = (vertex.pos[c] - m_pos_offset[c]) / m_pos_scale[c];
+            if(value > 1.0f) value = 1.0f;
+            if(value < -1.0f) value = -1.0f;
+            packed.pos[c] = static_cast<int16_t>(roundf(value * 32767.0f));
+        }
+
+        // octahedral encoding, project on the octahedron and fold the lower half over
+        float nx = vertex.norm[0];
+        float ny = vertex.norm[1];
+        float nz = vertex.norm[2];
+        float length = fabsf(nx) + fabsf(ny) + fabsf(nz);
+        if(length > 0.0f)
+        {
+            nx /= length;
+            ny /= length;
+            if(nz < 0.0f)
+            {
+                float fx = (1.0f - fabsf(ny)) * (nx >= 0.0f ? 1.0f : -1.0f);
+                float fy = (1.0f - fabsf(nx)) * (ny >= 0.0f ? 1.0f : -1.0f);
+                nx = fx;
+                ny = fy;
+            }
+        }
+        packed.norm[0] = static_cast<int8_t>(roundf(nx * 127.0f));
+        packed.norm[1] = static_cast<int8_t>(roundf(ny * 127.0f));
+
+        for(c = 0; c < 2; ++c)
+        {
+            float value = (vertex.uv[c] - m_uv_offset[c]) / m_uv_scale[c];
+            if(value > 1.0f) value = 1.0f;
+            if(value < 0.0f) value = 0.0f;
+            packed.uv[c] = static_cast<uint16_t>(roundf(value * 65535.0f));
+        }
+    }
+
+    logger.debug("quantized %d vertices, %d bytes instead of %d", vertCount,
+                 vertCount * sizeof(MeshVertexQuantized), vertCount * sizeof(MeshVertex));
+    return result;
+}
+
+void ModelLoader::optimizeMeshes(MeshVertex *vertices, uint32_t *indexBuffer)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_OPTIMIZE);
+    uint32_t chunk;
+    uint32_t chunkCount = m_chunks.size();
+
+    // vertex banks and their sizes, workers must not touch the maps
+    P3dVector<uint32_t> bankOffsets;
+    P3dVector<uint32_t> bankSizes;
+    for(auto item: m_gl_buffers)
+    {
+        bankOffsets.push_back(item.first);
+        bankSizes.push_back(item.second->vertCount);
+    }
+    uint32_t* chunkBankSize = new uint32_t[chunkCount];
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        chunkBankSize[chunk] = m_gl_buffers[m_chunks[chunk].vertOffset]->vertCount;
+    }
+
+    // triangle order within each chunk
+    float* acmrBefore = new float[chunkCount];
+    float* acmrAfter = new float[chunkCount];
+    P3dParallel::forEach(chunkCount, [&](size_t i)
+    {
+        const MeshChunk& meshChunk = m_chunks[i];
+        uint32_t* indices = indexBuffer + meshChunk.f3Offset;
+        acmrBefore[i] = MeshOptimizer::acmr(indices, meshChunk.indexCount);
+        uint32_t* original = new uint32_t[meshChunk.indexCount];
+        memcpy(original, indices, meshChunk.indexCount * sizeof(uint32_t));
+        MeshOptimizer::optimizeBankVertexCache(indices, meshChunk.indexCount, chunkBankSize[i]);
+        acmrAfter[i] = MeshOptimizer::acmr(indices, meshChunk.indexCount);
+        if(acmrAfter[i] > acmrBefore[i])
+        {
+            // small or already optimized chunks can come out worse, keep the exporter order then
+            memcpy(indices, original, meshChunk.indexCount * sizeof(uint32_t));
+            acmrAfter[i] = acmrBefore[i];
+        }
+        delete [] original;
+    });
+
+    // vertex order within each bank, following the chunks that draw from it
+    P3dParallel::forEach(bankOffsets.size(), [&](size_t bank)
+    {
+        P3dVector<uint32_t*> lists;
+        P3dVector<uint32_t> listCounts;
+        for(uint32_t i = 0; i < chunkCount; ++i)
+        {
+            if(m_chunks[i].vertOffset == bankOffsets[bank])
+            {
+                lists.push_back(indexBuffer + m_chunks[i].f3Offset);
+                listCounts.push_back(m_chunks[i].indexCount);
+            }
+        }
+        MeshOptimizer::optimizeVertexFetch(vertices + bankOffsets[bank], bankSizes[bank],
+                                           lists.data(), listCounts.data(), lists.size());
+    });
+
+    // triangle weighted totals
+    double before = 0.0;
+    double after = 0.0;
+    uint64_t tris = 0;
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        uint32_t chunkTris = m_chunks[chunk].indexCount / 3;
+        before += acmrBefore[chunk] * chunkTris;
+        after += acmrAfter[chunk] * chunkTris;
+        tris += chunkTris;
+    }
+    if(tris)
+    {
+        logger.debug("ACMR before: %.3f after: %.3f", before / tris, after / tris);
+    }
+
+    delete [] acmrAfter;
+    delete [] acmrBefore;
+    delete [] chunkBankSize;
+}
+
+void ModelLoader::groupChunks(uint32_t *indexBuffer, uint32_t indexCount)
+{
+    uint32_t chunk;
+    uint32_t chunkCount = m_chunks.size();
+
+    // loaders start a chunk whenever the material changes, so chunks of a bank
+    // that draw the same way lie apart in the index buffer. With their ranges
+    // next to each other the viewer draws them with one call.
+    // Nothing but chunks may be in the buffer, ranges outside of them would move.
+    uint64_t covered = 0;
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        covered += m_chunks[chunk].indexCount;
+    }
+    if(chunkCount < 2 || covered != indexCount)
+    {
+        return;
+    }
+
+    P3dVector<uint32_t> order;
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        order.push_back(chunk);
+    }
+    std::stable_sort(order.data(), order.data() + chunkCount, [this](uint32_t a, uint32_t b)
+    {
+        const MeshChunk& chunkA = m_chunks[a];
+        const MeshChunk& chunkB = m_chunks[b];
+        if(chunkA.vertOffset != chunkB.vertOffset) return chunkA.vertOffset < chunkB.vertOffset;
+        if(chunkA.material != chunkB.material) return chunkA.material < chunkB.material;
+        return chunkA.hasUvs < chunkB.hasUvs;
+    });
+
+    uint32_t* grouped = new uint32_t[indexCount];
+    MeshChunk* chunks = new MeshChunk[chunkCount];
+    memcpy(chunks, m_chunks.data(), chunkCount * sizeof(MeshChunk));
+    uint32_t offset = 0;
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        MeshChunk& meshChunk = m_chunks[chunk];
+        meshChunk = chunks[order[chunk]];
+        memcpy(grouped + offset, indexBuffer + meshChunk.f3Offset, meshChunk.indexCount * sizeof(uint32_t));
+        meshChunk.f4Offset = meshChunk.f4Offset - meshChunk.f3Offset + offset;
+        meshChunk.f3Offset = offset;
+        offset += meshChunk.indexCount;
+    }
+    memcpy(indexBuffer, grouped, indexCount * sizeof(uint32_t));
+    delete [] chunks;
+    delete [] grouped;
+}
+
+uint32_t* ModelLoader::simplifyMeshes(const MeshVertex *vertices, const uint32_t *indexBuffer, uint32_t& indexCount)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_SIMPLIFY);
+    uint32_t chunk;
+    uint32_t level;
+    uint32_t chunkCount = m_chunks.size();
+    uint32_t levels = m_options.lodLevels < MeshChunk::MAX_LODS ? m_options.lodLevels : MeshChunk::MAX_LODS;
+
+    uint32_t* chunkBankSize = new uint32_t[chunkCount];
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        chunkBankSize[chunk] = m_gl_buffers[m_chunks[chunk].vertOffset]->vertCount;
+    }
+
+    // every level is simplified from the one before, its error adds up
+    uint32_t** lists = new uint32_t*[chunkCount * levels]();
+    P3dParallel::forEach(chunkCount, [&](size_t i)
+    {
+        MeshChunk& meshChunk = m_chunks[i];
+        const uint32_t* source = indexBuffer + meshChunk.f3Offset;
+        uint32_t sourceCount = meshChunk.indexCount;
+        float error = 0.0f;
+        for(uint32_t l = 0; l < levels && sourceCount >= MIN_LOD_INDICES; ++l)
+        {
+            uint32_t* list = new uint32_t[sourceCount];
+            float levelError;
+            uint32_t count = MeshSimplifier::simplify(list, source, sourceCount, vertices + meshChunk.vertOffset,
+                                                      sourceCount / 6 * 3, &levelError);
+            if(count > sourceCount - sourceCount / 8)
+            {
+                // mostly seams and borders, a level this close to the last one isn't worth its memory
+                delete [] list;
+                break;
+            }
+            if(m_options.optimizeVertexCache)
+            {
+                MeshOptimizer::optimizeBankVertexCache(list, count, chunkBankSize[i]);
+            }
+            error += levelError;
+            lists[i * levels + l] = list;
+            meshChunk.lodCount[l] = count;
+            meshChunk.lodError[l] = error;
+            source = list;
+            sourceCount = count;
+        }
+    });
+
+    // level after level, so neighbours in the same batch merge into one range again;
+    // the coarsest level comes first and full detail last, streamed loads draw what arrived
+    uint64_t total = indexCount;
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        for(level = 0; level < levels; ++level)
+        {
+            total += m_chunks[chunk].lodCount[level];
+        }
+    }
+    uint32_t* lodBuffer = new uint32_t[total];
+    uint32_t offset = 0;
+    uint32_t lodChunks = 0;
+    for(level = levels; level-- > 0; )
+    {
+        for(chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            MeshChunk& meshChunk = m_chunks[chunk];
+            if(!meshChunk.lodCount[level])
+            {
+                continue;
+            }
+            memcpy(lodBuffer + offset, lists[chunk * levels + level], meshChunk.lodCount[level] * sizeof(uint32_t));
+            meshChunk.lodOffset[level] = offset;
+            offset += meshChunk.lodCount[level];
+            delete [] lists[chunk * levels + level];
+            if(!level) ++lodChunks;
+        }
+    }
+    memcpy(lodBuffer + offset, indexBuffer, indexCount * sizeof(uint32_t));
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        m_chunks[chunk].f3Offset += offset;
+        m_chunks[chunk].f4Offset += offset;
+    }
+    logger.debug("LODs of %d chunks, %d indices added to %d", lodChunks, offset, indexCount);
+    indexCount += offset;
+
+    delete [] lists;
+    delete [] chunkBankSize;
+    return lodBuffer;
+}
+
+void ModelLoader::chunkBounds(const MeshVertex *vertices, const uint32_t *indexBuffer)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_BOUNDS);
+
+    // quantized positions are off by up to half a step, the bounds must still hold them
+    float pad[3] = {0.0f, 0.0f, 0.0f};
+    if(m_quantized)
+    {
+        for(int c = 0; c < 3; ++c)
+        {
+            pad[c] = m_pos_scale[c] / 32767.0f;
+        }
+    }
+
+    P3dParallel::forEach(m_chunks.size(), [&](size_t i)
+    {
+        MeshChunk& meshChunk = m_chunks[i];
+        const uint32_t* indices = indexBuffer + meshChunk.f3Offset;
+        const MeshVertex* bank = vertices + meshChunk.vertOffset;
+        uint32_t index;
+        int c;
+        if(!meshChunk.indexCount)
+        {
+            return;
+        }
+
+        const float* first = bank[indices[0]].pos;
+        for(c = 0; c < 3; ++c)
+        {
+            meshChunk.boundsMin[c] = meshChunk.boundsMax[c] = first[c];
+        }
+        for(index = 1; index < meshChunk.indexCount; ++index)
+        {
+            const float* pos = bank[indices[index]].pos;
+            for(c = 0; c < 3; ++c)
+            {
+                if(pos[c] < meshChunk.boundsMin[c]) meshChunk.boundsMin[c] = pos[c];
+                if(pos[c] > meshChunk.boundsMax[c]) meshChunk.boundsMax[c] = pos[c];
+            }
+        }
+        for(c = 0; c < 3; ++c)
+        {
+            meshChunk.boundsMin[c] -= pad[c];
+            meshChunk.boundsMax[c] += pad[c];
+            meshChunk.sphereCenter[c] = 0.5f * (meshChunk.boundsMin[c] + meshChunk.boundsMax[c]);
+        }
+
+        // around the box center, tighter than the box's half diagonal for most meshes
+        float radius2 = 0.0f;
+        for(index = 0; index < meshChunk.indexCount; ++index)
+        {
+            const float* pos = bank[indices[index]].pos;
+            float distance2 = 0.0f;
+            for(c = 0; c < 3; ++c)
+            {
+                float d = fabsf(pos[c] - meshChunk.sphereCenter[c]) + pad[c];
+                distance2 += d * d;
+            }
+            if(distance2 > radius2) radius2 = distance2;
+        }
+        meshChunk.sphereRadius = sqrtf(radius2);
+    });
+}
+
+void ModelLoader::clusterChunks(const MeshVertex *vertices, uint32_t *indexBuffer)
+{
+    P3dProfiler::Scope scope(P3dProfiler::STAGE_CLUSTER);
+    uint32_t chunk;
+    uint32_t chunkCount = m_chunks.size();
+    uint32_t clusterTriangles = m_options.clusterTriangles;
+
+    // triangle counts of the clusters of every chunk, in index buffer order
+    P3dVector<uint32_t>* clusters = new P3dVector<uint32_t>[chunkCount];
+    P3dParallel::forEach(chunkCount, [&](size_t i)
+    {
+        const MeshChunk& meshChunk = m_chunks[i];
+        uint32_t* indices = indexBuffer + meshChunk.f3Offset;
+        const MeshVertex* bank = vertices + meshChunk.vertOffset;
+        uint32_t triCount = meshChunk.indexCount / 3;
+        uint32_t tri;
+        int c;
+        if(triCount <= clusterTriangles || meshChunk.indexCount % 3)
+        {
+            clusters[i].push_back(triCount);
+            return;
+        }
+
+        // triangle centroids, times 3
+        float* centroids = new float[size_t(triCount) * 3];
+        uint32_t* order = new uint32_t[triCount];
+        for(tri = 0; tri < triCount; ++tri)
+        {
+            order[tri] = tri;
+            for(c = 0; c < 3; ++c)
+            {
+                centroids[tri * 3 + c] = bank[indices[tri * 3]].pos[c] + bank[indices[tri * 3 + 1]].pos[c] +
+                        bank[indices[tri * 3 + 2]].pos[c];
+            }
+        }
+
+        // median splits along the longest axis of the centroids, like P3dBvh does with chunks;
+        // the right half goes on the stack first so clusters come out left to right,
+        // (first, count) pairs, the depth of the splits stays far below 64
+        uint32_t stack[64][2];
+        uint32_t size = 0;
+        stack[size][0] = 0;
+        stack[size++][1] = triCount;
+        while(size)
+        {
+            --size;
+            uint32_t first = stack[size][0];
+            uint32_t count = stack[size][1];
+            if(count <= clusterTriangles)
+            {
+                clusters[i].push_back(count);
+                continue;
+            }
+
+            float centerMin[3];
+            float centerMax[3];
+            for(c = 0; c < 3; ++c)
+            {
+                centerMin[c] = centerMax[c] = centroids[order[first] * 3 + c];
+            }
+            for(tri = first + 1; tri < first + count; ++tri)
+            {
+                for(c = 0; c < 3; ++c)
+                {
+                    float value = centroids[order[tri] * 3 + c];
+                    if(value < centerMin[c]) centerMin[c] = value;
+                    if(value > centerMax[c]) centerMax[c] = value;
+                }
+            }
+            int axis = 0;
+            for(c = 1; c < 3; ++c)
+            {
+                if(centerMax[c] - centerMin[c] > centerMax[axis] - centerMin[axis]) axis = c;
+            }
+            uint32_t half = count / 2;
+            std::nth_element(order + first, order + first + half, order + first + count,
+                             [centroids, axis](uint32_t a, uint32_t b)
+            {
+                return centroids[a * 3 + axis] < centroids[b * 3 + axis];
+            });
+            stack[size][0] = first + half;
+            stack[size++][1] = count - half;
+            stack[size][0] = first;
+            stack[size++][1] = half;
+        }
+
+        uint32_t* clustered = new uint32_t[size_t(triCount) * 3];
+        for(tri = 0; tri < triCount; ++tri)
+        {
+            memcpy(clustered + tri * 3, indices + order[tri] * 3, 3 * sizeof(uint32_t));
+        }
+        memcpy(indices, clustered, size_t(triCount) * 3 * sizeof(uint32_t));
+        delete [] clustered;
+        delete [] order;
+        delete [] centroids;
+    });
+
+    // every cluster becomes a chunk of the same bank and material
+    MeshChunk* chunks = new MeshChunk[chunkCount];
+    memcpy(chunks, m_chunks.data(), chunkCount * sizeof(MeshChunk));
+    m_chunks.clear();
+    for(chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        MeshChunk cluster = chunks[chunk];
+        for(uint32_t tris: clusters[chunk])
+        {
+            cluster.indexCount = tris * 3;
+            // split quads are mixed in with the triangles now
+            cluster.f4Offset = cluster.f3Offset + cluster.indexCount;
+            m_chunks.push_back(cluster);
+            cluster.f3Offset += cluster.indexCount;
+        }
+    }
+    delete [] chunks;
+    delete [] clusters;
+    m_clustered = true;
 }
@@ -7,12 +7,28 @@
 #include "P3dVector.h"
 #include "P3dMap.h"
 #include "glwrapper.h"
+#include "P3dBvh.h"
 
 #include "BaseLoader.h"
 
 struct GLBuffers;
+struct P3dFileHeader;
 class IMaterialsInfo;
 
+const GLuint ATTRIB_POSITION = 0;
+const GLuint ATTRIB_NORMAL = 1;
+const GLuint ATTRIB_UV = 2;
+
+//! \brief compressed upload format of MeshVertex
+//! pos is snorm16 within the bounding box, norm is oct encoded snorm8,
+//! uv is unorm16 within the uv range of the model
+struct MeshVertexQuantized
+{
+    int16_t pos[3];
+    int8_t norm[2];
+    uint16_t uv[2];
+};
+
 class ModelLoader
 {
 public:
@@ -28,27 +44,108 @@ public:
 
     //accessors
     IMaterialsInfo* materialsInfo() {return m_materialInfo;}
+    LoadOptions& options() { return m_options; }
 
     bool isLoaded() { return m_loaded; }
     void setIsLoaded(bool newValue) { m_loaded = newValue; }
     void clear();
     int chunkCount() { return m_chunks.size(); }
-    GLuint posBuffer(uint32_t chunk);
-    GLuint uvBuffer(uint32_t chunk);
-    GLuint normBuffer(uint32_t chunk);
+    GLuint vertexBuffer(uint32_t chunk);
+    //! \brief vertex array object of the chunk's bank, 0 when vertex arrays are not used
+    //! It has the attributes and the index buffer set up, see setVertexArrays.
+    GLuint vertexArray(uint32_t chunk);
+    //! \brief points the ATTRIB_* attributes into the bound GL_ARRAY_BUFFER, in the uploaded layout
+    //! Only needed without vertex arrays, the attribute arrays must be enabled too.
+    void setAttribPointers();
     GLuint indexBuffer() { return m_index_buffer; }
+    //! \brief GL_UNSIGNED_INT or GL_UNSIGNED_SHORT, as uploaded
+    GLenum indexType() { return m_index_type; }
+    size_t indexSize() { return m_index_type == GL_UNSIGNED_INT ? 4 : 2; }
+    //! \brief whether the context draws 32 bit indices, loaders only split banks when it does not
+    bool uint32Indices() { return m_uint32_indices; }
+    void setUint32Indices(bool newValue) { m_uint32_indices = newValue; }
+    //! \brief whether the context has vertex array objects, uploads then create one per bank
+    bool vertexArrays() { return m_vertex_arrays; }
+    void setVertexArrays(bool newValue) { m_vertex_arrays = newValue; }
     uint32_t indexCount(uint32_t chunk) { return m_chunks[chunk].indexCount; }
     uint32_t indexOffset(uint32_t chunk) { return m_chunks[chunk].f3Offset; }
+    //! \brief simplified index lists, level 0 is the first below full detail, counts of 0 are missing levels
+    uint32_t lodIndexCount(uint32_t chunk, uint32_t level) { return m_chunks[chunk].lodCount[level]; }
+    uint32_t lodIndexOffset(uint32_t chunk, uint32_t level) { return m_chunks[chunk].lodOffset[level]; }
+    float lodError(uint32_t chunk, uint32_t level) { return m_chunks[chunk].lodError[level]; }
     uint16_t material(uint32_t chunk) { return m_chunks[chunk].material; }
     uint16_t materialCount() { return m_mat_count; }
     bool hasUvs(uint32_t chunk) { return m_chunks[chunk].hasUvs; }
+    //! \brief box and sphere around the chunk's triangles, in model space
+    const float* boundsMin(uint32_t chunk) { return m_chunks[chunk].boundsMin; }
+    const float* boundsMax(uint32_t chunk) { return m_chunks[chunk].boundsMax; }
+    const float* sphereCenter(uint32_t chunk) { return m_chunks[chunk].sphereCenter; }
+    float sphereRadius(uint32_t chunk) { return m_chunks[chunk].sphereRadius; }
     float boundingRadius();
+    bool isQuantized() { return m_quantized; }
+    //! \brief chunks were split into clusters, LoadOptions::clusterTriangles
+    bool isClustered() { return m_clustered; }
+    //! \brief hierarchy over the chunk bounds, built when the model is created
+    const P3dBvh& bvh() { return m_bvh; }
+    //! \brief decode as offset + scale * attribute for quantized models
+    const float* posOffset() { return m_pos_offset; }
+    const float* posScale() { return m_pos_scale; }
+    const float* uvOffset() { return m_uv_offset; }
+    const float* uvScale() { return m_uv_scale; }
     void setBoundingBox(float minX, float maxX, float minY, float maxY, float minZ, float maxZ);
-    void createModel(uint32_t posCount, uint32_t normCount, uint32_t emptyNormCount, uint32_t uvCount,
-                     float* posBuffer, float* normBuffer, float* uvBuffer, uint32_t indexCount,
-                     uint16_t* indexBuffer, uint32_t chunkCount, const MeshChunk *chunks);
+    void createModel(uint32_t vertCount, uint32_t emptyNormCount, MeshVertex* vertices, uint32_t indexCount,
+                     uint32_t* indexBuffer, uint32_t chunkCount, const MeshChunk *chunks);
+
+    //! \brief creates the model from a validated .p3d file, see P3dLoader
+    //! Buffers are uploaded from the file data, deferred uploads copy it.
+    void createModel(const P3dFileHeader& header, const MeshChunk* chunks, const char* vertexData,
+                     const char* indexData);
+
+    //! \brief sets a material property, loaders use this so modelFile can keep the properties
+    void setMaterialProperty(int materialIndex, const char* property, const char* value);
+
+    //! \brief when set, createModel keeps the model as .p3d data for modelFile
+    //! It is kept too while LoadOptions::cacheModel and setSourceData are in effect.
+    void setKeepModelFile(bool newValue) { m_keep_model_file = newValue; }
+    //! \brief .p3d data of the last createModel, 0 if it was not kept
+    //! Call when the loader is done, valid until the next load or clear.
+    const char* modelFile(size_t* size);
+
+    //! \brief identifies the data the next load parses, for LoadOptions::cacheNormals and cacheModel
+    //! Call before BaseLoader::load, hashes the data only when caching is on.
+    void setSourceData(const char* data, size_t size);
+    //! \brief loads the model cached for the source data, LoadOptions::cacheModel
+    //! \return false if caching is off or there is no valid entry, load normally then
+    bool loadModelCache();
+    //! \brief caches the model just loaded for the source data, LoadOptions::cacheModel
+    void saveModelCache();
+    //! \brief 64 bit hash of data (xxHash64), stable across runs and platforms of one endianness
+    static uint64_t hashData(const char* data, size_t size, uint64_t seed = 0);
+
+    //! \brief when set, createModel keeps copies of the buffers instead of uploading them
+    //! Lets loaders run off the GL thread, uploadPending then does the GL part.
+    bool deferUploads() { return m_defer_uploads; }
+    void setDeferUploads(bool newValue) { m_defer_uploads = newValue; }
+    bool hasPendingUploads() { return m_pending_next < m_pending.size(); }
+    //! \brief uploads staged buffers, call on the GL thread
+    //! \arg byteBudget bytes to upload in this call, 0 for all, large buffers are filled in parts
+    //! \return true when nothing is left to upload
+    bool uploadPending(size_t byteBudget);
+    //! \brief while uploads are pending, whether the vertex buffers are done
+    bool verticesUploaded();
+    //! \brief while uploads are pending, indices at the start of the index buffer that are done
+    //! Draws must stay within them, UINT32_MAX once nothing is pending.
+    uint32_t uploadedIndexCount();
+
+    //! \brief the data of the next .p3d createModel is still arriving, up to end so far
+    //! Deferred uploads then read it in place instead of copying it and stop at end.
+    //! Call again as more arrives, see P3dLoader::appendData.
+    void setStreamEnd(const char* end) { m_stream_end = end; }
+    //! \brief all streamed data arrived, data is freed with delete [] once it is uploaded
+    void finishStream(char* data);
 private:
     IMaterialsInfo* m_materialInfo = nullptr;
+    LoadOptions m_options;
 
     struct VertexIndex
     {
@@ -60,9 +157,44 @@ private:
         size_t hash() const;
     };
     size_t addPadding(size_t size);
-    void generateNormals(uint16_t *new_faces, GLfloat* new_pos, GLfloat* new_norm, uint32_t emptyNormCount);
+    void generateNormals(uint32_t *new_faces, MeshVertex* vertices, uint32_t vertCount, uint32_t emptyNormCount);
+    void addChunks(const MeshChunk* chunks, uint32_t chunkCount);
+    void queueUploads(const char* vertexData, size_t vertexSize, uint32_t vertCount,
+                      const char* indexData, size_t indexBytes);
+    void keepModelFile(const char* vertexData, size_t vertexBytes, uint32_t vertCount,
+                       const char* indexData, uint32_t indexCount);
+    void clearModelFile();
+    void modelCacheKey(char* key);
+    void normalsCacheKey(char* key, uint32_t vertCount);
+    bool loadNormalsCache(P3dVector<uint32_t>& chunks, const uint32_t* new_faces, MeshVertex* vertices,
+                          uint32_t vertCount);
+    void saveNormalsCache(const uint32_t* weld, const MeshVertex* vertices, uint32_t vertCount);
+    MeshVertexQuantized* quantizeVertices(const MeshVertex* vertices, uint32_t vertCount,
+                                          const float* posMin, const float* posMax);
+    void optimizeMeshes(MeshVertex* vertices, uint32_t* indexBuffer);
+    void clusterChunks(const MeshVertex* vertices, uint32_t* indexBuffer);
+    void groupChunks(uint32_t* indexBuffer, uint32_t indexCount);
+    uint32_t* simplifyMeshes(const MeshVertex* vertices, const uint32_t* indexBuffer, uint32_t& indexCount);
+    void chunkBounds(const MeshVertex* vertices, const uint32_t* indexBuffer);
+    void clearPending();
+    void createVertexArrays();
 
     bool m_loaded;
+    // hash of the data being loaded, 0 when nothing is cached
+    uint64_t m_source_hash = 0;
+
+    // .p3d data, the header is completed by modelFile
+    bool m_keep_model_file = false;
+    char* m_model_file = nullptr;
+    size_t m_model_file_size = 0;
+    bool m_model_file_done = false;
+    struct Property
+    {
+        int materialIndex;
+        char* property;
+        char* value;
+    };
+    P3dVector<Property> m_properties;
 
     uint32_t m_pos_count;
     uint32_t m_norm_count;
@@ -96,10 +228,42 @@ private:
     uint32_t m_new_empty_norm_count;
     uint32_t m_new_uv_count;
 
+    bool m_clustered = false;
+    P3dBvh m_bvh;
+
+    // quantization
+    bool m_quantized = false;
+    float m_pos_offset[3] = {0.0f, 0.0f, 0.0f};
+    float m_pos_scale[3] = {0.0f, 0.0f, 0.0f};
+    float m_uv_offset[2] = {0.0f, 0.0f};
+    float m_uv_scale[2] = {0.0f, 0.0f};
+
     // OpenGL
-    GLuint m_index_buffer;
+    bool m_uint32_indices = false;
+    bool m_vertex_arrays = false;
+    GLenum m_index_type = GL_UNSIGNED_SHORT;
+    GLuint m_index_buffer = 0;
     P3dMap<uint32_t, GLBuffers*> m_gl_buffers;
 
+    // staged uploads, buffer points into GLBuffers or at m_index_buffer
+    struct PendingBuffer
+    {
+        GLenum target;
+        GLuint* buffer;
+        const char* data;
+        size_t size;
+        size_t done;
+    };
+    bool m_defer_uploads = false;
+    P3dVector<PendingBuffer> m_pending;
+    size_t m_pending_next = 0;
+    MeshVertex* m_staged_vertices = nullptr;
+    MeshVertexQuantized* m_staged_quantized = nullptr;
+    char* m_staged_indices = nullptr;
+    // streamed .p3d data, uploads don't read past m_stream_end until finishStream
+    const char* m_stream_end = nullptr;
+    char* m_staged_stream = nullptr;
+
     // bounding box
     float m_maxX;
     float m_minX;
@@ -0,0 +1,198 @@
+#include "NormalGenerator.h"
+#include "P3dParallel.h"
+#include <cstring>
+
+// faces or positions one worker takes at a time
+static const uint32_t BLOCK_SIZE = 16384;
+static const float D2R = 3.14159265358979f / 180.0f;
+
+void NormalGenerator::creaseNormals(const float *positions, uint32_t positionCount, const uint32_t *cornerPositions,
+                                    uint32_t triCount, uint32_t quadCount, NormalWeighting weighting, float creaseAngle,
+                                    uint32_t *cornerGroups, float *normals)
+{
+    uint32_t faceCount = triCount + quadCount;
+    uint32_t quadCorners = triCount * 3;
+    uint32_t cornerCount = quadCorners + quadCount * 4;
+    uint32_t i;
+
+    // unit normal per face and weighted normal per corner, 4 floats each
+    float* faceNormals = new float[size_t(faceCount) * 4];
+    float* weighted = new float[size_t(cornerCount) * 4]();
+    P3dParallel::forEach((faceCount + BLOCK_SIZE - 1) / BLOCK_SIZE, [&](size_t block)
+    {
+        uint32_t end = (block + 1) * BLOCK_SIZE < faceCount ? (block + 1) * BLOCK_SIZE : faceCount;
+        for(uint32_t face = block * BLOCK_SIZE; face < end; ++face)
+        {
+            bool quad = face >= triCount;
+            uint32_t first = quad ? quadCorners + (face - triCount) * 4 : face * 3;
+            uint32_t verts = quad ? 4 : 3;
+            bool valid = true;
+            for(uint32_t v = 0; v < verts; ++v)
+            {
+                valid = valid && cornerPositions[first + v] < positionCount;
+            }
+            float* unit = faceNormals + size_t(face) * 4;
+            if(!valid)
+            {
+                unit[0] = unit[1] = unit[2] = unit[3] = 0.0f;
+                continue;
+            }
+
+            const float* a = positions + size_t(cornerPositions[first]) * 3;
+            const float* b = positions + size_t(cornerPositions[first + 1]) * 3;
+            const float* c = positions + size_t(cornerPositions[first + 2]) * 3;
+            float* sums = weighted + size_t(first) * 4;
+            addTriangle(a, b, c, weighting, sums, sums + 4, sums + 8);
+            if(!quad)
+            {
+                faceNormal(a, b, c, unit);
+                continue;
+            }
+
+            // both halves of the quad, the face normal is their average
+            const float* d = positions + size_t(cornerPositions[first + 3]) * 3;
+            addTriangle(d, a, c, weighting, sums + 12, sums, sums + 8);
+            float second[4];
+            bool firstValid = faceNormal(a, b, c, unit);
+            bool secondValid = faceNormal(d, a, c, second);
+            if(firstValid && secondValid)
+            {
+                P3dSimd::Vec4 sum = P3dSimd::add(P3dSimd::load4(unit), P3dSimd::load4(second));
+                float length2 = P3dSimd::dot3(sum, sum);
+                P3dSimd::store4(unit, P3dSimd::mul(sum, length2 > 0.0f ? 1.0f / sqrtf(length2) : 0.0f));
+            }
+            else if(secondValid)
+            {
+                memcpy(unit, second, sizeof(second));
+            }
+        }
+    });
+
+    // weld, exporters often repeat a position per face or per uv
+    uint32_t* weld = new uint32_t[positionCount];
+    uint32_t weldCount = 0;
+    {
+        P3dMap<glm::vec3, uint32_t> welded(positionCount);
+        for(i = 0; i < positionCount; ++i)
+        {
+            const float* pos = positions + size_t(i) * 3;
+            bool inserted;
+            P3dPair<glm::vec3, uint32_t>* item = welded.findOrInsert(glm::vec3(pos[0], pos[1], pos[2]), &inserted);
+            if(inserted)
+            {
+                item->second = weldCount++;
+            }
+            weld[i] = item->second;
+        }
+    }
+
+    // corners of each welded position, counting sort keeps them in corner order
+    uint32_t* positionStart = new uint32_t[size_t(weldCount) + 1]();
+    for(i = 0; i < cornerCount; ++i)
+    {
+        if(cornerPositions[i] < positionCount)
+        {
+            ++positionStart[weld[cornerPositions[i]] + 1];
+        }
+    }
+    for(i = 0; i < weldCount; ++i)
+    {
+        positionStart[i + 1] += positionStart[i];
+    }
+    uint32_t* positionCorners = new uint32_t[positionStart[weldCount]];
+    uint32_t* fill = new uint32_t[weldCount];
+    memcpy(fill, positionStart, weldCount * sizeof(uint32_t));
+    for(i = 0; i < cornerCount; ++i)
+    {
+        cornerGroups[i] = i;
+        if(cornerPositions[i] < positionCount)
+        {
+            positionCorners[fill[weld[cornerPositions[i]]]++] = i;
+        }
+        else
+        {
+            normals[size_t(i) * 3] = normals[size_t(i) * 3 + 1] = normals[size_t(i) * 3 + 2] = 0.0f;
+        }
+    }
+    delete [] fill;
+    delete [] weld;
+
+    // group the corners of each position around the first face not yet in a group
+    float creaseCos = creaseAngle >= 180.0f ? -2.0f : cosf(creaseAngle * D2R);
+    P3dParallel::forEach((weldCount + BLOCK_SIZE - 1) / BLOCK_SIZE, [&](size_t block)
+    {
+        uint32_t end = (block + 1) * BLOCK_SIZE < weldCount ? (block + 1) * BLOCK_SIZE : weldCount;
+        for(uint32_t position = block * BLOCK_SIZE; position < end; ++position)
+        {
+            const uint32_t* corners = positionCorners + positionStart[position];
+            uint32_t count = positionStart[position + 1] - positionStart[position];
+            uint32_t firstGroup = UINT32_MAX;
+            uint32_t c;
+
+            auto faceOf = [&](uint32_t corner)
+            {
+                return corner >= quadCorners ? triCount + (corner - quadCorners) / 4 : corner / 3;
+            };
+            // degenerate faces don't start groups, mark them until they join one
+            for(c = 0; c < count; ++c)
+            {
+                const float* unit = faceNormals + size_t(faceOf(corners[c])) * 4;
+                bool degenerate = !unit[0] && !unit[1] && !unit[2];
+                cornerGroups[corners[c]] = degenerate ? UINT32_MAX : corners[c];
+            }
+
+            for(c = 0; c < count; ++c)
+            {
+                uint32_t seed = corners[c];
+                if(cornerGroups[seed] != seed)
+                {
+                    continue;
+                }
+                if(firstGroup == UINT32_MAX) firstGroup = seed;
+
+                P3dSimd::Vec4 seedNormal = P3dSimd::load4(faceNormals + size_t(faceOf(seed)) * 4);
+                P3dSimd::Vec4 sum = P3dSimd::load4(weighted + size_t(seed) * 4);
+                for(uint32_t other = c + 1; other < count; ++other)
+                {
+                    uint32_t corner = corners[other];
+                    if(cornerGroups[corner] != corner)
+                    {
+                        continue;
+                    }
+                    P3dSimd::Vec4 otherNormal = P3dSimd::load4(faceNormals + size_t(faceOf(corner)) * 4);
+                    if(P3dSimd::dot3(seedNormal, otherNormal) >= creaseCos)
+                    {
+                        cornerGroups[corner] = seed;
+                        sum = P3dSimd::add(sum, P3dSimd::load4(weighted + size_t(corner) * 4));
+                    }
+                }
+
+                float length2 = P3dSimd::dot3(sum, sum);
+                float result[4];
+                P3dSimd::store4(result, P3dSimd::mul(sum, length2 > 0.0f ? 1.0f / sqrtf(length2) : 0.0f));
+                memcpy(normals + size_t(seed) * 3, result, 3 * sizeof(float));
+            }
+
+            for(c = 0; c < count; ++c)
+            {
+                uint32_t corner = corners[c];
+                if(cornerGroups[corner] != UINT32_MAX)
+                {
+                    continue;
+                }
+                if(firstGroup == UINT32_MAX)
+                {
+                    // only degenerate faces here
+                    firstGroup = corner;
+                    normals[size_t(corner) * 3] = normals[size_t(corner) * 3 + 1] = normals[size_t(corner) * 3 + 2] = 0.0f;
+                }
+                cornerGroups[corner] = firstGroup;
+            }
+        }
+    });
+
+    delete [] positionCorners;
+    delete [] positionStart;
+    delete [] weighted;
+    delete [] faceNormals;
+}
@@ -0,0 +1,132 @@
+#ifndef NORMALGENERATOR_H
+#define NORMALGENERATOR_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+
+#include "BaseLoader.h"
+#include "P3dMap.h"
+#include "P3dSimd.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+//! \brief normals are summed per position value, not per index, maps weld by it
+template<>
+struct P3dHash<glm::vec3>
+{
+    size_t operator() (const glm::vec3& k) const
+    {
+        // adding 0 turns -0 into 0, they compare equal so must hash equal
+        glm::vec3 key = k + glm::vec3(0.0f);
+        uint32_t bits[3];
+        memcpy(bits, &key.x, sizeof(bits));
+        size_t h1 = bits[0];
+        size_t h2 = bits[1];
+        h1 ^= h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2);
+        h2 = bits[2];
+        h1 ^= h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2);
+        return h1;
+    }
+};
+
+//! \brief vertex normals from face normals
+class NormalGenerator
+{
+public:
+    //! \brief adds the normal of triangle a, b, c with each corner's weight to suma, sumb and sumc
+    //! Sums are 4 floats, w stays 0. Degenerate triangles add nothing.
+    static inline void addTriangle(const float* a, const float* b, const float* c, NormalWeighting weighting,
+                                   float* suma, float* sumb, float* sumc);
+
+    //! \brief unit normal of triangle a, b, c into 4 floats
+    //! \return false for degenerate triangles, normal is 0 then
+    static inline bool faceNormal(const float* a, const float* b, const float* c, float* normal);
+
+    //! \brief smooth normals of a triangle and quad list, split where faces meet at more than creaseAngle
+    //! Corners are the 3 of every triangle followed by the 4 of every quad, quads are
+    //! drawn as (0, 1, 2) and (3, 0, 2). Corners of one position share a normal when their
+    //! faces are within creaseAngle of the first face of the group. Positions with equal
+    //! values count as one.
+    //! \arg positions xyz per position
+    //! \arg cornerPositions position index of every corner
+    //! \arg cornerGroups out, per corner the first corner of the group it shares its normal with
+    //! \arg normals out, xyz per corner, set at the corners cornerGroups points to
+    static void creaseNormals(const float* positions, uint32_t positionCount, const uint32_t* cornerPositions,
+                              uint32_t triCount, uint32_t quadCount, NormalWeighting weighting, float creaseAngle,
+                              uint32_t* cornerGroups, float* normals);
+
+private:
+    static inline float angle(P3dSimd::Vec4 from, P3dSimd::Vec4 to1, P3dSimd::Vec4 to2);
+};
+
+inline float NormalGenerator::angle(P3dSimd::Vec4 from, P3dSimd::Vec4 to1, P3dSimd::Vec4 to2)
+{
+    P3dSimd::Vec4 e1 = P3dSimd::sub(to1, from);
+    P3dSimd::Vec4 e2 = P3dSimd::sub(to2, from);
+    float lengths = sqrtf(P3dSimd::dot3(e1, e1) * P3dSimd::dot3(e2, e2));
+    if(!(lengths > 0.0f))
+    {
+        return 0.0f;
+    }
+    float cosAngle = P3dSimd::dot3(e1, e2) / lengths;
+    if(cosAngle > 1.0f) cosAngle = 1.0f;
+    if(cosAngle < -1.0f) cosAngle = -1.0f;
+    return acosf(cosAngle);
+}
+
+inline void NormalGenerator::addTriangle(const float* a, const float* b, const float* c, NormalWeighting weighting,
+                                         float* suma, float* sumb, float* sumc)
+{
+    P3dSimd::Vec4 posa = P3dSimd::load3(a);
+    P3dSimd::Vec4 posb = P3dSimd::load3(b);
+    P3dSimd::Vec4 posc = P3dSimd::load3(c);
+    P3dSimd::Vec4 normal = P3dSimd::cross(P3dSimd::sub(posa, posb), P3dSimd::sub(posb, posc));
+    float length2 = P3dSimd::dot3(normal, normal);
+    // false for NaN too
+    if(!(length2 > 0.0f))
+    {
+        return;
+    }
+
+    P3dSimd::Vec4 weighteda;
+    P3dSimd::Vec4 weightedb;
+    P3dSimd::Vec4 weightedc;
+    switch(weighting)
+    {
+    case NORMALS_AREA:
+        // the cross product is twice the area long
+        weighteda = weightedb = weightedc = normal;
+        break;
+    case NORMALS_ANGLE:
+        normal = P3dSimd::mul(normal, 1.0f / sqrtf(length2));
+        weighteda = P3dSimd::mul(normal, angle(posa, posb, posc));
+        weightedb = P3dSimd::mul(normal, angle(posb, posc, posa));
+        weightedc = P3dSimd::mul(normal, angle(posc, posa, posb));
+        break;
+    default:
+        weighteda = weightedb = weightedc = P3dSimd::mul(normal, 1.0f / sqrtf(length2));
+        break;
+    }
+    P3dSimd::store4(suma, P3dSimd::add(P3dSimd::load4(suma), weighteda));
+    P3dSimd::store4(sumb, P3dSimd::add(P3dSimd::load4(sumb), weightedb));
+    P3dSimd::store4(sumc, P3dSimd::add(P3dSimd::load4(sumc), weightedc));
+}
+
+inline bool NormalGenerator::faceNormal(const float* a, const float* b, const float* c, float* normal)
+{
+    P3dSimd::Vec4 posb = P3dSimd::load3(b);
+    P3dSimd::Vec4 cross = P3dSimd::cross(P3dSimd::sub(P3dSimd::load3(a), posb), P3dSimd::sub(posb, P3dSimd::load3(c)));
+    float length2 = P3dSimd::dot3(cross, cross);
+    if(!(length2 > 0.0f) || std::isinf(length2))
+    {
+        normal[0] = normal[1] = normal[2] = normal[3] = 0.0f;
+        return false;
+    }
+    P3dSimd::store4(normal, P3dSimd::mul(cross, 1.0f / sqrtf(length2)));
+    return true;
+}
+
+#endif // NORMALGENERATOR_H
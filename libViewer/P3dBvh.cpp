@@ -0,0 +1,93 @@
+#include "P3dBvh.h"
+#include "BaseLoader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void P3dBvh::build(const MeshChunk *chunks, uint32_t chunkCount)
+{
+    m_nodes.clear();
+    P3dVector<uint32_t> items;
+    for(uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        if(chunks[chunk].indexCount)
+        {
+            items.push_back(chunk);
+        }
+    }
+    if(!items.size())
+    {
+        return;
+    }
+    m_nodes.reserve(items.size() * 2 - 1);
+    buildNode(chunks, items.data(), items.size());
+}
+
+uint32_t P3dBvh::buildNode(const MeshChunk *chunks, uint32_t *items, uint32_t count)
+{
+    // children are pushed behind the node, only write it through its index
+    uint32_t index = m_nodes.size();
+    Node node;
+    memset(&node, 0, sizeof(node));
+    m_nodes.push_back(node);
+
+    const MeshChunk& first = chunks[items[0]];
+    if(count == 1)
+    {
+        memcpy(node.boundsMin, first.boundsMin, sizeof(node.boundsMin));
+        memcpy(node.boundsMax, first.boundsMax, sizeof(node.boundsMax));
+        memcpy(node.sphereCenter, first.sphereCenter, sizeof(node.sphereCenter));
+        node.sphereRadius = first.sphereRadius;
+        node.index = items[0];
+        node.leaf = true;
+        m_nodes[index] = node;
+        return index;
+    }
+
+    float centerMin[3];
+    float centerMax[3];
+    int c;
+    for(c = 0; c < 3; ++c)
+    {
+        node.boundsMin[c] = first.boundsMin[c];
+        node.boundsMax[c] = first.boundsMax[c];
+        centerMin[c] = centerMax[c] = first.sphereCenter[c];
+    }
+    for(uint32_t i = 1; i < count; ++i)
+    {
+        const MeshChunk& chunk = chunks[items[i]];
+        for(c = 0; c < 3; ++c)
+        {
+            node.boundsMin[c] = std::min(node.boundsMin[c], chunk.boundsMin[c]);
+            node.boundsMax[c] = std::max(node.boundsMax[c], chunk.boundsMax[c]);
+            centerMin[c] = std::min(centerMin[c], chunk.sphereCenter[c]);
+            centerMax[c] = std::max(centerMax[c], chunk.sphereCenter[c]);
+        }
+    }
+    float radius2 = 0.0f;
+    for(c = 0; c < 3; ++c)
+    {
+        node.sphereCenter[c] = 0.5f * (node.boundsMin[c] + node.boundsMax[c]);
+        float half = node.boundsMax[c] - node.sphereCenter[c];
+        radius2 += half * half;
+    }
+    node.sphereRadius = sqrtf(radius2);
+
+    int axis = 0;
+    for(c = 1; c < 3; ++c)
+    {
+        if(centerMax[c] - centerMin[c] > centerMax[axis] - centerMin[axis]) axis = c;
+    }
+    uint32_t half = count / 2;
+    std::nth_element(items, items + half, items + count, [chunks, axis](uint32_t a, uint32_t b)
+    {
+        return chunks[a].sphereCenter[axis] < chunks[b].sphereCenter[axis];
+    });
+
+    buildNode(chunks, items, half);
+    node.index = buildNode(chunks, items + half, count - half);
+    node.leaf = false;
+    m_nodes[index] = node;
+    return index;
+}
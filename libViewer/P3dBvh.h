@@ -0,0 +1,105 @@
+#ifndef P3DBVH_H
+#define P3DBVH_H
+
+#include <cstdlib>
+#include <cstdint>
+#include "P3dVector.h"
+#include "P3dFrustum.h"
+
+struct MeshChunk;
+
+//! \brief bounding volume hierarchy over the chunks of a model
+//! Built top down, every node splits its chunks at the median along the
+//! longest axis of their centers. Leaves hold one chunk each.
+class P3dBvh
+{
+public:
+    struct Node
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        float sphereCenter[3];
+        float sphereRadius;
+        //! leaves: the chunk, inner nodes: the second child, the first one follows the node
+        uint32_t index;
+        bool leaf;
+    };
+
+    //! \brief builds the tree from MeshChunk bounds, chunks without indices are left out
+    void build(const MeshChunk* chunks, uint32_t chunkCount);
+    void clear() { m_nodes.clear(); }
+    uint32_t nodeCount() const { return m_nodes.size(); }
+
+    //! \brief calls visit(chunk) for the chunks not outside the frustum
+    //! The nearer child of every node is visited first, so chunks come
+    //! roughly front to back. Subtrees inside the frustum are not tested.
+    //! \arg eye camera position in model space
+    template<typename Visit>
+    void cull(const P3dFrustum& frustum, const float* eye, Visit visit) const;
+
+private:
+    uint32_t buildNode(const MeshChunk* chunks, uint32_t* items, uint32_t count);
+
+    static const uint32_t INSIDE = 0x80000000u;
+    P3dVector<Node> m_nodes;
+};
+
+template<typename Visit>
+void P3dBvh::cull(const P3dFrustum &frustum, const float *eye, Visit visit) const
+{
+    if(!m_nodes.size())
+    {
+        return;
+    }
+    const Node* nodes = m_nodes.data();
+    auto distance2 = [eye](const Node& node)
+    {
+        float d[3] = {node.sphereCenter[0] - eye[0], node.sphereCenter[1] - eye[1], node.sphereCenter[2] - eye[2]};
+        return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    };
+
+    // node indices, INSIDE marks subtrees that need no more tests;
+    // median splits keep the depth below 32 and the stack below one entry per level
+    uint32_t stack[64];
+    uint32_t size = 0;
+    stack[size++] = 0;
+    while(size)
+    {
+        uint32_t entry = stack[--size];
+        uint32_t index = entry & ~INSIDE;
+        const Node& node = nodes[index];
+        uint32_t inside = entry & INSIDE;
+        if(!inside)
+        {
+            if(frustum.sphereOutside(node.sphereCenter, node.sphereRadius))
+            {
+                continue;
+            }
+            if(frustum.sphereInside(node.sphereCenter, node.sphereRadius))
+            {
+                inside = INSIDE;
+            }
+            else if(frustum.boxOutside(node.boundsMin, node.boundsMax))
+            {
+                continue;
+            }
+        }
+        if(node.leaf)
+        {
+            visit(node.index);
+            continue;
+        }
+
+        uint32_t nearChild = index + 1;
+        uint32_t farChild = node.index;
+        if(distance2(nodes[farChild]) < distance2(nodes[nearChild]))
+        {
+            nearChild = node.index;
+            farChild = index + 1;
+        }
+        stack[size++] = farChild | inside;
+        stack[size++] = nearChild | inside;
+    }
+}
+
+#endif // P3DBVH_H
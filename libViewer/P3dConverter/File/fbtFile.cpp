@@ -161,7 +161,10 @@ int fbtFile::parse(const char* path, int mode)
 int fbtFile::parse(const void* memory, FBTsize sizeInBytes, int mode, bool suppressHeaderWarning)
 {
 	fbtMemoryStream ms;
-	ms.open( memory, sizeInBytes, fbtStream::SM_READ, mode==PM_COMPRESSED );
+	if (mode == PM_COMPRESSED)
+		ms.open( memory, sizeInBytes, fbtStream::SM_READ, true );
+	else
+		ms.openInPlace( memory, sizeInBytes );
 
 	if (!ms.isOpen())
 	{
@@ -285,7 +285,7 @@ FBTsize fbtGzStream::writef(const char* fmt, ...)
 
 
 fbtMemoryStream::fbtMemoryStream()
-	:   m_buffer(0), m_pos(0), m_size(0), m_capacity(0), m_mode(0)
+	:   m_buffer(0), m_pos(0), m_size(0), m_capacity(0), m_mode(0), m_owned(true)
 {
 }
 
@@ -341,6 +341,22 @@ void fbtMemoryStream::open(const void* buffer, FBTsize size, fbtStream::StreamMo
 	}
 }
 
+void fbtMemoryStream::openInPlace(const void* buffer, FBTsize size)
+{
+	if (buffer && size > 0 && size != FBT_NPOS)
+	{
+		if (m_owned)
+			delete [] m_buffer;
+
+		m_buffer   = (char*)buffer;
+		m_size     = size;
+		m_capacity = size;
+		m_pos      = 0;
+		m_mode     = fbtStream::SM_READ;
+		m_owned    = false;
+	}
+}
+
 #if FBT_USE_GZ_FILE == 1
 // this method was adapted from this snippet:
 // http://windrealm.org/tutorials/decompress-gzip-stream.php
@@ -350,8 +366,9 @@ bool fbtMemoryStream::gzipInflate( char* inBuf, int inSize) {
     return true ;
   }
 
-  if (m_buffer)
+  if (m_buffer && m_owned)
 	  delete [] m_buffer;
+  m_owned = true;
 
 
   m_size = inSize ;
@@ -404,7 +421,7 @@ bool fbtMemoryStream::gzipInflate( char* inBuf, int inSize) {
 
 fbtMemoryStream::~fbtMemoryStream()
 {
-	if (m_buffer != 0 )
+	if (m_buffer != 0 && m_owned)
 	{
 		delete []m_buffer;
 	}
@@ -418,7 +435,7 @@ fbtMemoryStream::~fbtMemoryStream()
 void fbtMemoryStream::clear(void)
 {
 	m_size = m_pos = 0;
-	if (m_buffer)
+	if (m_buffer && m_owned)
 		m_buffer[0] = 0;
 }
 
@@ -502,10 +519,12 @@ void fbtMemoryStream::reserve(FBTsize nr)
 		if (m_buffer != 0)
 		{
 			fbtMemcpy(buf, m_buffer, m_size);
-			delete [] m_buffer;
+			if (m_owned)
+				delete [] m_buffer;
 		}
 
 		m_buffer = buf;
+		m_owned = true;
 		m_buffer[m_size] = 0;
 		m_capacity = nr;
 	}
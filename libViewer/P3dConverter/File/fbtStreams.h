@@ -155,6 +155,8 @@ public:
 	void open(const char* path, fbtStream::StreamMode mode);
 	void open(const fbtFileStream& fs, fbtStream::StreamMode mode);
 	void open(const void* buffer, FBTsize size, fbtStream::StreamMode mode,bool compressed=false);
+	// reads the buffer where it is without a copy, it has to outlive the stream
+	void openInPlace(const void* buffer, FBTsize size);
 
 
 	bool     isOpen(void)    const   {return m_buffer != 0;}
@@ -182,6 +184,7 @@ protected:
 	mutable FBTsize  m_pos;
 	FBTsize          m_size, m_capacity;
 	int              m_mode;
+	bool             m_owned;
 };
 
 /** @}*/
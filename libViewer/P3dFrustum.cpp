@@ -0,0 +1,71 @@
+#include "P3dFrustum.h"
+
+#include <cmath>
+
+P3dFrustum::P3dFrustum(const glm::mat4 &viewProj)
+{
+    // a point is inside when -w <= x, y, z <= w in clip space, each plane is
+    // the last row of the matrix plus or minus the row of one axis
+    for(int axis = 0; axis < 3; ++axis)
+    {
+        for(int c = 0; c < 4; ++c)
+        {
+            m_planes[axis * 2][c] = viewProj[c][3] + viewProj[c][axis];
+            m_planes[axis * 2 + 1][c] = viewProj[c][3] - viewProj[c][axis];
+        }
+    }
+    for(float* plane: m_planes)
+    {
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        for(int c = 0; c < 4; ++c)
+        {
+            plane[c] *= scale;
+        }
+        if(length <= 0.0f)
+        {
+            // degenerate projection, the plane keeps everything
+            plane[3] = 1.0f;
+        }
+    }
+}
+
+bool P3dFrustum::sphereOutside(const float *center, float radius) const
+{
+    for(const float* plane: m_planes)
+    {
+        if(plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool P3dFrustum::sphereInside(const float *center, float radius) const
+{
+    for(const float* plane: m_planes)
+    {
+        if(plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool P3dFrustum::boxOutside(const float *boxMin, const float *boxMax) const
+{
+    // the corner furthest along each plane's normal
+    for(const float* plane: m_planes)
+    {
+        float x = plane[0] >= 0.0f ? boxMax[0] : boxMin[0];
+        float y = plane[1] >= 0.0f ? boxMax[1] : boxMin[1];
+        float z = plane[2] >= 0.0f ? boxMax[2] : boxMin[2];
+        if(plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,26 @@
+#ifndef P3DFRUSTUM_H
+#define P3DFRUSTUM_H
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+//! \brief the six clip planes of a projection, for culling on the CPU
+//! Tests are conservative, volumes near a frustum corner can pass without
+//! being visible, nothing visible is ever reported outside.
+class P3dFrustum
+{
+public:
+    //! \arg viewProj projection * view * model, the volumes tested are in model space
+    explicit P3dFrustum(const glm::mat4& viewProj);
+
+    bool sphereOutside(const float* center, float radius) const;
+    //! \brief the sphere lies inside all planes, its box needs no test
+    bool sphereInside(const float* center, float radius) const;
+    bool boxOutside(const float* boxMin, const float* boxMax) const;
+
+private:
+    //! normalized a, b, c, d of ax + by + cz + d >= 0 for points inside
+    float m_planes[6][4];
+};
+
+#endif // P3DFRUSTUM_H
@@ -0,0 +1,403 @@
+#include "P3dLoader.h"
+#include "ModelLoader.h"
+#include "P3dProfiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+static P3dLogger logger("core.P3dLoader", P3dLogger::LOG_DEBUG);
+
+const char P3dLoader::MAGIC[4] = {'P', '3', 'D', 'M'};
+
+static P3dLoader p3dLoader;
+static RegisterLoader registerP3dLoader(&p3dLoader, ".p3d", 0);
+
+size_t P3dLoader::vertexBytes(const P3dFileHeader &header)
+{
+    size_t vertexSize = header.flags & P3dFileHeader::FLAG_QUANTIZED ? sizeof(MeshVertexQuantized) : sizeof(MeshVertex);
+    return size_t(header.vertCount) * vertexSize;
+}
+
+size_t P3dLoader::indexBytes(const P3dFileHeader &header)
+{
+    size_t indexSize = header.flags & P3dFileHeader::FLAG_UINT32_INDICES ? 4 : 2;
+    // keeps the property records after it aligned like the rest of the file
+    return (size_t(header.indexCount) * indexSize + 3) & ~size_t(3);
+}
+
+uint64_t P3dLoader::fileBytes(const P3dFileHeader &header)
+{
+    return uint64_t(sizeof(P3dFileHeader)) + uint64_t(header.chunkCount) * sizeof(P3dFileChunk)
+            + vertexBytes(header) + indexBytes(header) + header.propertyBytes;
+}
+
+bool P3dLoader::checkHeader(const P3dFileHeader &header)
+{
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        logger.warning("Not a p3d model file");
+        return false;
+    }
+    if(header.version != VERSION)
+    {
+        logger.warning("Unsupported p3d version %d", header.version);
+        return false;
+    }
+    return true;
+}
+
+bool P3dLoader::validate(const char *data, size_t length, P3dFileHeader *header)
+{
+    if(length < sizeof(P3dFileHeader))
+    {
+        logger.warning("File too short for a header: %d bytes", length);
+        return false;
+    }
+    memcpy(header, data, sizeof(P3dFileHeader));
+    if(!checkHeader(*header))
+    {
+        return false;
+    }
+    uint64_t expected = fileBytes(*header);
+    if(expected != length)
+    {
+        logger.warning("Size mismatch, expected %lld bytes, got %d", (long long) expected, length);
+        return false;
+    }
+    if(ModelLoader::hashData(data + sizeof(P3dFileHeader), length - sizeof(P3dFileHeader)) != header->checksum)
+    {
+        logger.warning("Checksum mismatch");
+        return false;
+    }
+    return true;
+}
+
+bool P3dLoader::load(const char *data, size_t length)
+{
+    logger.debug("Loading %d bytes", length);
+
+    m_modelLoader->clear();
+    clearStream();
+
+    P3dFileHeader header;
+    P3dVector<MeshChunk> chunks;
+    bool valid;
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_MODEL_CACHE);
+        P3dVector<IndexRange> ranges;
+        size_t next = 0;
+        uint32_t done = 0;
+        valid = validate(data, length, &header) && readChunks(header, data, chunks) && indexRanges(chunks, ranges)
+                && checkIndices(header, ranges, data, &next, &done, header.indexCount);
+    }
+    if(!valid || !createModel(header, chunks, data))
+    {
+        return false;
+    }
+    const char* properties = data + length - header.propertyBytes;
+    readProperties(properties, data + length);
+
+    m_modelLoader->setIsLoaded(true);
+    return true;
+}
+
+bool P3dLoader::beginLoad(size_t totalSize)
+{
+    (void) totalSize;
+    m_modelLoader->clear();
+    clearStream();
+    m_file_size = 0;
+    m_created = false;
+    m_ranges.clear();
+    m_range_next = 0;
+    m_range_done = 0;
+    return true;
+}
+
+bool P3dLoader::appendData(const char *data, size_t size)
+{
+    // everything is kept, uploads read from it and finishLoad checks the checksum;
+    // the buffer gets its final size with the header and never moves after that
+    if(m_file_size && m_stream_size + size > m_file_size)
+    {
+        logger.warning("More data than the header announced, %lld bytes", (long long) m_file_size);
+        return false;
+    }
+    appendStream(data, size);
+
+    if(!m_file_size && m_stream_size >= sizeof(P3dFileHeader))
+    {
+        memcpy(&m_header, m_stream, sizeof(m_header));
+        if(!checkHeader(m_header))
+        {
+            return false;
+        }
+        uint64_t fileSize = fileBytes(m_header);
+        if(fileSize > SIZE_MAX || m_stream_size > fileSize)
+        {
+            logger.warning("Size mismatch, expected %lld bytes", (long long) fileSize);
+            return false;
+        }
+        m_file_size = fileSize;
+        reserveStream(m_file_size);
+    }
+
+    // the chunk table is all the model needs, the buffers fill in as the rest arrives
+    if(m_file_size && !m_created
+            && m_stream_size >= sizeof(P3dFileHeader) + size_t(m_header.chunkCount) * sizeof(P3dFileChunk))
+    {
+        P3dVector<MeshChunk> chunks;
+        if(!readChunks(m_header, m_stream, chunks) || !indexRanges(chunks, m_ranges))
+        {
+            return false;
+        }
+        // nothing is uploaded before the indices are checked below
+        m_modelLoader->setStreamEnd(m_stream);
+        if(!createModel(m_header, chunks, m_stream))
+        {
+            m_modelLoader->setStreamEnd(nullptr);
+            return false;
+        }
+        m_created = true;
+        m_modelLoader->setIsLoaded(true);
+    }
+    if(m_created)
+    {
+        // draws follow the uploaded indices, so uploads stop at the first range not checked yet
+        size_t indexStart = sizeof(P3dFileHeader) + size_t(m_header.chunkCount) * sizeof(P3dFileChunk)
+                + vertexBytes(m_header);
+        size_t indexSize = m_header.flags & P3dFileHeader::FLAG_UINT32_INDICES ? 4 : 2;
+        uint32_t arrived = 0;
+        if(m_stream_size > indexStart)
+        {
+            size_t count = (m_stream_size - indexStart) / indexSize;
+            arrived = count < m_header.indexCount ? uint32_t(count) : m_header.indexCount;
+        }
+        if(!checkIndices(m_header, m_ranges, m_stream, &m_range_next, &m_range_done, arrived))
+        {
+            return false;
+        }
+        size_t uploadEnd = m_stream_size;
+        if(m_range_next < m_ranges.size())
+        {
+            size_t checkedEnd = indexStart + (size_t(m_ranges.data()[m_range_next].offset) + m_range_done) * indexSize;
+            if(checkedEnd < uploadEnd) uploadEnd = checkedEnd;
+        }
+        m_modelLoader->setStreamEnd(m_stream + uploadEnd);
+    }
+    return true;
+}
+
+bool P3dLoader::finishLoad()
+{
+    if(!m_created || m_stream_size != m_file_size)
+    {
+        logger.warning("Size mismatch, expected %lld bytes, got %lld", (long long) m_file_size, (long long) m_stream_size);
+        m_modelLoader->clear();
+        return false;
+    }
+    bool valid;
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_MODEL_CACHE);
+        valid = ModelLoader::hashData(m_stream + sizeof(P3dFileHeader), m_stream_size - sizeof(P3dFileHeader)) == m_header.checksum;
+    }
+    if(!valid)
+    {
+        logger.warning("Checksum mismatch");
+        m_modelLoader->clear();
+        return false;
+    }
+    // appendData checked the indices as they arrived
+    m_ranges.clear();
+    readProperties(m_stream + m_stream_size - m_header.propertyBytes, m_stream + m_stream_size);
+    m_modelLoader->finishStream(releaseStream());
+    return true;
+}
+
+bool P3dLoader::readChunks(const P3dFileHeader &header, const char *data, P3dVector<MeshChunk> &chunks)
+{
+    const char* p = data + sizeof(P3dFileHeader);
+    for(uint32_t chunk = 0; chunk < header.chunkCount; ++chunk)
+    {
+        P3dFileChunk fileChunk;
+        memcpy(&fileChunk, p, sizeof(fileChunk));
+        p += sizeof(fileChunk);
+        if(uint64_t(fileChunk.vertOffset) + fileChunk.vertCount > header.vertCount
+                || uint64_t(fileChunk.f3Offset) + fileChunk.indexCount > header.indexCount
+                || fileChunk.f4Offset < fileChunk.f3Offset
+                || fileChunk.f4Offset - fileChunk.f3Offset > fileChunk.indexCount)
+        {
+            logger.warning("Chunk %d out of range", chunk);
+            return false;
+        }
+        MeshChunk meshChunk;
+        meshChunk.vertCount = fileChunk.vertCount;
+        meshChunk.vertOffset = fileChunk.vertOffset;
+        meshChunk.validNormals = true;
+        meshChunk.hasUvs = fileChunk.hasUvs;
+        meshChunk.indexCount = fileChunk.indexCount;
+        meshChunk.f3Offset = fileChunk.f3Offset;
+        meshChunk.f4Offset = fileChunk.f4Offset;
+        meshChunk.material = fileChunk.material;
+        memcpy(meshChunk.boundsMin, fileChunk.boundsMin, sizeof(meshChunk.boundsMin));
+        memcpy(meshChunk.boundsMax, fileChunk.boundsMax, sizeof(meshChunk.boundsMax));
+        memcpy(meshChunk.sphereCenter, fileChunk.sphereCenter, sizeof(meshChunk.sphereCenter));
+        meshChunk.sphereRadius = fileChunk.sphereRadius;
+        for(uint32_t level = 0; level < MeshChunk::MAX_LODS; ++level)
+        {
+            if(uint64_t(fileChunk.lodOffset[level]) + fileChunk.lodCount[level] > header.indexCount)
+            {
+                logger.warning("Chunk %d out of range", chunk);
+                return false;
+            }
+        }
+        memcpy(meshChunk.lodOffset, fileChunk.lodOffset, sizeof(meshChunk.lodOffset));
+        memcpy(meshChunk.lodCount, fileChunk.lodCount, sizeof(meshChunk.lodCount));
+        memcpy(meshChunk.lodError, fileChunk.lodError, sizeof(meshChunk.lodError));
+        chunks.push_back(meshChunk);
+    }
+    return true;
+}
+
+bool P3dLoader::indexRanges(const P3dVector<MeshChunk> &chunks, P3dVector<IndexRange> &ranges)
+{
+    // a bank is as large as its largest chunk, like ModelLoader sizes the vertex buffers
+    const MeshChunk* meshChunks = chunks.data();
+    P3dMap<uint32_t, uint32_t> bankSizes;
+    uint32_t chunk;
+    for(chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        auto* bank = bankSizes.findOrInsert(meshChunks[chunk].vertOffset);
+        if(meshChunks[chunk].vertCount > bank->second)
+        {
+            bank->second = meshChunks[chunk].vertCount;
+        }
+    }
+
+    // the viewer draws every level with indices, not only those before the first empty one
+    for(chunk = 0; chunk < chunks.size(); ++chunk)
+    {
+        const MeshChunk& meshChunk = meshChunks[chunk];
+        IndexRange range;
+        range.chunk = chunk;
+        range.limit = bankSizes.findOrInsert(meshChunk.vertOffset)->second;
+        range.offset = meshChunk.f3Offset;
+        range.count = meshChunk.indexCount;
+        if(range.count) ranges.push_back(range);
+        for(uint32_t level = 0; level < MeshChunk::MAX_LODS; ++level)
+        {
+            range.offset = meshChunk.lodOffset[level];
+            range.count = meshChunk.lodCount[level];
+            if(range.count) ranges.push_back(range);
+        }
+    }
+
+    // file order, streamed loads check the ranges as they arrive
+    std::sort(ranges.data(), ranges.data() + ranges.size(), [](const IndexRange& a, const IndexRange& b)
+    {
+        return a.offset < b.offset;
+    });
+    for(uint32_t i = 1; i < ranges.size(); ++i)
+    {
+        const IndexRange& previous = ranges.data()[i - 1];
+        if(uint64_t(previous.offset) + previous.count > ranges.data()[i].offset)
+        {
+            logger.warning("Chunk %d overlaps the indices of chunk %d", ranges.data()[i].chunk, previous.chunk);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+static bool indicesBelow(const char* indexData, uint32_t offset, uint32_t count, uint32_t limit)
+{
+    // the caller's buffer may not be aligned, memcpy reads the indices anyway
+    const char* p = indexData + size_t(offset) * sizeof(T);
+    for(uint32_t i = 0; i < count; ++i, p += sizeof(T))
+    {
+        T index;
+        memcpy(&index, p, sizeof(index));
+        if(index >= limit)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool P3dLoader::checkIndices(const P3dFileHeader &header, const P3dVector<IndexRange> &ranges, const char *data,
+                             size_t *next, uint32_t *done, uint32_t arrived)
+{
+    const char* indexData = data + sizeof(P3dFileHeader) + size_t(header.chunkCount) * sizeof(P3dFileChunk)
+            + vertexBytes(header);
+    bool uint32Indices = header.flags & P3dFileHeader::FLAG_UINT32_INDICES;
+    for(; *next < ranges.size(); ++*next, *done = 0)
+    {
+        const IndexRange& range = ranges.data()[*next];
+        if(range.offset + *done >= arrived)
+        {
+            break;
+        }
+        uint32_t count = range.count - *done;
+        if(count > arrived - range.offset - *done)
+        {
+            count = arrived - range.offset - *done;
+        }
+        uint32_t offset = range.offset + *done;
+        if(uint32Indices ? !indicesBelow<uint32_t>(indexData, offset, count, range.limit)
+                         : !indicesBelow<uint16_t>(indexData, offset, count, range.limit))
+        {
+            logger.warning("Chunk %d indexes past its vertices", range.chunk);
+            return false;
+        }
+        *done += count;
+        if(*done < range.count)
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+bool P3dLoader::createModel(const P3dFileHeader &header, const P3dVector<MeshChunk> &chunks, const char *data)
+{
+    if((header.flags & P3dFileHeader::FLAG_UINT32_INDICES) && !m_modelLoader->uint32Indices())
+    {
+        logger.warning("Model needs 32 bit indices, not supported by this context");
+        return false;
+    }
+
+    const char* vertexData = data + sizeof(P3dFileHeader) + size_t(header.chunkCount) * sizeof(P3dFileChunk);
+    const char* indexData = vertexData + vertexBytes(header);
+
+    m_modelLoader->setBoundingBox(header.boundingBox[0], header.boundingBox[1], header.boundingBox[2],
+                                  header.boundingBox[3], header.boundingBox[4], header.boundingBox[5]);
+    m_modelLoader->createModel(header, chunks.data(), vertexData, indexData);
+    return true;
+}
+
+void P3dLoader::readProperties(const char *p, const char *end)
+{
+    // records are (int32 material, key\0, value\0)
+    while(p < end)
+    {
+        int32_t materialIndex;
+        if(end - p < int(sizeof(materialIndex)))
+        {
+            break;
+        }
+        memcpy(&materialIndex, p, sizeof(materialIndex));
+        const char* property = p + sizeof(materialIndex);
+        const char* propertyEnd = static_cast<const char*>(memchr(property, 0, end - property));
+        const char* value = propertyEnd ? propertyEnd + 1 : end;
+        const char* valueEnd = value < end ? static_cast<const char*>(memchr(value, 0, end - value)) : 0;
+        if(!valueEnd)
+        {
+            logger.warning("Truncated material property");
+            break;
+        }
+        m_modelLoader->setMaterialProperty(materialIndex, property, value);
+        p = valueEnd + 1;
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef P3DLOADER_H
+#define P3DLOADER_H
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "BaseLoader.h"
+#include "P3dVector.h"
+
+//! \brief .p3d file layout, the reindexed model exactly as ModelLoader uploads it
+//! Header, chunk table, vertex data, index data padded to 4 bytes, then the
+//! material properties as (int32 material, key\0, value\0) records.
+//! Everything is little endian, the checksum is ModelLoader::hashData of all
+//! bytes after the header.
+//! The index ranges of the chunks and their levels don't overlap.
+struct P3dFileHeader
+{
+    enum Flags
+    {
+        FLAG_UINT32_INDICES = 1,
+        //! vertices are MeshVertexQuantized instead of MeshVertex
+        FLAG_QUANTIZED = 2,
+        //! chunks are LoadOptions::clusterTriangles clusters
+        FLAG_CLUSTERED = 4
+    };
+
+    char magic[4];
+    uint32_t version;
+    uint64_t checksum;
+    uint32_t flags;
+    uint32_t vertCount;
+    uint32_t indexCount;
+    uint32_t chunkCount;
+    uint32_t propertyBytes;
+    uint32_t reserved;
+    float boundingBox[6];
+    float posOffset[3];
+    float posScale[3];
+    float uvOffset[2];
+    float uvScale[2];
+};
+
+struct P3dFileChunk
+{
+    uint32_t vertCount;
+    uint32_t vertOffset;
+    uint32_t indexCount;
+    uint32_t f3Offset;
+    //! start of the chunk's quads, f3Offset + indexCount when it has none
+    uint32_t f4Offset;
+    uint16_t material;
+    uint8_t hasUvs;
+    uint8_t reserved;
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphereCenter[3];
+    float sphereRadius;
+    uint32_t lodOffset[MeshChunk::MAX_LODS];
+    uint32_t lodCount[MeshChunk::MAX_LODS];
+    float lodError[MeshChunk::MAX_LODS];
+};
+
+//! \brief loads .p3d files, written by ModelLoader::modelFile
+//! There is nothing to parse, vertex and index data go from the file straight
+//! to the GL buffers. Mapping the file makes loads bound by I/O alone.
+//! Streamed loads create the model as soon as the chunk table arrived and
+//! upload the sections while they arrive, chunks are drawn once their data
+//! is in; the index section has the coarsest levels of detail first.
+class P3dLoader : public BaseLoader
+{
+public:
+    static const char MAGIC[4];
+    static const uint32_t VERSION = 4;
+
+    P3dLoader() {}
+    virtual ~P3dLoader() {}
+
+    bool load(const char *data, size_t length);
+    bool beginLoad(size_t totalSize);
+    bool appendData(const char* data, size_t size);
+    //! \brief checks the checksum and sets the material properties, uploads may still be pending
+    bool finishLoad();
+    bool progressive() const { return true; }
+
+    //! \brief checks magic, version, section sizes and the checksum
+    //! \arg header receives the header when data is valid
+    static bool validate(const char* data, size_t length, P3dFileHeader* header);
+    //! \brief bytes of each section, also used by the writer
+    static size_t vertexBytes(const P3dFileHeader& header);
+    static size_t indexBytes(const P3dFileHeader& header);
+
+private:
+    static uint64_t fileBytes(const P3dFileHeader& header);
+    static bool checkHeader(const P3dFileHeader& header);
+    //! \brief reads the chunk table at data, checks the ranges in it
+    static bool readChunks(const P3dFileHeader& header, const char* data, P3dVector<MeshChunk>& chunks);
+    //! \brief index range of a chunk or one of its levels and the vertex count of its bank
+    struct IndexRange
+    {
+        uint32_t offset;
+        uint32_t count;
+        uint32_t limit;
+        uint32_t chunk;
+    };
+    //! \brief ranges of the chunks and their levels in file order, fails if they overlap
+    static bool indexRanges(const P3dVector<MeshChunk>& chunks, P3dVector<IndexRange>& ranges);
+    //! \brief checks the indices of ranges below arrived against the vertices of their bank
+    //! \arg next, done range and indices in it to continue from, advanced past what was checked
+    static bool checkIndices(const P3dFileHeader& header, const P3dVector<IndexRange>& ranges, const char* data,
+                             size_t* next, uint32_t* done, uint32_t arrived);
+    //! \brief creates the model from the header and chunks, data is the start of the file
+    bool createModel(const P3dFileHeader& header, const P3dVector<MeshChunk>& chunks, const char* data);
+    void readProperties(const char* p, const char* end);
+
+    // streamed load, m_file_size is 0 until the header arrived
+    P3dFileHeader m_header;
+    size_t m_file_size = 0;
+    bool m_created = false;
+    // index ranges in file order, checked up to m_range_done indices into m_range_next
+    P3dVector<IndexRange> m_ranges;
+    size_t m_range_next = 0;
+    uint32_t m_range_done = 0;
+};
+
+#endif // P3DLOADER_H
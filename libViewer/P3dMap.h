@@ -4,6 +4,7 @@
 #define USE_STD_MAP 0
 
 #include <cstring>
+#include <cstdint>
 
 template<typename K>
 struct P3dHash
@@ -65,18 +66,27 @@ public:
         std::unordered_map<K, T, P3dHash<K>, P3dComperator<K> >::insert(std::pair<K, T>(key, val));
     }
 
+    typename std::unordered_map<K, T, P3dHash<K>, P3dComperator<K> >::value_type* findOrInsert(const K& key, bool* inserted = 0)
+    {
+        auto res = std::unordered_map<K, T, P3dHash<K>, P3dComperator<K> >::insert(std::pair<K, T>(key, T()));
+        if(inserted) *inserted = res.second;
+        return &*res.first;
+    }
+
     // not implemented
     void dumpBucketLoad() {}
+    size_t lookupCount() { return 0; }
+    size_t probeCount() { return 0; }
 };
 
 #else // USE_STD_MAP
 
-#include "P3dVector.h"
 #include "PlatformAdapter.h"
 
 template<typename K, typename T>
 struct P3dPair
 {
+    P3dPair() : first(), second() {}
     P3dPair(const K& k, const T& v)
     {
         first = k;
@@ -96,6 +106,8 @@ P3dMakePair(K first, T second)
 
 //! \brief Replacement for std::unordered_map which makes code size too big (emscripten)
 //! Very limited compared to std::unordered_map
+//! Open addressing with linear probing over one contiguous slot array,
+//! capacity is always a power of two. Items can't be removed, only cleared.
 template<typename K, typename T>
 class P3dMap
 {
@@ -110,26 +122,23 @@ public:
         iterator(P3dMap* _map)
         {
             map = _map;
-            bucketIndex = 0;
-            itemIndex = -1;
+            slotIndex = -1;
             operator++();
         }
 
         iterator& operator++()
         {
-            ++itemIndex;
-            while(itemIndex >= map->m_buckets[bucketIndex].size())
+            ++slotIndex;
+            while(slotIndex < map->m_capacity && !map->m_slots[slotIndex].tag)
             {
-                ++bucketIndex;
-                itemIndex = 0;
-                if(bucketIndex >= map->m_bucketCount) return *this;
+                ++slotIndex;
             }
             return *this;
         }
 
         bool operator==(const iterator& other)
         {
-            return map == other.map && bucketIndex == other.bucketIndex && itemIndex == other.itemIndex;
+            return map == other.map && slotIndex == other.slotIndex;
         }
 
         bool operator!=(const iterator& other)
@@ -137,44 +146,40 @@ public:
             return !operator==(other);
         }
 
-        value_type operator*()
+        value_type& operator*()
         {
-            return map->m_buckets[bucketIndex][itemIndex];
+            return map->m_slots[slotIndex].item;
         }
 
     private:
         P3dMap* map;
-        size_t bucketIndex;
-        size_t itemIndex;
+        size_t slotIndex;
 
         friend class P3dMap;
     };
 
     P3dMap()
     {
-        m_size = 0;
-        m_bucketCount = 1024;
-        m_buckets = new Bucket[m_bucketCount];
+        init(1024);
     }
 
-    explicit P3dMap(size_t bucketCount)
+    //! \arg capacity expected number of items, table grows when needed
+    explicit P3dMap(size_t capacity)
     {
-        m_size = 0;
-        m_bucketCount = bucketCount;
-        m_buckets = new Bucket[m_bucketCount];
+        init(capacity);
     }
 
     ~P3dMap()
     {
-        delete [] m_buckets;
+        delete [] m_slots;
     }
 
     void clear()
     {
         m_size = 0;
-        for(size_t i = 0, il = m_bucketCount; i < il; ++i)
+        for(size_t i = 0, il = m_capacity; i < il; ++i)
         {
-            m_buckets[i].clear();
+            m_slots[i] = Slot();
         }
     }
 
@@ -185,48 +190,81 @@ public:
 
     T& operator[] (const K& key)
     {
-        value_type* itm = find(key);
-        if(!itm)
-        {
-            itm = insertPair(value_type(key, T()));
-        }
-        return itm->second;
+        return findOrInsert(key)->second;
     }
 
     size_t size() { return m_size; }
 
     void insert(const K& key, const T& val)
     {
-        insertPair(value_type(key, val));
+        findOrInsert(key)->second = val;
     }
 
     void insert(const value_type& newItem)
     {
-        insertPair(newItem);
+        findOrInsert(newItem.first)->second = newItem.second;
+    }
+
+    //! \brief looks up key and adds it with default value if not found
+    //! \arg inserted optional pointer set to true if key was added
+    //! \return the slot of key, valid until the next insert
+    value_type* findOrInsert(const K& key, bool* inserted = 0)
+    {
+        uint32_t tag = hashTag(key);
+        size_t i = slotFor(tag);
+        ++m_lookups;
+        while(m_slots[i].tag)
+        {
+            ++m_probes;
+            if(m_slots[i].tag == tag && m_Comperator(m_slots[i].item.first, key))
+            {
+                if(inserted) *inserted = false;
+                return &m_slots[i].item;
+            }
+            i = (i + 1) & m_mask;
+        }
+
+        if((m_size + 1) * 10 > m_capacity * 7)
+        {
+            grow();
+            i = slotFor(tag);
+            while(m_slots[i].tag) i = (i + 1) & m_mask;
+        }
+
+        m_slots[i].tag = tag;
+        m_slots[i].item.first = key;
+        m_slots[i].item.second = T();
+        ++m_size;
+        if(inserted) *inserted = true;
+        return &m_slots[i].item;
     }
 
     iterator begin() { return iterator(this); }
     iterator end() {
         iterator itr(this);
-        itr.itemIndex = 0;
-        itr.bucketIndex = m_bucketCount;
+        itr.slotIndex = m_capacity;
         return itr;
     }
 
+    //! \brief lookups since construction, clear() doesn't reset it
+    size_t lookupCount() { return m_lookups; }
+    //! \brief occupied slots compared by all lookups, probeCount() / lookupCount() is the average chain length
+    size_t probeCount() { return m_probes; }
+
     // for debugging
     void dumpBucketLoad() {
-        size_t maxSize = 0;
-        size_t minSize = size();
-        size_t totalSize = 0;
-        for(size_t i = 0; i < m_bucketCount; ++i)
+        size_t maxProbe = 0;
+        size_t totalProbe = 0;
+        for(size_t i = 0; i < m_capacity; ++i)
         {
-            totalSize += m_buckets[i].size();
-            if(maxSize < m_buckets[i].size()) maxSize = m_buckets[i].size();
-            if(minSize > m_buckets[i].size()) minSize = m_buckets[i].size();
+            if(!m_slots[i].tag) continue;
+            size_t probe = (i - slotFor(m_slots[i].tag)) & m_mask;
+            totalProbe += probe;
+            if(maxProbe < probe) maxProbe = probe;
         }
-        size_t avgSize = 0;
-        if(m_bucketCount) avgSize = totalSize / m_bucketCount;
-        logger.verbose("Bucket sizes min/max/avg: %d/%d/%d", minSize, maxSize, avgSize);
+        size_t avgProbe = 0;
+        if(m_size) avgProbe = totalProbe / m_size;
+        logger.verbose("Slots used/capacity: %d/%d, probe max/avg: %d/%d", m_size, m_capacity, maxProbe, avgProbe);
     }
 
 private:
@@ -235,48 +273,90 @@ private:
     // disable assignment
     P3dMap& operator=(const P3dMap&) {;}
 
-    typedef P3dVector<value_type> Bucket;
+    struct Slot
+    {
+        Slot() : tag(0) {}
 
-    value_type* find(const K& key)
+        value_type item;
+        // hash of key with lowest bit set, 0 marks an empty slot
+        uint32_t tag;
+    };
+
+    void init(size_t capacity)
+    {
+        // keep load factor under 0.7
+        size_t minCapacity = capacity + capacity / 2 + 1;
+        m_capacity = 8;
+        m_bits = 3;
+        while(m_capacity < minCapacity)
+        {
+            m_capacity <<= 1;
+            ++m_bits;
+        }
+        m_mask = m_capacity - 1;
+        m_size = 0;
+        m_lookups = 0;
+        m_probes = 0;
+        m_slots = new Slot[m_capacity];
+    }
+
+    uint32_t hashTag(const K& key)
     {
         size_t hash = m_Hash(key);
-        Bucket& buck = m_buckets[hash % m_bucketCount];
-        return findInBucket(buck, key);
+        uint32_t tag = static_cast<uint32_t>(hash) ^ static_cast<uint32_t>((hash >> 16) >> 16);
+        return tag | 1;
     }
 
-    value_type* insertPair(const value_type& pair)
+    size_t slotFor(uint32_t tag) const
     {
-        size_t hash = m_Hash(pair.first);
-        Bucket& buck = m_buckets[hash % m_bucketCount];
-        value_type* itm = findInBucket(buck, pair.first);
-        if(itm)
-        {
-            itm->second = pair.second;
-        }
-        else
+        // fibonacci hashing, spreads sequential keys over the table
+        return (tag * 2654435769u) >> (32 - m_bits);
+    }
+
+    value_type* find(const K& key)
+    {
+        uint32_t tag = hashTag(key);
+        ++m_lookups;
+        for(size_t i = slotFor(tag); m_slots[i].tag; i = (i + 1) & m_mask)
         {
-            buck.push_back(value_type(pair.first, pair.second));
-            itm = &buck[buck.size() - 1];
-            ++m_size;
+            ++m_probes;
+            if(m_slots[i].tag == tag && m_Comperator(m_slots[i].item.first, key))
+            {
+                return &m_slots[i].item;
+            }
         }
-        return itm;
+        return 0;
     }
 
-    value_type* findInBucket(Bucket& buck, const K& key)
+    void grow()
     {
-        for(size_t i = 0, il = buck.size(); i < il; ++i)
+        Slot* oldSlots = m_slots;
+        size_t oldCapacity = m_capacity;
+
+        m_capacity <<= 1;
+        ++m_bits;
+        m_mask = m_capacity - 1;
+        m_slots = new Slot[m_capacity];
+
+        for(size_t j = 0; j < oldCapacity; ++j)
         {
-            value_type& itm = buck[i];
-            if(m_Comperator(itm.first, key)) return &itm;
+            if(!oldSlots[j].tag) continue;
+            size_t i = slotFor(oldSlots[j].tag);
+            while(m_slots[i].tag) i = (i + 1) & m_mask;
+            m_slots[i] = oldSlots[j];
         }
-        return 0;
+        delete [] oldSlots;
     }
 
     P3dHash<K> m_Hash;
     P3dComperator<K> m_Comperator;
-    Bucket* m_buckets;
+    Slot* m_slots;
     size_t m_size;
-    size_t m_bucketCount;
+    size_t m_capacity;
+    size_t m_mask;
+    uint32_t m_bits;
+    size_t m_lookups;
+    size_t m_probes;
 
 };
 
@@ -0,0 +1,180 @@
+#include "P3dParallel.h"
+
+#if P3D_USE_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+//! \brief threads started on the first parallel forEach and reused by the following ones
+//! One job runs at a time, forEach falls back to its own threads while the pool is busy.
+class WorkerPool
+{
+public:
+    static WorkerPool& instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for(size_t t = 0; t < m_threadCount; ++t)
+        {
+            m_threads[t].join();
+        }
+        delete [] m_threads;
+    }
+
+    //! \brief runs func over [0, count) on the calling thread and helpers pool threads
+    //! Returns false without running anything when another job holds the pool.
+    bool run(size_t count, const std::function<void(size_t)>& func, size_t helpers)
+    {
+        std::unique_lock<std::mutex> job(m_jobMutex, std::try_to_lock);
+        if(!job.owns_lock()) return false;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(!m_threads)
+        {
+            m_threadCount = P3dParallel::workerCount() - 1;
+            m_threads = new std::thread[m_threadCount];
+            for(size_t t = 0; t < m_threadCount; ++t)
+            {
+                m_threads[t] = std::thread(&WorkerPool::workerLoop, this);
+            }
+        }
+        if(helpers > m_threadCount) helpers = m_threadCount;
+
+        m_func = &func;
+        m_count = count;
+        m_next = 0;
+        m_helpers = helpers;
+        m_joined = 0;
+        m_pending = helpers;
+        ++m_generation;
+        lock.unlock();
+        m_wake.notify_all();
+
+        // the calling thread works too
+        work();
+
+        lock.lock();
+        m_done.wait(lock, [this]() { return m_pending == 0; });
+        m_func = 0;
+        return true;
+    }
+
+private:
+    WorkerPool() :
+        m_threads(0), m_threadCount(0), m_func(0), m_count(0), m_next(0),
+        m_helpers(0), m_joined(0), m_pending(0), m_generation(0), m_quit(false)
+    {
+    }
+
+    void work()
+    {
+        for(size_t i = m_next++; i < m_count; i = m_next++)
+        {
+            (*m_func)(i);
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;)
+        {
+            // only the requested number of helpers join a job, the others sleep through it
+            m_wake.wait(lock, [&]() { return m_quit || (m_generation != seen && m_joined < m_helpers); });
+            if(m_quit) return;
+            seen = m_generation;
+            ++m_joined;
+
+            lock.unlock();
+            work();
+            lock.lock();
+
+            if(--m_pending == 0) m_done.notify_one();
+        }
+    }
+
+    std::mutex m_jobMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    std::thread* m_threads;
+    size_t m_threadCount;
+
+    // current job, written under m_mutex before the helpers are woken
+    const std::function<void(size_t)>* m_func;
+    size_t m_count;
+    std::atomic<size_t> m_next;
+    size_t m_helpers;
+    size_t m_joined;
+    size_t m_pending;
+    unsigned m_generation;
+    bool m_quit;
+};
+}
+#endif
+
+unsigned P3dParallel::workerCount()
+{
+#if P3D_USE_THREADS
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+#else
+    return 1;
+#endif
+}
+
+void P3dParallel::forEach(size_t count, const std::function<void(size_t)>& func)
+{
+    size_t workers = workerCount();
+    if(workers > count) workers = count;
+
+#if P3D_USE_THREADS
+    if(workers > 1)
+    {
+        if(WorkerPool::instance().run(count, func, workers - 1)) return;
+
+        // the pool is running another job (concurrent loads or a nested forEach)
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for(size_t i = next++; i < count; i = next++)
+            {
+                func(i);
+            }
+        };
+
+        // the calling thread works too
+        std::thread* threads = new std::thread[workers - 1];
+        for(size_t t = 0; t < workers - 1; ++t)
+        {
+            threads[t] = std::thread(worker);
+        }
+        worker();
+        for(size_t t = 0; t < workers - 1; ++t)
+        {
+            threads[t].join();
+        }
+        delete [] threads;
+        return;
+    }
+#endif
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        func(i);
+    }
+}
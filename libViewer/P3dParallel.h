@@ -0,0 +1,30 @@
+#ifndef P3DPARALLEL_H
+#define P3DPARALLEL_H
+
+#include <cstdlib>
+#include <functional>
+
+// emscripten builds are single threaded
+#ifndef P3D_USE_THREADS
+#ifdef __EMSCRIPTEN__
+#define P3D_USE_THREADS 0
+#else
+#define P3D_USE_THREADS 1
+#endif
+#endif
+
+//! \brief minimal worker pool for splitting load work over cores
+class P3dParallel
+{
+public:
+    //! \brief number of threads forEach uses, 1 when threads are disabled
+    static unsigned workerCount();
+
+    //! \brief calls func for every index in [0, count) and returns when all are done
+    //! Indices are handed out in order to the workers, func must be thread safe.
+    //! Runs on the calling thread when threads are disabled or count is 1.
+    //! The worker threads are started by the first call and reused by the following ones.
+    static void forEach(size_t count, const std::function<void(size_t)>& func);
+};
+
+#endif // P3DPARALLEL_H
@@ -0,0 +1,130 @@
+#include "P3dProfiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdarg>
+
+static std::atomic<uint64_t> stageNanos[P3dProfiler::STAGE_COUNT];
+static std::atomic<uint32_t> stageCalls[P3dProfiler::STAGE_COUNT];
+static std::atomic<uint64_t> counters[P3dProfiler::COUNTER_COUNT];
+
+static const char* stageNames[P3dProfiler::STAGE_COUNT] = {
+    "parse",
+    "reindexPosUvNorm",
+    "reindexPosUv",
+    "reindexPosNorm",
+    "reindexPos",
+    "copyVertData",
+    "normalsWeld",
+    "normalsCalc",
+    "normalsNormalize",
+    "normalsStore",
+    "normalsCrease",
+    "normalsCache",
+    "modelCache",
+    "cluster",
+    "optimize",
+    "simplify",
+    "quantize",
+    "bounds",
+    "upload"
+};
+
+static const char* counterNames[P3dProfiler::COUNTER_COUNT] = {
+    "mapLookups",
+    "mapProbes",
+    "uploadBytes",
+    "chunks",
+    "vertices",
+    "indices"
+};
+
+// like snprintf at buffer + length, keeps counting past the end so callers learn the needed size
+static void appendFormat(char* buffer, size_t size, size_t& length, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(length < size ? buffer + length : 0, length < size ? size - length : 0, format, args);
+    va_end(args);
+    if(written > 0)
+    {
+        length += written;
+    }
+}
+
+uint64_t P3dProfiler::nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void P3dProfiler::addTime(Stage stage, uint64_t nanos)
+{
+    stageNanos[stage] += nanos;
+    ++stageCalls[stage];
+}
+
+void P3dProfiler::add(Counter counter, uint64_t value)
+{
+    counters[counter] += value;
+}
+
+void P3dProfiler::reset()
+{
+    for(int i = 0; i < STAGE_COUNT; ++i)
+    {
+        stageNanos[i] = 0;
+        stageCalls[i] = 0;
+    }
+    for(int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        counters[i] = 0;
+    }
+}
+
+P3dProfiler::Stats P3dProfiler::stats()
+{
+    Stats result;
+    for(int i = 0; i < STAGE_COUNT; ++i)
+    {
+        result.stageNanos[i] = stageNanos[i];
+        result.stageCalls[i] = stageCalls[i];
+    }
+    for(int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        result.counters[i] = counters[i];
+    }
+    return result;
+}
+
+const char* P3dProfiler::stageName(Stage stage)
+{
+    return stageNames[stage];
+}
+
+const char* P3dProfiler::counterName(Counter counter)
+{
+    return counterNames[counter];
+}
+
+size_t P3dProfiler::toJson(const Stats& stats, char* buffer, size_t size)
+{
+    size_t length = 0;
+    int i;
+
+    appendFormat(buffer, size, length, "{\"stages\":{");
+    for(i = 0; i < STAGE_COUNT; ++i)
+    {
+        appendFormat(buffer, size, length, "%s\"%s\":{\"us\":%.3f,\"calls\":%u}", i ? "," : "",
+                     stageNames[i], stats.stageNanos[i] / 1000.0, stats.stageCalls[i]);
+    }
+    appendFormat(buffer, size, length, "},\"counters\":{");
+    for(i = 0; i < COUNTER_COUNT; ++i)
+    {
+        appendFormat(buffer, size, length, "%s\"%s\":%llu", i ? "," : "",
+                     counterNames[i], static_cast<unsigned long long>(stats.counters[i]));
+    }
+    appendFormat(buffer, size, length, "}}");
+    return length;
+}
@@ -0,0 +1,88 @@
+#ifndef P3DPROFILER_H
+#define P3DPROFILER_H
+
+#include <cstdlib>
+#include <cstdint>
+
+//! \brief timings and counters of the load pipeline
+//! One set is shared by all loaders, P3dViewer resets it when a load starts.
+//! Scopes and counters can be used from worker threads, stage times then
+//! add up over the threads.
+class P3dProfiler
+{
+public:
+    enum Stage
+    {
+        STAGE_PARSE = 0,
+        STAGE_REINDEX_POS_UV_NORM,
+        STAGE_REINDEX_POS_UV,
+        STAGE_REINDEX_POS_NORM,
+        STAGE_REINDEX_POS,
+        STAGE_COPY_VERT_DATA,
+        STAGE_NORMALS_WELD,
+        STAGE_NORMALS_CALC,
+        STAGE_NORMALS_NORMALIZE,
+        STAGE_NORMALS_STORE,
+        STAGE_NORMALS_CREASE,
+        STAGE_NORMALS_CACHE,
+        STAGE_MODEL_CACHE,
+        STAGE_CLUSTER,
+        STAGE_OPTIMIZE,
+        STAGE_SIMPLIFY,
+        STAGE_QUANTIZE,
+        STAGE_BOUNDS,
+        STAGE_UPLOAD,
+        STAGE_COUNT
+    };
+
+    enum Counter
+    {
+        COUNTER_MAP_LOOKUPS = 0,
+        COUNTER_MAP_PROBES,
+        COUNTER_UPLOAD_BYTES,
+        COUNTER_CHUNKS,
+        COUNTER_VERTICES,
+        COUNTER_INDICES,
+        COUNTER_COUNT
+    };
+
+    //! \brief snapshot of the current values
+    struct Stats
+    {
+        uint64_t stageNanos[STAGE_COUNT];
+        uint32_t stageCalls[STAGE_COUNT];
+        uint64_t counters[COUNTER_COUNT];
+    };
+
+    //! \brief adds the time from construction to destruction to a stage
+    class Scope
+    {
+    public:
+        explicit Scope(Stage stage) : m_stage(stage), m_start(nowNanos()) {}
+        ~Scope() { addTime(m_stage, nowNanos() - m_start); }
+
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+        Stage m_stage;
+        uint64_t m_start;
+    };
+
+    //! \brief monotonic clock in nanoseconds, only differences are meaningful
+    static uint64_t nowNanos();
+
+    static void addTime(Stage stage, uint64_t nanos);
+    static void add(Counter counter, uint64_t value);
+    static void reset();
+    static Stats stats();
+
+    static const char* stageName(Stage stage);
+    static const char* counterName(Counter counter);
+
+    //! \brief writes stats as a JSON object, times in microseconds
+    //! \return length of the whole JSON like snprintf, buffer is cut if too small
+    static size_t toJson(const Stats& stats, char* buffer, size_t size);
+};
+
+#endif // P3DPROFILER_H
@@ -0,0 +1,129 @@
+#ifndef P3DSIMD_H
+#define P3DSIMD_H
+
+// 4 wide float vectors for the load pipeline, SSE2 on x86, NEON on ARM,
+// simd128 on wasm (emcc -msimd128) and plain floats everywhere else.
+// Only what the loaders need, the w lane is carried along and kept at 0 by load3.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define P3D_SIMD_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define P3D_SIMD_NEON 1
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#define P3D_SIMD_WASM 1
+#include <wasm_simd128.h>
+#endif
+
+namespace P3dSimd
+{
+
+#if P3D_SIMD_SSE
+
+typedef __m128 Vec4;
+
+inline Vec4 load3(const float* p) { return _mm_setr_ps(p[0], p[1], p[2], 0.0f); }
+inline Vec4 load4(const float* p) { return _mm_loadu_ps(p); }
+inline void store4(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+inline Vec4 add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+inline Vec4 sub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+inline Vec4 mul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+inline Vec4 mul(Vec4 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+
+inline Vec4 cross(Vec4 a, Vec4 b)
+{
+    Vec4 ayzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    Vec4 byzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    Vec4 zxy = _mm_sub_ps(_mm_mul_ps(a, byzx), _mm_mul_ps(ayzx, b));
+    return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+#elif P3D_SIMD_NEON
+
+typedef float32x4_t Vec4;
+
+inline Vec4 load3(const float* p)
+{
+    return vcombine_f32(vld1_f32(p), vset_lane_f32(p[2], vdup_n_f32(0.0f), 0));
+}
+inline Vec4 load4(const float* p) { return vld1q_f32(p); }
+inline void store4(float* p, Vec4 v) { vst1q_f32(p, v); }
+inline Vec4 add(Vec4 a, Vec4 b) { return vaddq_f32(a, b); }
+inline Vec4 sub(Vec4 a, Vec4 b) { return vsubq_f32(a, b); }
+inline Vec4 mul(Vec4 a, Vec4 b) { return vmulq_f32(a, b); }
+inline Vec4 mul(Vec4 a, float s) { return vmulq_n_f32(a, s); }
+
+//! \brief (y, z, x, w), NEON has no 4 lane shuffle on ARMv7
+inline Vec4 yzxw(Vec4 v)
+{
+    float32x2_t xy = vget_low_f32(v);
+    float32x2_t zw = vget_high_f32(v);
+    // trn of (x, y) and (w, z) gives (x, w) and (y, z)
+    float32x2x2_t t = vtrn_f32(xy, vrev64_f32(zw));
+    return vcombine_f32(t.val[1], t.val[0]);
+}
+
+inline Vec4 cross(Vec4 a, Vec4 b)
+{
+    Vec4 zxy = vsubq_f32(vmulq_f32(a, yzxw(b)), vmulq_f32(yzxw(a), b));
+    return yzxw(zxy);
+}
+
+#elif P3D_SIMD_WASM
+
+typedef v128_t Vec4;
+
+inline Vec4 load3(const float* p) { return wasm_f32x4_make(p[0], p[1], p[2], 0.0f); }
+inline Vec4 load4(const float* p) { return wasm_v128_load(p); }
+inline void store4(float* p, Vec4 v) { wasm_v128_store(p, v); }
+inline Vec4 add(Vec4 a, Vec4 b) { return wasm_f32x4_add(a, b); }
+inline Vec4 sub(Vec4 a, Vec4 b) { return wasm_f32x4_sub(a, b); }
+inline Vec4 mul(Vec4 a, Vec4 b) { return wasm_f32x4_mul(a, b); }
+inline Vec4 mul(Vec4 a, float s) { return wasm_f32x4_mul(a, wasm_f32x4_splat(s)); }
+
+inline Vec4 cross(Vec4 a, Vec4 b)
+{
+    Vec4 ayzx = wasm_i32x4_shuffle(a, a, 1, 2, 0, 3);
+    Vec4 byzx = wasm_i32x4_shuffle(b, b, 1, 2, 0, 3);
+    Vec4 zxy = wasm_f32x4_sub(wasm_f32x4_mul(a, byzx), wasm_f32x4_mul(ayzx, b));
+    return wasm_i32x4_shuffle(zxy, zxy, 1, 2, 0, 3);
+}
+
+#else
+
+struct Vec4
+{
+    float v[4];
+};
+
+inline Vec4 make(float x, float y, float z, float w) { Vec4 r = {{x, y, z, w}}; return r; }
+inline Vec4 load3(const float* p) { return make(p[0], p[1], p[2], 0.0f); }
+inline Vec4 load4(const float* p) { return make(p[0], p[1], p[2], p[3]); }
+inline void store4(float* p, Vec4 v) { p[0] = v.v[0]; p[1] = v.v[1]; p[2] = v.v[2]; p[3] = v.v[3]; }
+inline Vec4 add(Vec4 a, Vec4 b) { return make(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]); }
+inline Vec4 sub(Vec4 a, Vec4 b) { return make(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]); }
+inline Vec4 mul(Vec4 a, Vec4 b) { return make(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]); }
+inline Vec4 mul(Vec4 a, float s) { return make(a.v[0] * s, a.v[1] * s, a.v[2] * s, a.v[3] * s); }
+
+inline Vec4 cross(Vec4 a, Vec4 b)
+{
+    return make(a.v[1] * b.v[2] - a.v[2] * b.v[1],
+                a.v[2] * b.v[0] - a.v[0] * b.v[2],
+                a.v[0] * b.v[1] - a.v[1] * b.v[0],
+                0.0f);
+}
+
+#endif
+
+//! \brief x * x + y * y + z * z of a, summed in that order like glm::dot
+inline float dot3(Vec4 a, Vec4 b)
+{
+    float m[4];
+    store4(m, mul(a, b));
+    return m[0] + m[1] + m[2];
+}
+
+} // namespace P3dSimd
+
+#endif // P3DSIMD_H
@@ -0,0 +1,692 @@
+// GL backend for headless builds, enabled by defining P3D_STUB_GL.
+// The gl* functions hand out object names and keep the little state needed
+// to count draw calls, state changes, uploads and memory, see P3dStubGL.h.
+
+#ifdef P3D_STUB_GL
+
+#include "P3dStubGL.h"
+#include "P3dMap.h"
+#include "glwrapper.h"
+
+#include <cstring>
+
+// GLES formats the core profile header doesn't have
+#ifndef GL_ALPHA
+#define GL_ALPHA 0x1906
+#endif
+#ifndef GL_LUMINANCE
+#define GL_LUMINANCE 0x1909
+#endif
+#ifndef GL_LUMINANCE_ALPHA
+#define GL_LUMINANCE_ALPHA 0x190A
+#endif
+
+static const int MAX_ATTRIBS = 16;
+static const int MAX_TEXTURE_UNITS = 16;
+static const int MAX_TEXTURE_LEVELS = 16;
+//! floats compared to find redundant uniforms, larger uniforms always count as changed
+static const int MAX_UNIFORM_FLOATS = 16;
+
+struct BufferInfo
+{
+    bool live;
+    uint64_t size;
+};
+
+struct TextureInfo
+{
+    bool live;
+    uint64_t levels[MAX_TEXTURE_LEVELS];
+};
+
+struct AttribPointer
+{
+    GLuint buffer;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    const GLvoid* pointer;
+};
+
+//! \brief what a vertex array object keeps, the current one is in the globals below
+struct VertexArrayState
+{
+    bool attribEnabled[MAX_ATTRIBS];
+    AttribPointer attribPointers[MAX_ATTRIBS];
+    GLuint elementArrayBuffer;
+};
+
+struct UniformValue
+{
+    GLsizei floats;
+    GLfloat values[MAX_UNIFORM_FLOATS];
+};
+
+static const char* version = "OpenGL ES 2.0";
+static const char* extensions = "";
+static GLuint nextName = 1;
+
+static P3dStubGL::FrameStats frame;
+static P3dStubGL::MemoryStats memory;
+static bool recording = false;
+static P3dVector<P3dStubGL::Command> commandLog;
+
+static P3dMap<uint32_t, BufferInfo> buffers;
+static P3dMap<uint32_t, TextureInfo> textures;
+//! key is program << 16 | location
+static P3dMap<uint32_t, UniformValue> uniforms;
+//! uniform name to location, names are copies in uniformNameStore
+static P3dMap<const char*, GLint> uniformLocations;
+static P3dVector<char*> uniformNameStore;
+
+static GLuint arrayBuffer = 0;
+static GLuint elementArrayBuffer = 0;
+static GLuint currentProgram = 0;
+static GLenum activeTexture = GL_TEXTURE0;
+static GLuint boundTextures[MAX_TEXTURE_UNITS];
+static P3dMap<uint32_t, bool> capabilities(16);
+static GLenum depthFunc = GL_LESS;
+static GLboolean depthMask = GL_TRUE;
+static GLenum frontFace = GL_CCW;
+static bool attribEnabled[MAX_ATTRIBS];
+static AttribPointer attribPointers[MAX_ATTRIBS];
+//! state of the vertex arrays not bound, 0 is the default one
+static P3dMap<uint32_t, VertexArrayState> vertexArrays;
+static GLuint boundVertexArray = 0;
+
+static void record(const char* function, uint64_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0, uint64_t arg3 = 0)
+{
+    ++frame.calls;
+    if(recording)
+    {
+        P3dStubGL::Command command = {function, {arg0, arg1, arg2, arg3}};
+        commandLog.push_back(command);
+    }
+}
+
+//! \brief counts a state change, changed is false if it set what was already set
+static void stateChange(bool changed)
+{
+    ++frame.stateChanges;
+    if(!changed)
+    {
+        ++frame.redundantStateChanges;
+    }
+}
+
+template<typename T>
+static void setState(T& state, T value)
+{
+    stateChange(state != value);
+    state = value;
+}
+
+static void setUniform(GLint location, GLsizei floats, const GLfloat* values)
+{
+    ++frame.uniformCalls;
+    if(location < 0 || !currentProgram)
+    {
+        return;
+    }
+    UniformValue& uniform = uniforms[currentProgram << 16 | static_cast<uint32_t>(location)];
+    bool same = floats <= MAX_UNIFORM_FLOATS && uniform.floats == floats &&
+            memcmp(uniform.values, values, floats * sizeof(GLfloat)) == 0;
+    if(same)
+    {
+        ++frame.redundantUniformCalls;
+    }
+    else if(floats <= MAX_UNIFORM_FLOATS)
+    {
+        uniform.floats = floats;
+        memcpy(uniform.values, values, floats * sizeof(GLfloat));
+    }
+    else
+    {
+        uniform.floats = 0;
+    }
+}
+
+static uint64_t texelSize(GLenum format, GLenum type)
+{
+    switch(type)
+    {
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+        return 2;
+    default:
+        break;
+    }
+    uint64_t components;
+    switch(format)
+    {
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+    case GL_RED:
+        components = 1;
+        break;
+    case GL_LUMINANCE_ALPHA:
+    case GL_RG:
+        components = 2;
+        break;
+    case GL_RGB:
+        components = 3;
+        break;
+    default:
+        components = 4;
+        break;
+    }
+    return components * (type == GL_FLOAT ? 4 : type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT ? 2 : 1);
+}
+
+void P3dStubGL::setVersion(const char* newVersion)
+{
+    version = newVersion;
+}
+
+void P3dStubGL::setExtensions(const char* newExtensions)
+{
+    extensions = newExtensions;
+}
+
+void P3dStubGL::beginFrame()
+{
+    memset(&frame, 0, sizeof(frame));
+}
+
+P3dStubGL::FrameStats P3dStubGL::frameStats()
+{
+    return frame;
+}
+
+P3dStubGL::MemoryStats P3dStubGL::memoryStats()
+{
+    return memory;
+}
+
+void P3dStubGL::setRecording(bool newValue)
+{
+    recording = newValue;
+}
+
+const P3dVector<P3dStubGL::Command>& P3dStubGL::commands()
+{
+    return commandLog;
+}
+
+void P3dStubGL::clearCommands()
+{
+    commandLog.clear();
+}
+
+void P3dStubGL::writeCommands(FILE* out)
+{
+    for(size_t i = 0; i < commandLog.size(); ++i)
+    {
+        const Command& command = commandLog[i];
+        fprintf(out, "%s(%llu, %llu, %llu, %llu)\n", command.function,
+                static_cast<unsigned long long>(command.args[0]), static_cast<unsigned long long>(command.args[1]),
+                static_cast<unsigned long long>(command.args[2]), static_cast<unsigned long long>(command.args[3]));
+    }
+}
+
+void P3dStubGL::reset()
+{
+    nextName = 1;
+    memset(&frame, 0, sizeof(frame));
+    memset(&memory, 0, sizeof(memory));
+    commandLog.clear();
+    buffers.clear();
+    textures.clear();
+    uniforms.clear();
+    uniformLocations.clear();
+    for(size_t i = 0; i < uniformNameStore.size(); ++i)
+    {
+        delete [] uniformNameStore[i];
+    }
+    uniformNameStore.clear();
+
+    arrayBuffer = 0;
+    elementArrayBuffer = 0;
+    currentProgram = 0;
+    activeTexture = GL_TEXTURE0;
+    memset(boundTextures, 0, sizeof(boundTextures));
+    capabilities.clear();
+    depthFunc = GL_LESS;
+    depthMask = GL_TRUE;
+    frontFace = GL_CCW;
+    memset(attribEnabled, 0, sizeof(attribEnabled));
+    memset(attribPointers, 0, sizeof(attribPointers));
+    vertexArrays.clear();
+    boundVertexArray = 0;
+}
+
+extern "C" {
+
+// shaders and programs, only names are handed out
+
+void APIENTRY glAttachShader(GLuint program, GLuint shader) { record("glAttachShader", program, shader); }
+void APIENTRY glBindAttribLocation(GLuint program, GLuint index, const GLchar*) { record("glBindAttribLocation", program, index); }
+void APIENTRY glCompileShader(GLuint shader) { record("glCompileShader", shader); }
+void APIENTRY glDeleteProgram(GLuint program) { record("glDeleteProgram", program); }
+void APIENTRY glDeleteShader(GLuint shader) { record("glDeleteShader", shader); }
+void APIENTRY glLinkProgram(GLuint program) { record("glLinkProgram", program); }
+void APIENTRY glShaderSource(GLuint shader, GLsizei count, const GLchar* const*, const GLint*) { record("glShaderSource", shader, count); }
+
+GLuint APIENTRY glCreateProgram()
+{
+    record("glCreateProgram", nextName);
+    return nextName++;
+}
+
+GLuint APIENTRY glCreateShader(GLenum type)
+{
+    record("glCreateShader", type, nextName);
+    return nextName++;
+}
+
+void APIENTRY glGetProgramInfoLog(GLuint program, GLsizei, GLsizei* length, GLchar*)
+{
+    record("glGetProgramInfoLog", program);
+    if(length) *length = 0;
+}
+
+void APIENTRY glGetShaderInfoLog(GLuint shader, GLsizei, GLsizei* length, GLchar*)
+{
+    record("glGetShaderInfoLog", shader);
+    if(length) *length = 0;
+}
+
+void APIENTRY glGetProgramiv(GLuint program, GLenum pname, GLint* params)
+{
+    record("glGetProgramiv", program, pname);
+    // everything compiles and links, logs are empty
+    *params = pname == GL_INFO_LOG_LENGTH ? 0 : GL_TRUE;
+}
+
+void APIENTRY glGetShaderiv(GLuint shader, GLenum pname, GLint* params)
+{
+    record("glGetShaderiv", shader, pname);
+    *params = pname == GL_INFO_LOG_LENGTH ? 0 : GL_TRUE;
+}
+
+GLint APIENTRY glGetUniformLocation(GLuint program, const GLchar* name)
+{
+    // the same name gets the same location in every program
+    bool inserted;
+    P3dPair<const char*, GLint>* item = uniformLocations.findOrInsert(name, &inserted);
+    if(inserted)
+    {
+        char* copy = new char[strlen(name) + 1];
+        strcpy(copy, name);
+        uniformNameStore.push_back(copy);
+        item->first = copy;
+        item->second = static_cast<GLint>(uniformLocations.size() - 1);
+    }
+    record("glGetUniformLocation", program, item->second);
+    return item->second;
+}
+
+void APIENTRY glUseProgram(GLuint program)
+{
+    record("glUseProgram", program);
+    setState(currentProgram, program);
+}
+
+// queries
+
+GLenum APIENTRY glGetError()
+{
+    record("glGetError");
+    return GL_NO_ERROR;
+}
+
+void APIENTRY glGetIntegerv(GLenum pname, GLint* data)
+{
+    record("glGetIntegerv", pname);
+    *data = pname == GL_DEPTH_BITS ? 24 : 0;
+}
+
+const GLubyte* APIENTRY glGetString(GLenum name)
+{
+    record("glGetString", name);
+    return reinterpret_cast<const GLubyte*>(name == GL_VERSION ? version :
+                                             name == GL_EXTENSIONS ? extensions : "");
+}
+
+// buffers
+
+void APIENTRY glGenBuffers(GLsizei n, GLuint* names)
+{
+    for(GLsizei i = 0; i < n; ++i)
+    {
+        names[i] = nextName++;
+        BufferInfo& buffer = buffers[names[i]];
+        buffer.live = true;
+        buffer.size = 0;
+        ++memory.buffers;
+    }
+    record("glGenBuffers", n, n ? names[0] : 0);
+}
+
+void APIENTRY glDeleteBuffers(GLsizei n, const GLuint* names)
+{
+    record("glDeleteBuffers", n, n ? names[0] : 0);
+    for(GLsizei i = 0; i < n; ++i)
+    {
+        P3dPair<uint32_t, BufferInfo>* item = buffers.findOrInsert(names[i]);
+        if(item->second.live)
+        {
+            memory.bufferBytes -= item->second.size;
+            --memory.buffers;
+            item->second.live = false;
+            item->second.size = 0;
+        }
+        // deleting a bound buffer unbinds it
+        if(arrayBuffer == names[i]) arrayBuffer = 0;
+        if(elementArrayBuffer == names[i]) elementArrayBuffer = 0;
+    }
+}
+
+void APIENTRY glBindBuffer(GLenum target, GLuint buffer)
+{
+    record("glBindBuffer", target, buffer);
+    setState(target == GL_ELEMENT_ARRAY_BUFFER ? elementArrayBuffer : arrayBuffer, buffer);
+}
+
+void APIENTRY glBufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+    record("glBufferData", target, size, data != 0, usage);
+    GLuint name = target == GL_ELEMENT_ARRAY_BUFFER ? elementArrayBuffer : arrayBuffer;
+    if(!name)
+    {
+        return;
+    }
+    BufferInfo& buffer = buffers[name];
+    memory.bufferBytes += size - buffer.size;
+    buffer.size = size;
+    if(data)
+    {
+        frame.uploadBytes += size;
+    }
+}
+
+void APIENTRY glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid*)
+{
+    record("glBufferSubData", target, offset, size);
+    frame.uploadBytes += size;
+}
+
+// textures
+
+void APIENTRY glGenTextures(GLsizei n, GLuint* names)
+{
+    for(GLsizei i = 0; i < n; ++i)
+    {
+        names[i] = nextName++;
+        TextureInfo& texture = textures[names[i]];
+        memset(&texture, 0, sizeof(texture));
+        texture.live = true;
+        ++memory.textures;
+    }
+    record("glGenTextures", n, n ? names[0] : 0);
+}
+
+void APIENTRY glDeleteTextures(GLsizei n, const GLuint* names)
+{
+    record("glDeleteTextures", n, n ? names[0] : 0);
+    for(GLsizei i = 0; i < n; ++i)
+    {
+        P3dPair<uint32_t, TextureInfo>* item = textures.findOrInsert(names[i]);
+        if(item->second.live)
+        {
+            for(int level = 0; level < MAX_TEXTURE_LEVELS; ++level)
+            {
+                memory.textureBytes -= item->second.levels[level];
+            }
+            --memory.textures;
+            memset(&item->second, 0, sizeof(item->second));
+        }
+        for(int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+        {
+            if(boundTextures[unit] == names[i]) boundTextures[unit] = 0;
+        }
+    }
+}
+
+void APIENTRY glActiveTexture(GLenum texture)
+{
+    record("glActiveTexture", texture);
+    setState(activeTexture, texture);
+}
+
+void APIENTRY glBindTexture(GLenum target, GLuint texture)
+{
+    record("glBindTexture", target, texture);
+    GLuint unit = activeTexture - GL_TEXTURE0;
+    if(unit < MAX_TEXTURE_UNITS)
+    {
+        setState(boundTextures[unit], texture);
+    }
+}
+
+void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                           GLint, GLenum format, GLenum type, const GLvoid* pixels)
+{
+    record("glTexImage2D", target, level, width, height);
+    uint64_t size = static_cast<uint64_t>(width) * height * texelSize(format ? format : internalformat, type);
+    GLuint unit = activeTexture - GL_TEXTURE0;
+    GLuint name = unit < MAX_TEXTURE_UNITS ? boundTextures[unit] : 0;
+    if(name && level >= 0 && level < MAX_TEXTURE_LEVELS)
+    {
+        TextureInfo& texture = textures[name];
+        memory.textureBytes += size - texture.levels[level];
+        texture.levels[level] = size;
+    }
+    if(pixels)
+    {
+        frame.uploadBytes += size;
+    }
+}
+
+void APIENTRY glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    record("glTexParameteri", target, pname, param);
+    ++frame.stateChanges;
+}
+
+// fixed function state
+
+void APIENTRY glClear(GLbitfield mask) { record("glClear", mask); }
+void APIENTRY glClearColor(GLfloat, GLfloat, GLfloat, GLfloat) { record("glClearColor"); }
+void APIENTRY glViewport(GLint x, GLint y, GLsizei width, GLsizei height) { record("glViewport", x, y, width, height); }
+
+void APIENTRY glEnable(GLenum cap)
+{
+    record("glEnable", cap);
+    setState(capabilities[cap], true);
+}
+
+void APIENTRY glDisable(GLenum cap)
+{
+    record("glDisable", cap);
+    setState(capabilities[cap], false);
+}
+
+void APIENTRY glDepthFunc(GLenum func)
+{
+    record("glDepthFunc", func);
+    setState(depthFunc, func);
+}
+
+void APIENTRY glDepthMask(GLboolean flag)
+{
+    record("glDepthMask", flag);
+    setState(depthMask, flag);
+}
+
+void APIENTRY glFrontFace(GLenum mode)
+{
+    record("glFrontFace", mode);
+    setState(frontFace, mode);
+}
+
+// vertex attributes
+
+void APIENTRY glEnableVertexAttribArray(GLuint index)
+{
+    record("glEnableVertexAttribArray", index);
+    if(index < MAX_ATTRIBS)
+    {
+        setState(attribEnabled[index], true);
+    }
+}
+
+void APIENTRY glDisableVertexAttribArray(GLuint index)
+{
+    record("glDisableVertexAttribArray", index);
+    if(index < MAX_ATTRIBS)
+    {
+        setState(attribEnabled[index], false);
+    }
+}
+
+void APIENTRY glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                    const GLvoid* pointer)
+{
+    record("glVertexAttribPointer", index, arrayBuffer, stride, reinterpret_cast<uintptr_t>(pointer));
+    if(index < MAX_ATTRIBS)
+    {
+        AttribPointer& attrib = attribPointers[index];
+        stateChange(attrib.buffer != arrayBuffer || attrib.size != size || attrib.type != type ||
+                    attrib.normalized != normalized || attrib.stride != stride || attrib.pointer != pointer);
+        attrib.buffer = arrayBuffer;
+        attrib.size = size;
+        attrib.type = type;
+        attrib.normalized = normalized;
+        attrib.stride = stride;
+        attrib.pointer = pointer;
+    }
+}
+
+// vertex array objects, binding one swaps the attribute and index buffer state
+
+static void switchVertexArray(GLuint array)
+{
+    VertexArrayState& saved = vertexArrays[boundVertexArray];
+    memcpy(saved.attribEnabled, attribEnabled, sizeof(attribEnabled));
+    memcpy(saved.attribPointers, attribPointers, sizeof(attribPointers));
+    saved.elementArrayBuffer = elementArrayBuffer;
+
+    bool inserted;
+    P3dPair<uint32_t, VertexArrayState>* item = vertexArrays.findOrInsert(array, &inserted);
+    if(inserted)
+    {
+        memset(&item->second, 0, sizeof(item->second));
+    }
+    memcpy(attribEnabled, item->second.attribEnabled, sizeof(attribEnabled));
+    memcpy(attribPointers, item->second.attribPointers, sizeof(attribPointers));
+    elementArrayBuffer = item->second.elementArrayBuffer;
+    boundVertexArray = array;
+}
+
+void APIENTRY glGenVertexArrays(GLsizei n, GLuint* arrays)
+{
+    for(GLsizei i = 0; i < n; ++i)
+    {
+        arrays[i] = nextName++;
+        VertexArrayState& state = vertexArrays[arrays[i]];
+        memset(&state, 0, sizeof(state));
+    }
+    record("glGenVertexArrays", n, n ? arrays[0] : 0);
+}
+
+void APIENTRY glDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+    record("glDeleteVertexArrays", n, n ? arrays[0] : 0);
+    for(GLsizei i = 0; i < n; ++i)
+    {
+        // deleting the bound array binds the default one
+        if(arrays[i] && arrays[i] == boundVertexArray)
+        {
+            switchVertexArray(0);
+        }
+    }
+}
+
+void APIENTRY glBindVertexArray(GLuint array)
+{
+    record("glBindVertexArray", array);
+    stateChange(array != boundVertexArray);
+    if(array != boundVertexArray)
+    {
+        switchVertexArray(array);
+    }
+}
+
+// uniforms
+
+void APIENTRY glUniform1f(GLint location, GLfloat v0)
+{
+    record("glUniform1f", location);
+    setUniform(location, 1, &v0);
+}
+
+void APIENTRY glUniform1i(GLint location, GLint v0)
+{
+    record("glUniform1i", location, v0);
+    // compared as bits, only equality matters
+    GLfloat value;
+    memcpy(&value, &v0, sizeof(value));
+    setUniform(location, 1, &value);
+}
+
+void APIENTRY glUniform2fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    record("glUniform2fv", location, count);
+    setUniform(location, 2 * count, value);
+}
+
+void APIENTRY glUniform3fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    record("glUniform3fv", location, count);
+    setUniform(location, 3 * count, value);
+}
+
+void APIENTRY glUniformMatrix3fv(GLint location, GLsizei count, GLboolean, const GLfloat* value)
+{
+    record("glUniformMatrix3fv", location, count);
+    setUniform(location, 9 * count, value);
+}
+
+void APIENTRY glUniformMatrix4fv(GLint location, GLsizei count, GLboolean, const GLfloat* value)
+{
+    record("glUniformMatrix4fv", location, count);
+    setUniform(location, 16 * count, value);
+}
+
+// drawing
+
+void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices)
+{
+    record("glDrawElements", mode, count, type, reinterpret_cast<uintptr_t>(indices));
+    ++frame.drawCalls;
+    frame.drawnIndices += count;
+}
+
+void APIENTRY glMultiDrawElements(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices,
+                                  GLsizei drawcount)
+{
+    record("glMultiDrawElements", mode, drawcount, type, drawcount ? reinterpret_cast<uintptr_t>(indices[0]) : 0);
+    // one call for the driver, however many ranges it has
+    ++frame.drawCalls;
+    for(GLsizei i = 0; i < drawcount; ++i)
+    {
+        frame.drawnIndices += count[i];
+    }
+}
+
+}
+
+#endif // P3D_STUB_GL
@@ -0,0 +1,70 @@
+#ifndef P3DSTUBGL_H
+#define P3DSTUBGL_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include "P3dVector.h"
+
+//! \brief GL backend for headless builds, enabled by defining P3D_STUB_GL
+//! The gl* functions keep just enough state to count what the viewer does:
+//! draw calls, state changes and uploads per frame, and the memory held by
+//! buffers and textures. Calls can also be recorded into a command log.
+//! Like GL itself it must only be used from one thread.
+class P3dStubGL
+{
+public:
+    //! \brief counters since the last beginFrame()
+    struct FrameStats
+    {
+        uint32_t calls;
+        uint32_t drawCalls;
+        uint64_t drawnIndices;
+        //! binds, enables, program and attribute setup, without uniforms
+        uint32_t stateChanges;
+        //! state changes that set what was already set
+        uint32_t redundantStateChanges;
+        uint32_t uniformCalls;
+        //! uniform calls that set the value the location already had
+        uint32_t redundantUniformCalls;
+        uint64_t uploadBytes;
+    };
+
+    struct MemoryStats
+    {
+        uint32_t buffers;
+        uint64_t bufferBytes;
+        uint32_t textures;
+        uint64_t textureBytes;
+    };
+
+    //! \brief one recorded gl* call, args are the integer arguments in call order
+    struct Command
+    {
+        const char* function;
+        uint64_t args[4];
+    };
+
+    //! \brief string glGetString(GL_VERSION) returns, "OpenGL ES 2.0" by default
+    //! "OpenGL ES 3.0" or a desktop version make the viewer use 32 bit indices
+    static void setVersion(const char* version);
+    //! \brief string glGetString(GL_EXTENSIONS) returns, empty by default
+    //! "GL_EXT_multi_draw_arrays" makes a GLES viewer use glMultiDrawElements
+    static void setExtensions(const char* extensions);
+
+    static void beginFrame();
+    static FrameStats frameStats();
+    static MemoryStats memoryStats();
+
+    //! \brief starts or stops appending calls to the command log
+    static void setRecording(bool newValue);
+    static const P3dVector<Command>& commands();
+    static void clearCommands();
+    //! \brief writes the command log one call per line
+    static void writeCommands(FILE* out);
+
+    //! \brief forgets all objects and counters, for a new context
+    static void reset();
+};
+
+#endif // P3DSTUBGL_H
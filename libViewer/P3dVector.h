@@ -12,6 +12,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 
 //! \brief Replacement for std::vector which makes code size too big (emscripten)
@@ -76,7 +77,8 @@ public:
     }
 
     size_t size() const { return m_size; }
-    const T* data() { return m_data; }
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
 
     iterator begin() { return iterator(this); }
     iterator end() {
@@ -115,6 +117,14 @@ public:
         ++m_size;
     }
 
+    //! \brief appends count values copied from values, growing the storage once
+    void append(const T* values, size_t count)
+    {
+        reserve(m_size + count);
+        memcpy(m_data + m_size, values, sizeof(T) * count);
+        m_size += count;
+    }
+
     T& operator[] (size_t index)
     {
         assert(index < m_size);
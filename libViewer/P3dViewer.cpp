@@ -2,6 +2,8 @@
 #include "PlatformAdapter.h"
 #include "ModelLoader.h"
 #include "CameraNavigation.h"
+#include "P3dParallel.h"
+#include "P3dFrustum.h"
 #include "glwrapper.h"
 
 // translate, rotate, scale, perspective
@@ -10,12 +12,105 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#if P3D_USE_THREADS
+#include <thread>
+#include <condition_variable>
+#endif
+#ifdef __ANDROID__
+#include <EGL/egl.h>
+
+PFNGLGENVERTEXARRAYSOESPROC p3dGenVertexArrays = 0;
+PFNGLBINDVERTEXARRAYOESPROC p3dBindVertexArray = 0;
+PFNGLDELETEVERTEXARRAYSOESPROC p3dDeleteVertexArrays = 0;
+PFNGLMULTIDRAWELEMENTSEXTPROC p3dMultiDrawElements = 0;
+#endif
 
 static P3dLogger logger("core.P3dViewer", P3dLogger::LOG_DEBUG);
 
 const float PI = 3.14159265358979f;
 const float D2R = PI / 180;
 
+//! \brief state of a loadModelAsync or streamed load, the worker writes parsed, result and failed
+struct P3dViewer::AsyncLoad
+{
+    enum State
+    {
+        IDLE,
+        //! between beginModelLoad and finishModelLoad of progressive loaders
+        STREAMING,
+        PARSING,
+        UPLOADING
+    };
+
+    struct Property
+    {
+        int materialIndex;
+        char* property;
+        char* value;
+    };
+
+    struct Piece
+    {
+        char* data;
+        size_t size;
+    };
+
+    State state = IDLE;
+    std::atomic<bool> parsed{false};
+    bool result = false;
+    uint64_t start = 0;
+    // streamed loads, shown once the loader created the model from partial data
+    BaseLoader* loader = nullptr;
+    bool shown = false;
+    // streamed loads of the other loaders parse on the worker while pieces arrive
+    bool onWorker = false;
+    std::atomic<bool> failed{false};
+#if P3D_USE_THREADS
+    std::thread thread;
+    std::condition_variable wakeup;
+#endif
+
+    // material properties set while parsing, the materials don't exist yet
+    std::mutex mutex;
+    P3dVector<Property> properties;
+    // pieces for the worker, finished once finishModelLoad was called
+    P3dVector<Piece> pieces;
+    bool finished = false;
+    bool canceled = false;
+
+    void clearProperties()
+    {
+        for(Property item: properties)
+        {
+            delete [] item.property;
+            delete [] item.value;
+        }
+        properties.clear();
+    }
+
+    void clearPieces()
+    {
+        for(Piece piece: pieces)
+        {
+            delete [] piece.data;
+        }
+        pieces.clear();
+    }
+};
+
+static char* copyString(const char* value)
+{
+    char* res = new char[strlen(value) + 1];
+    strcpy(res, value);
+    return res;
+}
+
 P3dViewer::P3dViewer(PlatformAdapter* adapter)
 {
     PlatformAdapter::adapter = adapter;
@@ -26,12 +121,19 @@ P3dViewer::P3dViewer(PlatformAdapter* adapter)
 
     m_ModelLoader = new ModelLoader(this);
     m_CameraNavigation = new CameraNavigation();
+    m_AsyncLoad = new AsyncLoad();
 
     logger.debug("Viewer constructed");
 }
 
 P3dViewer::~P3dViewer()
 {
+    cancelAsyncLoad();
+    delete m_AsyncLoad;
+    delete [] m_StatsJson;
+    delete [] m_DrawCounts;
+    delete [] m_DrawOffsets;
+    delete [] m_ChunkOrder;
     delete m_UrlPrefix;
     delete m_CameraNavigation;
     delete m_ModelLoader;
@@ -186,6 +288,376 @@ GLint P3dViewer::getUniform(GLuint program, const char *name)
     return res;
 }
 
+void P3dViewer::loadUniforms(programs program)
+{
+    ProgramUniforms& uniforms = m_Uniforms[program];
+    uniforms = ProgramUniforms();
+    GLuint programObject = m_Programs[program];
+    if(!programObject)
+    {
+        return;
+    }
+
+    uniforms.modelViewMatrix = getUniform(programObject, "modelViewMatrix");
+    uniforms.projectionMatrix = getUniform(programObject, "projectionMatrix");
+    uniforms.viewMatrix = getUniform(programObject, "viewMatrix");
+    uniforms.normalMatrix = getUniform(programObject, "normalMatrix");
+    uniforms.directionalLightColor = getUniform(programObject, "directionalLightColor");
+    uniforms.directionalLightDirection = getUniform(programObject, "directionalLightDirection");
+    uniforms.uDiffuseColor = getUniform(programObject, "uDiffuseColor");
+    uniforms.uSpecularColor = getUniform(programObject, "uSpecularColor");
+    uniforms.uShininess = getUniform(programObject, "uShininess");
+
+    bool uvs = program == UVS || program == UVS_QUANTIZED;
+    bool quantized = program == BASIC_QUANTIZED || program == UVS_QUANTIZED;
+    glUseProgram(programObject);
+    if(uvs)
+    {
+        uniforms.enableDiffuse = getUniform(programObject, "enableDiffuse");
+        uniforms.enableSpecular = getUniform(programObject, "enableSpecular");
+        // samplers never change, diffuse is unit 0, specular unit 1
+        glUniform1i(getUniform(programObject, "tDiffuse"), 0);
+        glUniform1i(getUniform(programObject, "tSpecular"), 1);
+    }
+    if(quantized)
+    {
+        uniforms.uPosOffset = getUniform(programObject, "uPosOffset");
+        uniforms.uPosScale = getUniform(programObject, "uPosScale");
+        if(uvs)
+        {
+            uniforms.uUvOffset = getUniform(programObject, "uUvOffset");
+            uniforms.uUvScale = getUniform(programObject, "uUvScale");
+        }
+    }
+    glUseProgram(0);
+}
+
+void P3dViewer::buildRenderQueue()
+{
+    m_RenderQueue.clear();
+    m_RenderQueueDirty = false;
+    bool quantized = m_ModelLoader->isQuantized();
+    for(uint32_t chunk = 0, chunkl = m_ModelLoader->chunkCount(); chunk < chunkl; ++chunk)
+    {
+        if(!m_ModelLoader->indexCount(chunk))
+        {
+            continue;
+        }
+        DrawItem item;
+        bool uvs = m_ModelLoader->hasUvs(chunk);
+        item.program = uvs ? (quantized ? UVS_QUANTIZED : UVS) : (quantized ? BASIC_QUANTIZED : BASIC);
+        item.material = m_ModelLoader->material(chunk);
+        const P3dMaterial& material = m_Materials[item.material];
+        // programs without uvs don't sample, their chunks don't need to be split by texture
+        item.diffuseTexture = uvs ? material.diffuseTexture : 0;
+        item.specTexture = uvs ? material.specTexture : 0;
+        item.vertexBuffer = m_ModelLoader->vertexBuffer(chunk);
+        item.vertexArray = m_ModelLoader->vertexArray(chunk);
+        item.chunk = chunk;
+        item.indexOffset = m_ModelLoader->indexOffset(chunk);
+        item.indexCount = m_ModelLoader->indexCount(chunk);
+        item.visible = true;
+        item.order = 0;
+        m_RenderQueue.push_back(item);
+    }
+
+    // program switches cost most, then texture binds, then material uniforms;
+    // ties keep the chunk order so banks are bound in sequence
+    std::sort(m_RenderQueue.data(), m_RenderQueue.data() + m_RenderQueue.size(),
+              [](const DrawItem& a, const DrawItem& b)
+    {
+        if(a.program != b.program) return a.program < b.program;
+        if(a.diffuseTexture != b.diffuseTexture) return a.diffuseTexture < b.diffuseTexture;
+        if(a.specTexture != b.specTexture) return a.specTexture < b.specTexture;
+        if(a.material != b.material) return a.material < b.material;
+        return a.chunk < b.chunk;
+    });
+
+    delete [] m_DrawCounts;
+    delete [] m_DrawOffsets;
+    m_DrawCounts = new GLsizei[m_RenderQueue.size()];
+    m_DrawOffsets = new const void*[m_RenderQueue.size()];
+    delete [] m_ChunkOrder;
+    m_ChunkOrder = new uint32_t[m_ModelLoader->chunkCount()];
+}
+
+void P3dViewer::selectLods(const glm::vec3 &eye, float pixelsPerUnit)
+{
+    // while uploading, only ranges within the uploaded indices can be drawn
+    bool uploading = m_ModelLoader->hasPendingUploads();
+    bool verticesUploaded = m_ModelLoader->verticesUploaded();
+    uint32_t uploadedIndices = m_ModelLoader->uploadedIndexCount();
+    const int FULL = -1;
+    for(uint32_t item = 0, iteml = m_RenderQueue.size(); item < iteml; ++item)
+    {
+        DrawItem& draw = m_RenderQueue[item];
+        if(!draw.visible)
+        {
+            continue;
+        }
+        uint32_t chunk = draw.chunk;
+        auto levelOffset = [this, chunk](int level)
+        {
+            return level == FULL ? m_ModelLoader->indexOffset(chunk) : m_ModelLoader->lodIndexOffset(chunk, level);
+        };
+        auto levelCount = [this, chunk](int level)
+        {
+            return level == FULL ? m_ModelLoader->indexCount(chunk) : m_ModelLoader->lodIndexCount(chunk, level);
+        };
+
+        int selected = FULL;
+        if(m_ModelLoader->lodIndexCount(chunk, 0))
+        {
+            // from the nearest point of the bounding sphere, chunks around the camera stay in full detail
+            const float* center = m_ModelLoader->sphereCenter(chunk);
+            float dx = center[0] - eye.x;
+            float dy = center[1] - eye.y;
+            float dz = center[2] - eye.z;
+            float distance = sqrtf(dx * dx + dy * dy + dz * dz) - m_ModelLoader->sphereRadius(chunk);
+            // the coarsest level whose error stays below the limit on screen
+            float maxError = m_LodPixelError * distance / pixelsPerUnit;
+            for(int level = MeshChunk::MAX_LODS; distance > 0.0f && level-- > 0; )
+            {
+                if(levelCount(level) && m_ModelLoader->lodError(chunk, level) <= maxError)
+                {
+                    selected = level;
+                    break;
+                }
+            }
+        }
+
+        if(uploading)
+        {
+            // coarser levels come first in the index buffer and stand in for the selected one,
+            // then finer ones; chunks with nothing uploaded yet wait
+            auto uploaded = [&](int level)
+            {
+                return verticesUploaded && levelCount(level) && levelOffset(level) + levelCount(level) <= uploadedIndices;
+            };
+            int level = selected;
+            while(level < int(MeshChunk::MAX_LODS) && !uploaded(level)) ++level;
+            if(level == int(MeshChunk::MAX_LODS))
+            {
+                for(level = selected - 1; level >= FULL && !uploaded(level); --level) {}
+            }
+            if(level < FULL)
+            {
+                draw.visible = false;
+                ++m_FrameStats.loadingChunks;
+                continue;
+            }
+            selected = level;
+        }
+
+        draw.indexOffset = levelOffset(selected);
+        draw.indexCount = levelCount(selected);
+        if(selected != FULL)
+        {
+            ++m_FrameStats.lodChunks;
+        }
+    }
+}
+
+uint32_t P3dViewer::drawBatch(uint32_t first)
+{
+    // ModelLoader::groupChunks put the ranges of a batch next to each other,
+    // they merge into one unless chunks in between are left out
+    const DrawItem& batch = m_RenderQueue[first];
+    uint32_t indexSize = m_ModelLoader->indexSize();
+    GLsizei ranges = 0;
+    uint32_t rangeEnd = 0;
+    uint32_t item = first;
+    for(uint32_t iteml = m_RenderQueue.size(); item < iteml; ++item)
+    {
+        const DrawItem& draw = m_RenderQueue[item];
+        if(!draw.sameBatch(batch))
+        {
+            break;
+        }
+        if(!draw.visible)
+        {
+            continue;
+        }
+        if(ranges && draw.indexOffset == rangeEnd)
+        {
+            m_DrawCounts[ranges - 1] += draw.indexCount;
+        }
+        else
+        {
+            m_DrawCounts[ranges] = draw.indexCount;
+            m_DrawOffsets[ranges] = reinterpret_cast<const void*>(uintptr_t(draw.indexOffset) * indexSize);
+            ++ranges;
+        }
+        rangeEnd = draw.indexOffset + draw.indexCount;
+    }
+
+    GLenum indexType = m_ModelLoader->indexType();
+#if P3D_MULTI_DRAW
+    if(ranges > 1 && m_MultiDraw)
+    {
+        p3dMultiDrawElements(GL_TRIANGLES, m_DrawCounts, indexType, m_DrawOffsets, ranges);
+        ++m_FrameStats.drawCalls;
+        return item;
+    }
+#endif
+    for(GLsizei range = 0; range < ranges; ++range)
+    {
+        glDrawElements(GL_TRIANGLES, m_DrawCounts[range], indexType, m_DrawOffsets[range]);
+    }
+    m_FrameStats.drawCalls += ranges;
+    return item;
+}
+
+void P3dViewer::cullRenderQueue(const glm::mat4 &viewProj, const glm::vec3 &eye)
+{
+    const uint32_t NOT_VISIBLE = UINT32_MAX;
+    uint32_t chunkCount = m_ModelLoader->chunkCount();
+    for(uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        m_ChunkOrder[chunk] = NOT_VISIBLE;
+    }
+
+    // whole subtrees are culled or accepted at once, the rest down to the chunk spheres and boxes
+    P3dFrustum frustum(viewProj);
+    const float eyePosition[3] = {eye.x, eye.y, eye.z};
+    uint32_t visited = 0;
+    m_ModelLoader->bvh().cull(frustum, eyePosition, [this, &visited](uint32_t chunk)
+    {
+        m_ChunkOrder[chunk] = visited++;
+    });
+
+    uint32_t iteml = m_RenderQueue.size();
+    for(uint32_t item = 0; item < iteml; ++item)
+    {
+        DrawItem& draw = m_RenderQueue[item];
+        draw.order = m_ChunkOrder[draw.chunk];
+        draw.visible = draw.order != NOT_VISIBLE;
+        if(!draw.visible)
+        {
+            ++m_FrameStats.culledChunks;
+        }
+    }
+
+    // clusters of a batch front to back, the nearest ones fill the depth buffer first
+    // and the fragments behind them fail the depth test early;
+    // only with multi draw, elsewhere index order merges clusters into far fewer draw calls
+    if(!m_ModelLoader->isClustered() || !m_MultiDraw)
+    {
+        return;
+    }
+    for(uint32_t first = 0; first < iteml; )
+    {
+        uint32_t end = first + 1;
+        while(end < iteml && m_RenderQueue[end].sameBatch(m_RenderQueue[first]))
+        {
+            ++end;
+        }
+        std::sort(m_RenderQueue.data() + first, m_RenderQueue.data() + end, [](const DrawItem& a, const DrawItem& b)
+        {
+            return a.order < b.order;
+        });
+        first = end;
+    }
+}
+
+bool P3dViewer::hasUint32Indices()
+{
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if(!version)
+    {
+        return false;
+    }
+
+    // desktop GL always draws 32 bit indices
+    const char* es = strstr(version, "OpenGL ES");
+    if(!es)
+    {
+        return true;
+    }
+
+    // GLES3 and WebGL 2 ("OpenGL ES 3.0 (WebGL 2.0)") do as well
+    int major = 0;
+    if(sscanf(es, "OpenGL ES %d", &major) == 1 && major >= 3)
+    {
+        return true;
+    }
+
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    return extensions && strstr(extensions, "OES_element_index_uint");
+}
+
+bool P3dViewer::hasMultiDraw()
+{
+#if P3D_MULTI_DRAW
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if(!version)
+    {
+        return false;
+    }
+
+    // core since GL 1.4, no GLES version has it
+    if(!strstr(version, "OpenGL ES"))
+    {
+        return true;
+    }
+    // WEBGL_multi_draw or EXT_multi_draw_arrays
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if(!extensions || !strstr(extensions, "multi_draw"))
+    {
+        return false;
+    }
+#ifdef __ANDROID__
+    p3dMultiDrawElements = reinterpret_cast<PFNGLMULTIDRAWELEMENTSEXTPROC>(eglGetProcAddress("glMultiDrawElementsEXT"));
+    return p3dMultiDrawElements;
+#else
+    return true;
+#endif
+#else
+    return false;
+#endif
+}
+
+bool P3dViewer::hasVertexArrays()
+{
+#if P3D_VERTEX_ARRAYS
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if(!version)
+    {
+        return false;
+    }
+
+    // GL 3, GLES 3 and WebGL 2 have them in core
+    const char* es = strstr(version, "OpenGL ES");
+    int major = 0;
+    bool core = es ? sscanf(es, "OpenGL ES %d", &major) == 1 && major >= 3
+                   : sscanf(version, "%d", &major) == 1 && major >= 3;
+    if(!core)
+    {
+        const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        if(!extensions || !(strstr(extensions, "OES_vertex_array_object") ||
+                            strstr(extensions, "GL_ARB_vertex_array_object")))
+        {
+            return false;
+        }
+    }
+#ifdef __ANDROID__
+    const char* suffix = core ? "" : "OES";
+    char name[32];
+    snprintf(name, sizeof(name), "glGenVertexArrays%s", suffix);
+    p3dGenVertexArrays = reinterpret_cast<PFNGLGENVERTEXARRAYSOESPROC>(eglGetProcAddress(name));
+    snprintf(name, sizeof(name), "glBindVertexArray%s", suffix);
+    p3dBindVertexArray = reinterpret_cast<PFNGLBINDVERTEXARRAYOESPROC>(eglGetProcAddress(name));
+    snprintf(name, sizeof(name), "glDeleteVertexArrays%s", suffix);
+    p3dDeleteVertexArrays = reinterpret_cast<PFNGLDELETEVERTEXARRAYSOESPROC>(eglGetProcAddress(name));
+    return p3dGenVertexArrays && p3dBindVertexArray && p3dDeleteVertexArrays;
+#else
+    return true;
+#endif
+#else
+    return false;
+#endif
+}
+
 char *P3dViewer::prefixUrl(const char *url)
 {
     char* res;
@@ -233,9 +705,42 @@ void P3dViewer::onSurfaceCreated() {
                           );
     m_Programs[UVS] = program;
 
+    program = loadProgram("shaders/vertex.glsl", "shaders/fragment.glsl",
+                          "#define MAX_DIR_LIGHTS 4\n"
+                          "#define GAMMA_INPUT\n"
+                          "#define GAMMA_OUTPUT\n"
+                          "#define PHYSICALLY_BASED_SHADING\n"
+                          "#define QUANTIZED\n"
+                          );
+    m_Programs[BASIC_QUANTIZED] = program;
+
+    program = loadProgram("shaders/vertex.glsl", "shaders/fragment.glsl",
+                          "#define MAX_DIR_LIGHTS 4\n"
+                          "#define GAMMA_INPUT\n"
+                          "#define GAMMA_OUTPUT\n"
+                          "#define PHYSICALLY_BASED_SHADING\n"
+                          "#define HAS_UV\n"
+                          "#define USE_DIFFUSE_TEXTURE\n"
+                          "#define USE_SPEC_TEX\n"
+                          "#define QUANTIZED\n"
+                          );
+    m_Programs[UVS_QUANTIZED] = program;
+
+    for(int i = 0; i < programCount; ++i)
+    {
+        loadUniforms(static_cast<programs>(i));
+    }
+
     int depth;
     glGetIntegerv(GL_DEPTH_BITS, &depth);
     logger.debug("Depth buffer: %d bits", depth);
+
+    m_ModelLoader->setUint32Indices(hasUint32Indices());
+    logger.debug("32 bit indices: %s", m_ModelLoader->uint32Indices() ? "yes" : "no");
+    m_ModelLoader->setVertexArrays(hasVertexArrays());
+    logger.debug("vertex arrays: %s", m_ModelLoader->vertexArrays() ? "yes" : "no");
+    m_MultiDraw = hasMultiDraw();
+    logger.debug("multi draw: %s", m_MultiDraw ? "yes" : "no");
     m_InitOk = true;
 }
 
@@ -250,6 +755,8 @@ void P3dViewer::drawFrame() {
         return;
     }
 
+    m_FrameStats = FrameStats();
+
     // Set the viewport
     glViewport(0, 0, m_Width, m_Height);
 
@@ -257,7 +764,11 @@ void P3dViewer::drawFrame() {
     glClearColor(0.2f, 0.2f, 0.2f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-    if(m_ModelLoader->isLoaded() && m_ModelLoader->boundingRadius() > 0.0f)
+    // the model loader belongs to the worker until the parse is done,
+    // while uploading selectLods leaves out the chunks whose data isn't there yet
+    updateAsyncLoad();
+
+    if(m_AsyncLoad->state != AsyncLoad::PARSING && m_ModelLoader->isLoaded() && m_ModelLoader->boundingRadius() > 0.0f)
     {
 
         glEnable(GL_DEPTH_TEST);
@@ -281,91 +792,106 @@ void P3dViewer::drawFrame() {
         glm::mat4 modelView = view * model;
         glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelView)));
 
-        bool commonUniformsSet[sizeof(m_Programs)/sizeof(m_Programs[0])];
-        memset(commonUniformsSet, 0, sizeof(commonUniformsSet));
-
-        programs currentProgram = BASIC;
+        if(m_RenderQueueDirty)
+        {
+            buildRenderQueue();
+        }
+        m_FrameStats.chunks = m_RenderQueue.size();
+        cullRenderQueue(proj * view * model, m_CameraNavigation->position());
+        // pixels one unit covers at a distance of one unit
+        selectLods(m_CameraNavigation->position(), proj[1][1] * 0.5f * m_Height);
 
-        for(int chunk = 0, chunkl = m_ModelLoader->chunkCount(); chunk < chunkl; ++chunk)
+        bool commonUniformsSet[programCount];
+        memset(commonUniformsSet, 0, sizeof(commonUniformsSet));
+        // material whose uniforms each program has, uniforms are per program
+        int programMaterial[programCount];
+        for(int i = 0; i < programCount; ++i) programMaterial[i] = -1;
+
+        // all attributes come from one interleaved buffer per vertex bank,
+        // with vertex arrays every bank has its setup in one object
+        bool vertexArrays = m_RenderQueue.size() && m_RenderQueue[0].vertexArray;
+        if(!vertexArrays)
+        {
+            glEnableVertexAttribArray(ATTRIB_POSITION);
+            glEnableVertexAttribArray(ATTRIB_NORMAL);
+            glEnableVertexAttribArray(ATTRIB_UV);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ModelLoader->indexBuffer());
+        }
+        GLuint boundBuffer = 0;
+#if P3D_VERTEX_ARRAYS
+        GLuint boundVertexArray = 0;
+#endif
+        GLuint currentProgram = 0;
+        // texture loads may bind textures between frames, the first bind of a frame always happens
+        GLuint boundTextures[2] = {GLuint(-1), GLuint(-1)};
+        GLenum activeTexture = 0;
+        bool quantized = m_ModelLoader->isQuantized();
+
+        // state is set once per batch, drawBatch draws its chunks
+        for(uint32_t item = 0, iteml = m_RenderQueue.size(); item < iteml; )
         {
-            if(m_ModelLoader->indexCount(chunk))
+            const DrawItem& draw = m_RenderQueue[item];
+            if(!draw.visible)
             {
-                GLuint arrayBuffer;
-                P3dMaterial& material = m_Materials[m_ModelLoader->material(chunk)];
-
-                arrayBuffer = m_ModelLoader->posBuffer(chunk);
-                glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-                glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0);
-                glEnableVertexAttribArray(ATTRIB_POSITION);
-
-                arrayBuffer = m_ModelLoader->normBuffer(chunk);
-                glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-                if(arrayBuffer)
-                {
-                    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
-                    glEnableVertexAttribArray(ATTRIB_NORMAL);
-                }
-                else
-                {
-                    glDisableVertexAttribArray(ATTRIB_NORMAL);
-                }
-
-                arrayBuffer = m_ModelLoader->uvBuffer(chunk);
-                glBindBuffer(GL_ARRAY_BUFFER, arrayBuffer);
-                if(arrayBuffer)
-                {
-                    glVertexAttribPointer(ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, 0, 0);
-                    glEnableVertexAttribArray(ATTRIB_UV);
-                }
-                else
+                ++item;
+                continue;
+            }
+            P3dMaterial& material = m_Materials[draw.material];
+
+            // chunks of the same bank share the attribute setup
+#if P3D_VERTEX_ARRAYS
+            if(vertexArrays)
+            {
+                if(draw.vertexArray != boundVertexArray)
                 {
-                    glDisableVertexAttribArray(ATTRIB_UV);
+                    boundVertexArray = draw.vertexArray;
+                    p3dBindVertexArray(draw.vertexArray);
                 }
+            }
+            else
+#endif
+            if(draw.vertexBuffer != boundBuffer)
+            {
+                boundBuffer = draw.vertexBuffer;
+                glBindBuffer(GL_ARRAY_BUFFER, draw.vertexBuffer);
+                m_ModelLoader->setAttribPointers();
+            }
+
+            GLuint programObject = m_Programs[draw.program];
+            const ProgramUniforms& uniforms = m_Uniforms[draw.program];
+            if(programObject != currentProgram)
+            {
+                currentProgram = programObject;
+                glUseProgram(programObject);
+            }
 
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ModelLoader->indexBuffer());
-
-                GLuint programObject = 0;
-                if(m_ModelLoader->hasUvs(chunk))
+            // textures, only programs with uvs sample them
+            GLuint textures[2] = {draw.diffuseTexture, draw.specTexture};
+            for(int unit = 0; unit < 2; ++unit)
+            {
+                if(textures[unit] && textures[unit] != boundTextures[unit])
                 {
-                    // has uvs
-                    currentProgram = UVS;
-                    programObject = m_Programs[currentProgram];
-                    glUseProgram(programObject);
-
-                    // diff texure
-                    GLint diffuseTexId = material.diffuseTexture;
-                    GLint enableDiffuse = getUniform(programObject, "enableDiffuse");
-                    glUniform1i(enableDiffuse, diffuseTexId != 0);
-                    if(diffuseTexId)
+                    if(activeTexture != GLenum(GL_TEXTURE0 + unit))
                     {
-                        glActiveTexture(GL_TEXTURE0);
-                        glBindTexture(GL_TEXTURE_2D, diffuseTexId);
-                        GLint tDiffuse = getUniform(programObject, "tDiffuse");
-                        glUniform1i(tDiffuse, 0);
-                    }
-
-                    // spec texure
-                    GLint specTexId = material.specTexture;
-                    GLint enableSpecular = getUniform(programObject, "enableSpecular");
-                    glUniform1i(enableSpecular, specTexId != 0);
-                    if(specTexId)
-                    {
-                        glActiveTexture(GL_TEXTURE1);
-                        glBindTexture(GL_TEXTURE_2D, specTexId);
-                        GLint tSpecular = getUniform(programObject, "tSpecular");
-                        glUniform1i(tSpecular, 1);
+                        activeTexture = GL_TEXTURE0 + unit;
+                        glActiveTexture(activeTexture);
                     }
+                    glBindTexture(GL_TEXTURE_2D, textures[unit]);
+                    boundTextures[unit] = textures[unit];
                 }
-                else
+            }
+
+            // material uniforms
+            if(programMaterial[draw.program] != int(draw.material))
+            {
+                programMaterial[draw.program] = draw.material;
+                if(uniforms.enableDiffuse != -1)
                 {
-                    // no uvs
-                    currentProgram = BASIC;
-                    programObject = m_Programs[currentProgram];
-                    glUseProgram(programObject);
+                    glUniform1i(uniforms.enableDiffuse, draw.diffuseTexture != 0);
+                    glUniform1i(uniforms.enableSpecular, draw.specTexture != 0);
                 }
 
                 // diffuse
-                GLint uDiffuseColor = getUniform(programObject, "uDiffuseColor");
                 glm::vec3 diff_color = material.diff_col;
                 if(!material.diffuseTexture)
                 {
@@ -375,57 +901,64 @@ void P3dViewer::drawFrame() {
                 {
                     diff_color *= material.diff_tex_str;
                 }
-                glUniform3fv(uDiffuseColor, 1, glm::value_ptr(diff_color));
+                glUniform3fv(uniforms.uDiffuseColor, 1, glm::value_ptr(diff_color));
 
                 // specular
-                GLint uSpecularColor = getUniform(programObject, "uSpecularColor");
                 glm::vec3 spec_color = material.spec_col;
                 spec_color *= material.spec_str;
-                glUniform3fv(uSpecularColor, 1, glm::value_ptr(spec_color));
-                GLint uShininess = getUniform(programObject, "uShininess");
-                glUniform1f(uShininess, material.spec_shininess * 255.0f);
+                glUniform3fv(uniforms.uSpecularColor, 1, glm::value_ptr(spec_color));
+                glUniform1f(uniforms.uShininess, material.spec_shininess * 255.0f);
+            }
 
-                // common uniforms
-                if(!commonUniformsSet[currentProgram])
+            // common uniforms
+            if(!commonUniformsSet[draw.program])
+            {
+                commonUniformsSet[draw.program] = true;
+                glUniformMatrix4fv(uniforms.modelViewMatrix, 1, GL_FALSE, glm::value_ptr(modelView));
+                glUniformMatrix4fv(uniforms.projectionMatrix, 1, GL_FALSE, glm::value_ptr(proj));
+                glUniformMatrix4fv(uniforms.viewMatrix, 1, GL_FALSE, glm::value_ptr(view));
+                glUniformMatrix3fv(uniforms.normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+
+                // lights
+                glm::vec3 lightColors[4] = {
+                    glm::vec3(0xff, 0xfa, 0xf0) * (1.15f / 255.0f),
+                    glm::vec3(0xb3, 0xe5, 0xff) * (0.55f / 255.0f),
+                    glm::vec3(0xfd, 0xff, 0xcc) * (0.55f / 255.0f),
+                    glm::vec3(0xb3, 0xe5, 0xff) * (0.55f / 255.0f)
+                };
+                glm::vec3 lightDirs[4] = {
+                    glm::vec3(10, 10, 10) * normalMatrix,
+                    glm::vec3(-5, 10, 5) * normalMatrix,
+                    glm::vec3(0, -10, 5) * normalMatrix,
+                    glm::vec3(0, 0, -10) * normalMatrix
+                };
+
+                glUniform3fv(uniforms.directionalLightColor, 4, reinterpret_cast<GLfloat*>(lightColors));
+                glUniform3fv(uniforms.directionalLightDirection, 4, reinterpret_cast<GLfloat*>(lightDirs));
+
+                // attribute decoding
+                if(quantized)
                 {
-                    commonUniformsSet[currentProgram] = true;
-                    GLint modelViewMatrix = getUniform(programObject, "modelViewMatrix");
-                    glUniformMatrix4fv(modelViewMatrix, 1, GL_FALSE, glm::value_ptr(modelView));
-                    GLint projectionMatrix = getUniform(programObject, "projectionMatrix");
-                    glUniformMatrix4fv(projectionMatrix, 1, GL_FALSE, glm::value_ptr(proj));
-                    GLint uViewMatrix = getUniform(programObject, "viewMatrix");
-                    glUniformMatrix4fv(uViewMatrix, 1, GL_FALSE, glm::value_ptr(view));
-
-                    GLint uNormalMatrix = getUniform(programObject, "normalMatrix");
-                    glUniformMatrix3fv(uNormalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-                    // lights
-                    GLint directionalLightColor = getUniform(programObject, "directionalLightColor");
-                    GLint directionalLightDirection = getUniform(programObject, "directionalLightDirection");
-                    glm::vec3 lightColors[4] = {
-                        glm::vec3(0xff, 0xfa, 0xf0) * (1.15f / 255.0f),
-                        glm::vec3(0xb3, 0xe5, 0xff) * (0.55f / 255.0f),
-                        glm::vec3(0xfd, 0xff, 0xcc) * (0.55f / 255.0f),
-                        glm::vec3(0xb3, 0xe5, 0xff) * (0.55f / 255.0f)
-                    };
-                    glm::vec3 lightDirs[4] = {
-                        glm::vec3(10, 10, 10) * normalMatrix,
-                        glm::vec3(-5, 10, 5) * normalMatrix,
-                        glm::vec3(0, -10, 5) * normalMatrix,
-                        glm::vec3(0, 0, -10) * normalMatrix
-                    };
-
-                    glUniform3fv(directionalLightColor, 4, reinterpret_cast<GLfloat*>(lightColors));
-                    glUniform3fv(directionalLightDirection, 4, reinterpret_cast<GLfloat*>(lightDirs));
+                    glUniform3fv(uniforms.uPosOffset, 1, m_ModelLoader->posOffset());
+                    glUniform3fv(uniforms.uPosScale, 1, m_ModelLoader->posScale());
+                    if(draw.program == UVS_QUANTIZED)
+                    {
+                        glUniform2fv(uniforms.uUvOffset, 1, m_ModelLoader->uvOffset());
+                        glUniform2fv(uniforms.uUvScale, 1, m_ModelLoader->uvScale());
+                    }
                 }
+            }
 
-                GLsizei count = m_ModelLoader->indexCount(chunk);
-                uint32_t offset = m_ModelLoader->indexOffset(chunk);
-                glDrawElements(GL_TRIANGLES, count,
-                               GL_UNSIGNED_SHORT,
-                               (GLvoid*)(sizeof(GLushort) * offset));
-                }
+            item = drawBatch(item);
         }
+
+#if P3D_VERTEX_ARRAYS
+        // leave the default vertex array bound for other GL users of the context
+        if(boundVertexArray)
+        {
+            p3dBindVertexArray(0);
+        }
+#endif
     }
 }
 
@@ -446,23 +979,392 @@ bool P3dViewer::loadModel(const char *binaryData, size_t size, const char *exten
         return false;
     }
     loader->setModelLoader(m_ModelLoader);
-    bool res = loader->load(binaryData, size);
-    if(res)
+    m_ModelLoader->setDeferUploads(false);
+    P3dProfiler::reset();
+    bool res;
+    m_ModelLoader->setSourceData(binaryData, size);
+    res = m_ModelLoader->loadModelCache();
+    if(!res)
     {
-        logger.debug("material count: %d", materialCount());
-        while(m_Materials.size() < materialCount())
         {
-            m_Materials.push_back(P3dMaterial());
+            P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+            res = loader->load(binaryData, size);
         }
-        logger.debug("bounding radius %f", m_ModelLoader->boundingRadius());
-        m_CameraNavigation->setBoundingRadius(m_ModelLoader->boundingRadius());
-        m_CameraNavigation->reset();
+        if(res) m_ModelLoader->saveModelCache();
+    }
+    if(res)
+    {
+        onModelLoaded();
+        logger.debug("load stats: %s", loadStatsJson());
     }
     return res;
 }
 
+bool P3dViewer::loadModelAsync(const char *binaryData, size_t size, const char *extension)
+{
+    clearModel();
+    BaseLoader* loader = BaseLoader::loaderFromExtension(extension);
+    if(!loader)
+    {
+        logger.warning("unsupported extension:  %s", extension);
+        return false;
+    }
+    loader->setModelLoader(m_ModelLoader);
+    m_ModelLoader->setDeferUploads(true);
+
+    m_AsyncLoad->state = AsyncLoad::PARSING;
+    m_AsyncLoad->parsed = false;
+    m_AsyncLoad->result = false;
+    m_AsyncLoad->start = PlatformAdapter::currentMillis();
+    m_AsyncLoad->onWorker = false;
+    P3dProfiler::reset();
+
+    AsyncLoad* asyncLoad = m_AsyncLoad;
+    ModelLoader* modelLoader = m_ModelLoader;
+    auto parse = [=]()
+    {
+        modelLoader->setSourceData(binaryData, size);
+        asyncLoad->result = modelLoader->loadModelCache();
+        if(!asyncLoad->result)
+        {
+            {
+                P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+                asyncLoad->result = loader->load(binaryData, size);
+            }
+            if(asyncLoad->result) modelLoader->saveModelCache();
+        }
+        asyncLoad->parsed = true;
+    };
+#if P3D_USE_THREADS
+    m_AsyncLoad->thread = std::thread(parse);
+#else
+    parse();
+#endif
+    return true;
+}
+
+bool P3dViewer::beginModelLoad(const char *extension, size_t totalSize)
+{
+    clearModel();
+    BaseLoader* loader = BaseLoader::loaderFromExtension(extension);
+    if(!loader)
+    {
+        logger.warning("unsupported extension:  %s", extension);
+        return false;
+    }
+    loader->setModelLoader(m_ModelLoader);
+    m_ModelLoader->setDeferUploads(true);
+    // loaders that keep all data set it in finishLoad for the caches
+    m_ModelLoader->setSourceData(0, 0);
+
+    // progressive loaders create the model on this thread, it is drawn while the rest
+    // arrives; the others parse on the worker like loadModelAsync
+    m_AsyncLoad->state = loader->progressive() ? AsyncLoad::STREAMING : AsyncLoad::PARSING;
+    m_AsyncLoad->parsed = false;
+    m_AsyncLoad->result = false;
+    m_AsyncLoad->start = PlatformAdapter::currentMillis();
+    m_AsyncLoad->loader = loader;
+    m_AsyncLoad->shown = false;
+    m_AsyncLoad->onWorker = !loader->progressive();
+    m_AsyncLoad->failed = false;
+    m_AsyncLoad->finished = false;
+    m_AsyncLoad->canceled = false;
+    P3dProfiler::reset();
+
+    bool res;
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+        res = loader->beginLoad(totalSize);
+    }
+    if(!res)
+    {
+        logger.warning("streamed load failed");
+        m_AsyncLoad->state = AsyncLoad::IDLE;
+        clearModel();
+        return false;
+    }
+#if P3D_USE_THREADS
+    if(m_AsyncLoad->onWorker)
+    {
+        AsyncLoad* asyncLoad = m_AsyncLoad;
+        ModelLoader* modelLoader = m_ModelLoader;
+        auto parse = [=]()
+        {
+            P3dVector<AsyncLoad::Piece> pieces;
+            bool finished = false;
+            while(!finished)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(asyncLoad->mutex);
+                    asyncLoad->wakeup.wait(lock, [=]()
+                    {
+                        return asyncLoad->pieces.size() || asyncLoad->finished || asyncLoad->canceled;
+                    });
+                    if(asyncLoad->canceled)
+                    {
+                        break;
+                    }
+                    for(AsyncLoad::Piece piece: asyncLoad->pieces)
+                    {
+                        pieces.push_back(piece);
+                    }
+                    asyncLoad->pieces.clear();
+                    finished = asyncLoad->finished;
+                }
+                for(AsyncLoad::Piece piece: pieces)
+                {
+                    // after a failure the pieces are dropped until the viewer notices
+                    if(!asyncLoad->failed)
+                    {
+                        P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+                        asyncLoad->failed = !loader->appendData(piece.data, piece.size);
+                    }
+                    delete [] piece.data;
+                }
+                pieces.clear();
+            }
+            if(finished && !asyncLoad->failed)
+            {
+                {
+                    P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+                    asyncLoad->result = loader->finishLoad();
+                }
+                if(asyncLoad->result) modelLoader->saveModelCache();
+            }
+            asyncLoad->parsed = true;
+        };
+        m_AsyncLoad->thread = std::thread(parse);
+    }
+#endif
+    return true;
+}
+
+bool P3dViewer::appendModelData(const char *data, size_t size)
+{
+    bool queue = m_AsyncLoad->state == AsyncLoad::PARSING && m_AsyncLoad->onWorker && !m_AsyncLoad->finished;
+    if(m_AsyncLoad->state != AsyncLoad::STREAMING && !queue)
+    {
+        return false;
+    }
+    bool res = !m_AsyncLoad->failed;
+#if P3D_USE_THREADS
+    if(queue && res)
+    {
+        AsyncLoad::Piece piece;
+        piece.data = new char[size];
+        memcpy(piece.data, data, size);
+        piece.size = size;
+        {
+            std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+            m_AsyncLoad->pieces.push_back(piece);
+        }
+        m_AsyncLoad->wakeup.notify_one();
+        return true;
+    }
+#endif
+    if(res)
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+        res = m_AsyncLoad->loader->appendData(data, size);
+    }
+    if(!res)
+    {
+        logger.warning("streamed load failed");
+        clearModel();
+        return false;
+    }
+    if(!m_AsyncLoad->shown && !m_AsyncLoad->onWorker && m_ModelLoader->isLoaded())
+    {
+        // the loader created the model early, it is drawn while the rest arrives
+        m_AsyncLoad->shown = true;
+        onModelLoaded();
+        applyAsyncProperties(true);
+    }
+    return true;
+}
+
+bool P3dViewer::finishModelLoad()
+{
+    if(m_AsyncLoad->state == AsyncLoad::PARSING && m_AsyncLoad->onWorker && !m_AsyncLoad->finished)
+    {
+        // the worker finishes after the last piece, updateAsyncLoad takes over from there
+#if P3D_USE_THREADS
+        {
+            std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+            m_AsyncLoad->finished = true;
+        }
+        m_AsyncLoad->wakeup.notify_one();
+#else
+        m_AsyncLoad->finished = true;
+        {
+            P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+            m_AsyncLoad->result = m_AsyncLoad->loader->finishLoad();
+        }
+        if(m_AsyncLoad->result) m_ModelLoader->saveModelCache();
+        m_AsyncLoad->parsed = true;
+#endif
+        return true;
+    }
+    if(m_AsyncLoad->state != AsyncLoad::STREAMING)
+    {
+        return false;
+    }
+
+    // only checks are left, uploads go on over the next frames
+    bool res;
+    {
+        P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+        res = m_AsyncLoad->loader->finishLoad();
+    }
+    if(!res)
+    {
+        logger.warning("streamed load failed");
+        clearModel();
+        return false;
+    }
+    m_AsyncLoad->state = AsyncLoad::UPLOADING;
+    if(!m_AsyncLoad->shown)
+    {
+        m_AsyncLoad->shown = true;
+        onModelLoaded();
+        applyAsyncProperties(true);
+    }
+    return true;
+}
+
+bool P3dViewer::isLoading()
+{
+    return m_AsyncLoad->state != AsyncLoad::IDLE;
+}
+
+void P3dViewer::onModelLoaded()
+{
+    logger.debug("material count: %d", materialCount());
+    while(m_Materials.size() < materialCount())
+    {
+        m_Materials.push_back(P3dMaterial());
+    }
+    logger.debug("bounding radius %f", m_ModelLoader->boundingRadius());
+    m_CameraNavigation->setBoundingRadius(m_ModelLoader->boundingRadius());
+    m_CameraNavigation->reset();
+    m_RenderQueueDirty = true;
+}
+
+void P3dViewer::updateAsyncLoad()
+{
+    if(m_AsyncLoad->state == AsyncLoad::PARSING)
+    {
+        if(!m_AsyncLoad->parsed)
+        {
+            return;
+        }
+#if P3D_USE_THREADS
+        m_AsyncLoad->thread.join();
+#endif
+        logger.debug("async parse took %lldms", PlatformAdapter::durationMillis(m_AsyncLoad->start));
+
+        {
+            std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+            m_AsyncLoad->state = m_AsyncLoad->result ? AsyncLoad::UPLOADING : AsyncLoad::IDLE;
+        }
+        if(m_AsyncLoad->result)
+        {
+            onModelLoaded();
+        }
+        else
+        {
+            logger.warning("async load failed");
+        }
+        applyAsyncProperties(m_AsyncLoad->result);
+    }
+
+    // streamed data uploads as it arrives
+    if(m_AsyncLoad->state == AsyncLoad::STREAMING || m_AsyncLoad->state == AsyncLoad::UPLOADING)
+    {
+        if(m_ModelLoader->hasPendingUploads())
+        {
+            bool verticesUploaded = m_ModelLoader->verticesUploaded();
+            // the render queue takes the buffer names once they exist
+            if(m_ModelLoader->uploadPending(m_ModelLoader->options().uploadBudget)
+                    || verticesUploaded != m_ModelLoader->verticesUploaded())
+            {
+                m_RenderQueueDirty = true;
+            }
+        }
+        if(m_AsyncLoad->state == AsyncLoad::UPLOADING && !m_ModelLoader->hasPendingUploads())
+        {
+            m_AsyncLoad->state = AsyncLoad::IDLE;
+            logger.debug("async load took %lldms", PlatformAdapter::durationMillis(m_AsyncLoad->start));
+            logger.debug("load stats: %s", loadStatsJson());
+        }
+    }
+}
+
+void P3dViewer::applyAsyncProperties(bool apply)
+{
+    P3dVector<AsyncLoad::Property> properties;
+    {
+        std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+        for(AsyncLoad::Property item: m_AsyncLoad->properties)
+        {
+            properties.push_back(item);
+        }
+        m_AsyncLoad->properties.clear();
+    }
+    for(AsyncLoad::Property item: properties)
+    {
+        if(apply)
+        {
+            setMaterialProperty(item.materialIndex, item.property, item.value);
+        }
+        delete [] item.property;
+        delete [] item.value;
+    }
+}
+
+void P3dViewer::cancelAsyncLoad()
+{
+    // loaders can't be interrupted, a running parse is waited for;
+    // a worker waiting for streamed pieces stops
+    if(m_AsyncLoad->state == AsyncLoad::PARSING)
+    {
+#if P3D_USE_THREADS
+        {
+            std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+            m_AsyncLoad->canceled = true;
+        }
+        m_AsyncLoad->wakeup.notify_one();
+        m_AsyncLoad->thread.join();
+#endif
+    }
+    std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+    m_AsyncLoad->state = AsyncLoad::IDLE;
+    m_AsyncLoad->clearProperties();
+    m_AsyncLoad->clearPieces();
+}
+
+P3dProfiler::Stats P3dViewer::loadStats()
+{
+    return P3dProfiler::stats();
+}
+
+const char* P3dViewer::loadStatsJson()
+{
+    P3dProfiler::Stats stats = loadStats();
+    size_t length = P3dProfiler::toJson(stats, m_StatsJson, m_StatsJsonSize);
+    if(length >= m_StatsJsonSize)
+    {
+        delete [] m_StatsJson;
+        m_StatsJsonSize = length + 1;
+        m_StatsJson = new char[m_StatsJsonSize];
+        P3dProfiler::toJson(stats, m_StatsJson, m_StatsJsonSize);
+    }
+    return m_StatsJson;
+}
+
 void P3dViewer::clearModel()
 {
+    cancelAsyncLoad();
     m_ModelLoader->clear();
 
     PlatformAdapter::adapter->cancelTextureLoads();
@@ -472,6 +1374,13 @@ void P3dViewer::clearModel()
         PlatformAdapter::adapter->deleteTexture(material.specTexture);
     }
     m_Materials.clear();
+    m_RenderQueue.clear();
+    m_RenderQueueDirty = true;
+}
+
+LoadOptions &P3dViewer::loadOptions()
+{
+    return m_ModelLoader->options();
 }
 
 int P3dViewer::materialCount()
@@ -505,6 +1414,21 @@ void P3dViewer::parseColor(glm::vec3& color, const char *value)
 
 void P3dViewer::setMaterialProperty(int materialIndex, const char *property, const char *value)
 {
+    {
+        std::lock_guard<std::mutex> lock(m_AsyncLoad->mutex);
+        if(m_AsyncLoad->state == AsyncLoad::PARSING
+                || (m_AsyncLoad->state == AsyncLoad::STREAMING && !m_AsyncLoad->shown))
+        {
+            // loaders call this from the worker too, textures must load on the GL thread
+            AsyncLoad::Property item;
+            item.materialIndex = materialIndex;
+            item.property = copyString(property);
+            item.value = copyString(value);
+            m_AsyncLoad->properties.push_back(item);
+            return;
+        }
+    }
+
     if(materialIndex >= materialCount())
     {
         return;
@@ -525,6 +1449,7 @@ void P3dViewer::setMaterialProperty(int materialIndex, const char *property, con
         PlatformAdapter::adapter->loadTexture(url, [=,&material](uint32_t texId)
         {
             material.diffuseTexture = texId;
+            m_RenderQueueDirty = true;
             delete[] url;
         });
     }
@@ -548,6 +1473,7 @@ void P3dViewer::setMaterialProperty(int materialIndex, const char *property, con
         PlatformAdapter::adapter->loadTexture(url, [=,&material](uint32_t texId)
         {
             material.specTexture = texId;
+            m_RenderQueueDirty = true;
             delete[] url;
         });
     }
@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include "P3dVector.h"
 #include "IMaterialsInfo.h"
+#include "P3dProfiler.h"
 
 #define GLM_FORCE_RADIANS
 // vec3, vec4, ivec4, mat4
@@ -12,17 +13,15 @@
 typedef int GLint;
 typedef unsigned int GLuint;
 typedef unsigned int GLenum;
+typedef int GLsizei;
 
 class PlatformAdapter;
 class ModelLoader;
+struct LoadOptions;
 class CameraNavigation;
 
 class BlendData;
 
-const GLuint ATTRIB_POSITION = 0;
-const GLuint ATTRIB_NORMAL = 1;
-const GLuint ATTRIB_UV = 2;
-
 class P3dViewer: public IMaterialsInfo
 {
 public:
@@ -37,8 +36,46 @@ public:
     void drawFrame();
     void setUrlPrefix(const char* prefix);
     bool loadModel(const char* binaryData, size_t size, const char* extension);
+    //! \brief parses the model on a worker thread, drawFrame uploads it over the next frames
+    //! Call on the GL thread, binaryData must stay valid while isLoading() returns true.
+    //! Material properties set while parsing are applied when the model is ready.
+    bool loadModelAsync(const char* binaryData, size_t size, const char* extension);
+    //! \brief streamed load, for data that arrives in pieces, see BaseLoader::beginLoad
+    //! Call on the GL thread: beginModelLoad, appendModelData for every piece in order,
+    //! then finishModelLoad. Progressive loaders, like .p3d, have the model drawn
+    //! while it arrives, the others parse on a worker as the pieces come in and have
+    //! it drawn once it is complete. Those use LoadOptions::cacheModel and cacheNormals
+    //! once all data is there, unless LoadOptions::boundedStreaming drops it.
+    //! \arg totalSize bytes that will arrive, 0 if not known
+    bool beginModelLoad(const char* extension, size_t totalSize);
+    bool appendModelData(const char* data, size_t size);
+    //! \brief the last piece arrived, isLoading() returns true until the model is ready
+    bool finishModelLoad();
+    //! \brief true while an async or streamed load is in progress
+    bool isLoading();
+    //! \brief waits for a running async parse before clearing
     void clearModel();
+    //! \brief timings and counters of the last load, complete once isLoading() returns false
+    P3dProfiler::Stats loadStats();
+    //! \brief loadStats() as a JSON object, valid until the next call
+    const char* loadStatsJson();
+    //! \brief what the last drawFrame drew
+    struct FrameStats
+    {
+        uint32_t chunks = 0;
+        //! chunks outside the view frustum, not drawn
+        uint32_t culledChunks = 0;
+        uint32_t drawCalls = 0;
+        //! chunks drawn with one of their simplified index lists
+        uint32_t lodChunks = 0;
+        //! visible chunks left out because their data isn't uploaded yet
+        uint32_t loadingChunks = 0;
+    };
+    const FrameStats& frameStats() {return m_FrameStats;}
+    //! \brief simplified chunks are drawn while they are off by at most this many pixels, 1 by default
+    void setLodPixelError(float pixels) {m_LodPixelError = pixels;}
     CameraNavigation* cameraNavigation() {return m_CameraNavigation;}
+    LoadOptions& loadOptions();
 
     int materialCount();
     void setMaterialProperty(int materialIndex, const char* property, const char* value);
@@ -64,20 +101,100 @@ private:
     GLuint loadShaderFromFile(GLenum type, const char *shaderFile, const char *defines = 0);
     GLuint loadProgram(const char* vShaderFile, const char* fShaderFile, const char *defines = 0);
     GLint getUniform(GLuint program, const char* name);
+    bool hasUint32Indices();
+    bool hasVertexArrays();
+    bool hasMultiDraw();
     char* prefixUrl(const char* url);
+    void onModelLoaded();
+    void updateAsyncLoad();
+    void cancelAsyncLoad();
+    //! \brief sets the material properties queued during the load, or only drops them
+    void applyAsyncProperties(bool apply);
 
     ModelLoader* m_ModelLoader;
     CameraNavigation* m_CameraNavigation;
+    struct AsyncLoad;
+    AsyncLoad* m_AsyncLoad;
     char* m_UrlPrefix = nullptr;
+    char* m_StatsJson = nullptr;
+    size_t m_StatsJsonSize = 0;
 
     enum programs
     {
         BASIC = 0,
-        UVS = 1
+        UVS = 1,
+        BASIC_QUANTIZED = 2,
+        UVS_QUANTIZED = 3
     };
 
-    static const int programCount = 2;
-    GLuint m_Programs[programCount] = {0, 0};
+    static const int programCount = 4;
+    GLuint m_Programs[programCount] = {0, 0, 0, 0};
+
+    //! \brief uniform locations of a program, looked up once when it is linked
+    struct ProgramUniforms
+    {
+        GLint modelViewMatrix = -1;
+        GLint projectionMatrix = -1;
+        GLint viewMatrix = -1;
+        GLint normalMatrix = -1;
+        GLint directionalLightColor = -1;
+        GLint directionalLightDirection = -1;
+        GLint uDiffuseColor = -1;
+        GLint uSpecularColor = -1;
+        GLint uShininess = -1;
+        // programs with uvs
+        GLint enableDiffuse = -1;
+        GLint enableSpecular = -1;
+        // quantized programs
+        GLint uPosOffset = -1;
+        GLint uPosScale = -1;
+        GLint uUvOffset = -1;
+        GLint uUvScale = -1;
+    };
+    ProgramUniforms m_Uniforms[programCount];
+    void loadUniforms(programs program);
+
+    //! \brief chunk to draw, the render queue is sorted so state changes are rare
+    struct DrawItem
+    {
+        programs program;
+        GLuint diffuseTexture;
+        GLuint specTexture;
+        uint32_t material;
+        GLuint vertexBuffer;
+        GLuint vertexArray;
+        uint32_t chunk;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        //! set by the culling at the start of every frame
+        bool visible;
+        //! position in the front to back order of the visible chunks
+        uint32_t order;
+
+        //! \brief same state and vertex bank, the ranges of both can go in one draw call
+        bool sameBatch(const DrawItem& other) const
+        {
+            return program == other.program && diffuseTexture == other.diffuseTexture &&
+                    specTexture == other.specTexture && material == other.material &&
+                    vertexBuffer == other.vertexBuffer;
+        }
+    };
+    P3dVector<DrawItem> m_RenderQueue;
+    //! set when chunks, materials or textures change, drawFrame rebuilds the queue
+    bool m_RenderQueueDirty = true;
+    void buildRenderQueue();
+
+    //! index ranges of the batch being drawn, as many as the queue has items
+    GLsizei* m_DrawCounts = nullptr;
+    const void** m_DrawOffsets = nullptr;
+    bool m_MultiDraw = false;
+    uint32_t drawBatch(uint32_t first);
+    void cullRenderQueue(const glm::mat4& viewProj, const glm::vec3& eye);
+    //! DrawItem::order of every chunk, as many as the model has chunks
+    uint32_t* m_ChunkOrder = nullptr;
+    void selectLods(const glm::vec3& eye, float pixelsPerUnit);
+    float m_LodPixelError = 1.0f;
+    FrameStats m_FrameStats;
 
     P3dVector<P3dMaterial> m_Materials;
 
@@ -1,19 +1,64 @@
 #include "PlatformAdapter.h"
 #include <cstdio>
 #include <cstring>
+#include <atomic>
 
 #include <sys/time.h>
 
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 PlatformAdapter* PlatformAdapter::adapter = 0;
 
 static P3dLogger logger("core.PlatformAdapter", P3dLogger::LOG_DEBUG);
 
+//! \brief mapping fallback owning a heap copy of the data
+class HeapMappedFile: public MappedFile
+{
+public:
+    HeapMappedFile(const char* data, size_t size)
+    {
+        m_data = data;
+        m_size = size;
+    }
+
+    virtual ~HeapMappedFile()
+    {
+        delete [] m_data;
+    }
+};
+
+#ifndef _WIN32
+class PosixMappedFile: public MappedFile
+{
+public:
+    PosixMappedFile(void* addr, size_t size)
+    {
+        m_data = static_cast<const char*>(addr);
+        m_size = size;
+    }
+
+    virtual ~PosixMappedFile()
+    {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+};
+#endif
+
 PlatformAdapter::PlatformAdapter()
 {
 }
 
 PlatformAdapter::~PlatformAdapter()
 {
+    delete [] m_cacheDir;
 }
 
 void PlatformAdapter::loadTexture(const char *name, std::function<void(uint32_t)> callback)
@@ -61,6 +106,135 @@ const char *PlatformAdapter::loadAsset(const char *filename, size_t *size)
     return data;
 }
 
+MappedFile *PlatformAdapter::mapModel(const char *path)
+{
+    size_t size;
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        logger.error("Unable to map model: %s", path);
+        return 0;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        logger.error("Unable to map empty model: %s", path);
+        close(fd);
+        return 0;
+    }
+    size = st.st_size;
+    void* addr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if(addr != MAP_FAILED)
+    {
+        return new PosixMappedFile(addr, size);
+    }
+    logger.warning("mmap failed for %s, reading instead", path);
+#endif
+    // plain file read, subclasses may load assets from elsewhere
+    const char* data = PlatformAdapter::loadAsset(path, &size);
+    return data ? new HeapMappedFile(data, size) : 0;
+}
+
+void PlatformAdapter::setCacheDir(const char *path)
+{
+    delete [] m_cacheDir;
+    m_cacheDir = nullptr;
+    if(path)
+    {
+        m_cacheDir = new char[strlen(path) + 1];
+        strcpy(m_cacheDir, path);
+    }
+}
+
+const char *PlatformAdapter::loadCache(const char *key, size_t *size)
+{
+    if(!m_cacheDir)
+    {
+        return 0;
+    }
+    char* path = new char[strlen(m_cacheDir) + strlen(key) + 2];
+    sprintf(path, "%s/%s", m_cacheDir, key);
+    // a missing file is the normal cache miss, not an error
+    FILE* f = fopen(path, "rb");
+    delete [] path;
+    if(!f)
+    {
+        return 0;
+    }
+    fseek(f, 0L, SEEK_END);
+    long filesize = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+    char* data = filesize > 0 ? new char[filesize] : 0;
+    if(data && fread(data, filesize, 1, f) != 1)
+    {
+        delete [] data;
+        data = 0;
+    }
+    fclose(f);
+    *size = data ? filesize : 0;
+    return data;
+}
+
+bool PlatformAdapter::saveCache(const char *key, const char *data, size_t size)
+{
+    if(!m_cacheDir)
+    {
+        return false;
+    }
+    size_t length = strlen(m_cacheDir) + strlen(key) + 2;
+    char* path = new char[length];
+    // room for ".<pid>.<serial>.tmp"
+    char* tmpPath = new char[length + 26];
+    sprintf(path, "%s/%s", m_cacheDir, key);
+    // write aside and rename, so viewers loading at the same time never read half a file;
+    // the pid and serial keep processes and loader threads saving the same key off each other's file
+    static std::atomic<unsigned> serial(0);
+    sprintf(tmpPath, "%s.%u.%u.tmp", path, (unsigned)getpid(), serial++);
+    FILE* f = fopen(tmpPath, "wb");
+    bool ok = f != 0;
+    if(f)
+    {
+        ok = fwrite(data, size, 1, f) == 1;
+        ok = fclose(f) == 0 && ok;
+    }
+#ifdef _WIN32
+    // rename does not replace existing files on windows
+    if(ok) remove(path);
+#endif
+    ok = ok && rename(tmpPath, path) == 0;
+    if(!ok)
+    {
+        logger.warning("Unable to write cache: %s", path);
+        remove(tmpPath);
+    }
+    delete [] tmpPath;
+    delete [] path;
+    return ok;
+}
+
+MappedFile *PlatformAdapter::mapCache(const char *key)
+{
+    if(!m_cacheDir)
+    {
+        return 0;
+    }
+    char* path = new char[strlen(m_cacheDir) + strlen(key) + 2];
+    sprintf(path, "%s/%s", m_cacheDir, key);
+    MappedFile* file = 0;
+    // check first, mapModel logs missing files as errors
+    FILE* f = fopen(path, "rb");
+    if(f)
+    {
+        fclose(f);
+        file = mapModel(path);
+    }
+    delete [] path;
+    return file;
+}
+
 void PlatformAdapter::logFunc(P3dLogger::Level level, const char *func, const char *format, ...)
 {
     va_list args;
@@ -10,6 +10,28 @@
 
 #define GL_CHECK_ERROR {GLenum err = glGetError(); if(err != GL_NO_ERROR) P3D_LOGE("%s:%d ogl error: 0x%x", __FILE__, __LINE__, err);}
 
+//! \brief read only view of a file's data, see PlatformAdapter::mapModel
+//! Deleting the handle releases the mapping, data() is invalid after that.
+class MappedFile
+{
+public:
+    virtual ~MappedFile() {}
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+protected:
+    MappedFile() {}
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+
+private:
+    // disable copy ctor
+    MappedFile(const MappedFile&);
+    // disable assignment
+    MappedFile& operator=(const MappedFile&);
+};
+
 class PlatformAdapter
 {
 public:
@@ -32,6 +54,34 @@ public:
     //! \return loaded data or 0 on error. Caller is responsible for freeing data
     virtual const char* loadAsset(const char* filename, size_t *size = 0);
 
+    //! \brief map a model file from the file system read only
+    //! The data can be passed to P3dViewer::loadModel, loaders parse it in place.
+    //! \arg path file system path of the model
+    //! \return mapping or 0 on error. Caller deletes the mapping to release it
+    virtual MappedFile* mapModel(const char* path);
+
+    //! \brief directory the default loadCache and saveCache keep their files in
+    //! \arg path existing directory or 0 to disable caching (default)
+    void setCacheDir(const char* path);
+    const char* cacheDir() { return m_cacheDir; }
+
+    //! \brief load data stored with saveCache, e.g. generated normals
+    //! Called from the loader thread during async loads.
+    //! \arg key file name safe key
+    //! \arg size pointer to receive size of data
+    //! \return data or 0 if nothing is cached for key. Caller is responsible for freeing data
+    virtual const char* loadCache(const char* key, size_t* size);
+
+    //! \brief store data for later loads, replaces what was stored for key
+    //! Called from the loader thread during async loads.
+    //! \return false if the data could not be stored
+    virtual bool saveCache(const char* key, const char* data, size_t size);
+
+    //! \brief map data stored with saveCache read only, e.g. cached models
+    //! Called from the loader thread during async loads.
+    //! \return mapping or 0 if nothing is cached for key. Caller deletes the mapping to release it
+    virtual MappedFile* mapCache(const char* key);
+
     //! \brief writes out a printf formattet log messages
     //! \arg level severity level
     //! \arg func pretty function info of caller (__PRETTY_FUNCTION__)
@@ -54,6 +104,9 @@ public:
 
 protected:
     virtual uint64_t _currentMillis();
+
+private:
+    char* m_cacheDir = nullptr;
 };
 
 #endif // PLATFORMADAPTER_H
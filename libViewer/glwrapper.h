@@ -1,3 +1,9 @@
+#ifdef P3D_STUB_GL
+// headless builds without a GPU, the gl* functions are defined in P3dStubGL.cpp
+#define GLCOREARB_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif //P3D_STUB_GL
+
 #ifdef __EMSCRIPTEN__
 #include <GLES2/gl2.h>
 #endif //__EMSCRIPTEN__
@@ -26,6 +32,54 @@
 
 #endif //QT_GUI_LIB
 
+// vertex array objects, core in GL 3 and GLES 3, OES_vertex_array_object on GLES 2 and WebGL 1
+// P3D_VERTEX_ARRAYS is 0 where the viewer always sets up attributes per draw
+#if defined(P3D_STUB_GL) || (defined(QT_GUI_LIB) && !defined(QT_OPENGL_ES_2))
+#define P3D_VERTEX_ARRAYS 1
+#define p3dGenVertexArrays glGenVertexArrays
+#define p3dBindVertexArray glBindVertexArray
+#define p3dDeleteVertexArrays glDeleteVertexArrays
+#elif defined(__EMSCRIPTEN__)
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GLES2/gl2ext.h>
+#define P3D_VERTEX_ARRAYS 1
+#define p3dGenVertexArrays glGenVertexArraysOES
+#define p3dBindVertexArray glBindVertexArrayOES
+#define p3dDeleteVertexArrays glDeleteVertexArraysOES
+#elif defined(__ANDROID__)
+#include <GLES2/gl2ext.h>
+#define P3D_VERTEX_ARRAYS 1
+// GLES 2 libraries don't export them, P3dViewer::hasVertexArrays looks them up
+extern PFNGLGENVERTEXARRAYSOESPROC p3dGenVertexArrays;
+extern PFNGLBINDVERTEXARRAYOESPROC p3dBindVertexArray;
+extern PFNGLDELETEVERTEXARRAYSOESPROC p3dDeleteVertexArrays;
+#else
+#define P3D_VERTEX_ARRAYS 0
+#endif
+
+// several index ranges in one call, GL 1.4 core, WEBGL_multi_draw and EXT_multi_draw_arrays
+// P3D_MULTI_DRAW is 0 where the viewer draws the ranges one by one
+#if defined(P3D_STUB_GL) || (defined(QT_GUI_LIB) && !defined(QT_OPENGL_ES_2))
+#define P3D_MULTI_DRAW 1
+#define p3dMultiDrawElements glMultiDrawElements
+#elif defined(__EMSCRIPTEN__) && defined(__has_include)
+#if __has_include(<webgl/webgl1_ext.h>)
+#include <webgl/webgl1_ext.h>
+#define P3D_MULTI_DRAW 1
+#define p3dMultiDrawElements glMultiDrawElementsWEBGL
+#else
+#define P3D_MULTI_DRAW 0
+#endif
+#elif defined(__ANDROID__)
+#define P3D_MULTI_DRAW 1
+// looked up by P3dViewer::hasMultiDraw like the vertex array functions
+extern PFNGLMULTIDRAWELEMENTSEXTPROC p3dMultiDrawElements;
+#else
+#define P3D_MULTI_DRAW 0
+#endif
+
 #ifndef GL_DEPTH_BITS
 #define GL_DEPTH_BITS                     0x0D56
 #endif
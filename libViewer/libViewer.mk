@@ -0,0 +1,105 @@
+# libViewer, the blend parser and zlib for the command line tools (p3d-bench, p3d-convert)
+# The including Makefile sets TARGET, DEFINES and optionally TOOL_SOURCES, the
+# libViewer files only it needs, then includes this from its own directory.
+
+OPTIMIZE = -O2
+
+GLM_DIR = ../ext/glm
+
+INCLUDE_DIRS = \
+    -I../libViewer\
+    -I$(GLM_DIR)\
+    -I../libViewer/P3dConverter/File\
+    -I../libViewer/P3dConverter/FileFormats\
+    -I../libViewer/P3dConverter/FileFormats/Blend\
+    -I../libViewer/P3dConverter/FileFormats/Blend/Generated\
+    -I../libViewer/P3dConverter/P3dConvert\
+    -I../libViewer/P3dConverter/zlib
+
+LIBVIEWER_DIR = ../libViewer
+
+WARNINGS = -Wno-narrowing
+
+CFLAGS = -I. $(INCLUDE_DIRS) $(DEFINES) $(OPTIMIZE)
+CXXFLAGS = -I. $(INCLUDE_DIRS) $(DEFINES) -Wall -Wextra $(WARNINGS) -std=c++11 $(OPTIMIZE)
+LDFLAGS = -pthread
+
+LIBVIEWER_SOURCES = \
+    PlatformAdapter.cpp \
+    P3dLogger.cpp \
+    ModelLoader.cpp \
+    BaseLoader.cpp \
+    BinLoader.cpp \
+    P3dParallel.cpp \
+    P3dProfiler.cpp \
+    P3dStubGL.cpp \
+    MeshOptimizer.cpp \
+    MeshSimplifier.cpp \
+    NormalGenerator.cpp \
+    P3dLoader.cpp \
+    P3dBvh.cpp \
+    BlendLoader.cpp
+
+ZLIB_DIR = ../libViewer/P3dConverter/zlib
+ZLIB_SOURCES = \
+    adler32.c \
+    compress.c \
+    crc32.c \
+    deflate.c \
+    gzclose.c \
+    gzlib.c \
+    gzread.c \
+    gzwrite.c \
+    infback.c \
+    inffast.c \
+    inflate.c \
+    inftrees.c \
+    trees.c \
+    uncompr.c \
+    zutil.c
+
+P3DCONVERTER_DIR = ../libViewer/P3dConverter
+P3DCONVERTER_SOURCES = \
+    fbtBuilder.cpp \
+    fbtFile.cpp \
+    fbtStreams.cpp \
+    fbtTables.cpp \
+    fbtTypes.cpp \
+    fbtBlend.cpp \
+    bfBlender.cpp \
+    p3dConvert.cpp
+
+
+SOURCES = \
+    main.cpp \
+    $(TOOL_SOURCES) $(LIBVIEWER_SOURCES) $(ZLIB_SOURCES) $(P3DCONVERTER_SOURCES)
+OBJECTS = $(patsubst %.c, %.o, $(SOURCES:.cpp=.o))
+VPATH = \
+    $(LIBVIEWER_DIR) \
+    $(ZLIB_DIR) \
+    $(P3DCONVERTER_DIR)/File \
+    $(P3DCONVERTER_DIR)/FileFormats \
+    $(P3DCONVERTER_DIR)/FileFormats/Blend \
+    $(P3DCONVERTER_DIR)/FileFormats/Blend/Generated \
+    $(P3DCONVERTER_DIR)/P3dConvert
+
+MAKEFILES_USED = Makefile $(LIBVIEWER_DIR)/libViewer.mk
+
+# Targets start here.
+all: $(TARGET)
+
+$(TARGET): $(OBJECTS) $(MAKEFILES_USED) deps.txt
+	$(CXX) -o $@ $(OBJECTS) $(LDFLAGS)
+
+clean:
+	$(RM) $(TARGET) $(OBJECTS) deps.txt
+
+deps.txt: $(SOURCES) $(MAKEFILES_USED)
+	@$(CXX) $(CXXFLAGS) -MM $(filter-out $(MAKEFILES_USED), $^) > $@
+
+# list targets that do not create files (but not all makes understand .PHONY)
+.PHONY:	all clean
+
+$(OBJECTS): $(MAKEFILES_USED)
+
+-include deps.txt
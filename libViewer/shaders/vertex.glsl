@@ -5,9 +5,19 @@ precision mediump float;
 #endif
 
 attribute vec3 aPosition;
+#ifdef QUANTIZED
+attribute vec2 aNormal;
+uniform vec3 uPosOffset;
+uniform vec3 uPosScale;
+#else
 attribute vec3 aNormal;
+#endif
 #ifdef HAS_UV
 attribute vec2 aUv;
+#ifdef QUANTIZED
+uniform vec2 uUvOffset;
+uniform vec2 uUvScale;
+#endif
 #endif
 
 uniform mat4 uMVP;
@@ -19,16 +29,39 @@ varying vec2 vUv;
 varying vec3 vNormal;
 varying vec3 vViewPosition;
 
+#ifdef QUANTIZED
+// inverse of the octahedral normal encoding in ModelLoader::quantizeVertices
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * (step(0.0, n.xy) * 2.0 - 1.0);
+    }
+    return normalize(n);
+}
+#endif
+
 void main(void)
 {
+#ifdef QUANTIZED
+    vec3 position = uPosOffset + uPosScale * aPosition;
+    vNormal = normalMatrix * octDecode(aNormal);
+#else
+    vec3 position = aPosition;
     vNormal = normalMatrix * aNormal;
+#endif
 #ifdef HAS_UV
+#ifdef QUANTIZED
+    vUv = uUvOffset + uUvScale * aUv;
+#else
     vUv = aUv;
+#endif
 #else
     vUv = vec2(0.0, 0.0);
 #endif
 
-    vec4 mvPosition = modelViewMatrix * vec4( aPosition, 1.0 );
+    vec4 mvPosition = modelViewMatrix * vec4( position, 1.0 );
     vViewPosition = -mvPosition.xyz;
 
     gl_Position = projectionMatrix * mvPosition;
@@ -5,15 +5,27 @@ include $(CLEAR_VARS)
 LOCAL_MODULE    := p3dviewer
 LOCAL_C_INCLUDES:= $(LOCAL_PATH)/../../libViewer $(LOCAL_PATH)/../../ext/glm
 LOCAL_CFLAGS    := -Wall -Wextra -std=c++0x -g
+# P3dSimd.h uses NEON for normal generation, x86 has SSE2 already
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_ARM_NEON  := true
+endif
 LOCAL_SRC_FILES := \
 	../../libViewer/PlatformAdapter.cpp \
 	../../libViewer/P3dViewer.cpp \
 	../../libViewer/ModelLoader.cpp \
 	../../libViewer/BaseLoader.cpp \
 	../../libViewer/BinLoader.cpp \
+	../../libViewer/P3dParallel.cpp \
+	../../libViewer/P3dProfiler.cpp \
+	../../libViewer/MeshOptimizer.cpp \
+	../../libViewer/MeshSimplifier.cpp \
+	../../libViewer/NormalGenerator.cpp \
+	../../libViewer/P3dLoader.cpp \
 	../../libViewer/CameraNavigation.cpp \
+	../../libViewer/P3dFrustum.cpp \
+	../../libViewer/P3dBvh.cpp \
 	jni_stub.cpp \
 	AndroidPlatformAdapter.cpp
-LOCAL_LDLIBS	:= -lGLESv2 -llog -landroid
+LOCAL_LDLIBS	:= -lGLESv2 -lEGL -llog -landroid
 
 include $(BUILD_SHARED_LIBRARY)
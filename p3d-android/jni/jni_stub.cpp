@@ -4,6 +4,7 @@
 #include <android/asset_manager_jni.h>
 
 #include "P3dViewer.h"
+#include "BaseLoader.h"
 #include "CameraNavigation.h"
 #include "AndroidPlatformAdapter.h"
 
@@ -24,6 +25,10 @@ JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_on_1surface_1creat
 	(void)cls;
 
 	LOGD("surfaceCreated");
+	// quantized attributes cut vertex memory and bandwidth on phones
+	viewer.loadOptions().quantizeAttributes = true;
+	// low end GPUs are bound by vertex shading on dense models
+	viewer.loadOptions().optimizeVertexCache = true;
 	viewer.onSurfaceCreated();
 }
 
@@ -60,17 +65,36 @@ JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_init_1asset_1manag
 	adapter->setAssetManager(mgr);
 }
 
-JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_load_1model(JNIEnv* env,
-		jclass cls, jobject buf, jint size, jstring extension) {
+JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_begin_1model_1load(JNIEnv* env,
+		jclass cls, jstring extension, jint size) {
 	// unused
 	(void)cls;
 
-	const char* data = (const char*) env->GetDirectBufferAddress(buf);
 	const char *c_extension = env->GetStringUTFChars(extension, 0);
-	viewer.loadModel(data, size, c_extension);
+	viewer.beginModelLoad(c_extension, size);
 	env->ReleaseStringUTFChars(extension, c_extension);
 }
 
+JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_append_1model_1data(JNIEnv* env,
+		jclass cls, jbyteArray data, jint size) {
+	// unused
+	(void)cls;
+
+	// the viewer copies what it keeps, the array goes back unchanged
+	jbyte* bytes = env->GetByteArrayElements(data, 0);
+	viewer.appendModelData((const char*) bytes, size);
+	env->ReleaseByteArrayElements(data, bytes, JNI_ABORT);
+}
+
+JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_finish_1model_1load(JNIEnv* env,
+		jclass cls) {
+	// unused
+	(void)env;
+	(void)cls;
+
+	viewer.finishModelLoad();
+}
+
 JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_start_1rotate_1cam
   (JNIEnv *env, jclass cls, jfloat x, jfloat y) {
 	// unused
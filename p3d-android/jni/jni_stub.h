@@ -41,11 +41,27 @@ JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_init_1asset_1manag
 
 /*
  * Class:     in_p3d_mobile_P3dViewerJNIWrapper
- * Method:    load_model
- * Signature: (Ljava/nio/ByteBuffer;ILjava/lang/String;)V
+ * Method:    begin_model_load
+ * Signature: (Ljava/lang/String;I)V
  */
-JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_load_1model
-  (JNIEnv *, jclass, jobject, jint, jstring);
+JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_begin_1model_1load
+  (JNIEnv *, jclass, jstring, jint);
+
+/*
+ * Class:     in_p3d_mobile_P3dViewerJNIWrapper
+ * Method:    append_model_data
+ * Signature: ([BI)V
+ */
+JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_append_1model_1data
+  (JNIEnv *, jclass, jbyteArray, jint);
+
+/*
+ * Class:     in_p3d_mobile_P3dViewerJNIWrapper
+ * Method:    finish_model_load
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_in_p3d_mobile_P3dViewerJNIWrapper_finish_1model_1load
+  (JNIEnv *, jclass);
 
 /*
  * Class:     in_p3d_mobile_P3dViewerJNIWrapper
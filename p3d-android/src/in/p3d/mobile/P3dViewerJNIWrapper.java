@@ -1,7 +1,5 @@
 package in.p3d.mobile;
 
-import java.nio.ByteBuffer;
-
 import android.content.res.AssetManager;
 import android.util.Log;
 
@@ -25,7 +23,11 @@ public class P3dViewerJNIWrapper {
     
     public static native void init_asset_manager(AssetManager am);
     
-    public static native void load_model(ByteBuffer data, int size, String extension);
+    public static native void begin_model_load(String extension, int size);
+    
+    public static native void append_model_data(byte[] data, int size);
+    
+    public static native void finish_model_load();
     
     public static native void start_rotate_cam(float x, float y);
     
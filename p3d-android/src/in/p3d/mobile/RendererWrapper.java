@@ -1,6 +1,6 @@
 package in.p3d.mobile;
 
-import java.nio.ByteBuffer;
+import java.util.ArrayList;
 
 import javax.microedition.khronos.egl.EGLConfig;
 import javax.microedition.khronos.opengles.GL10;
@@ -8,9 +8,15 @@ import javax.microedition.khronos.opengles.GL10;
 import android.opengl.GLSurfaceView.Renderer;
 
 public class RendererWrapper implements Renderer {
-	private ByteBuffer modelData = null;
 	private String extension = ".bin";
 	
+	// streamed model data, handed to the viewer on the GL thread
+	private Object loadMutex = new Object();
+	private int modelSize;
+	private ArrayList<byte[]> modelPieces = new ArrayList<byte[]>();
+	private boolean doBeginLoad = false;
+	private boolean doFinishLoad = false;
+	
 	private Object rotateMutex = new Object();
 	private float rotateX;
 	private float rotateY;
@@ -19,8 +25,25 @@ public class RendererWrapper implements Renderer {
 	private boolean doRotateCam = false;
 	private boolean doStartRotateCam = false;
 
-	public void loadModel(ByteBuffer data) {
-		modelData = data;
+	public void beginModelLoad(int size) {
+		synchronized (loadMutex) {
+			modelSize = size;
+			modelPieces.clear();
+			doBeginLoad = true;
+			doFinishLoad = false;
+		}
+	}
+
+	public void appendModelData(byte[] data) {
+		synchronized (loadMutex) {
+			modelPieces.add(data);
+		}
+	}
+
+	public void finishModelLoad() {
+		synchronized (loadMutex) {
+			doFinishLoad = true;
+		}
 	}
 	
 	public void startRotateCam(float x, float y) {
@@ -51,9 +74,19 @@ public class RendererWrapper implements Renderer {
  
     @Override
     public void onDrawFrame(GL10 gl) {
-    	if(modelData != null) {
-    		P3dViewerJNIWrapper.load_model(modelData, modelData.limit(), extension);
-    		modelData = null;
+    	synchronized (loadMutex) {
+    		if(doBeginLoad) {
+    			doBeginLoad = false;
+    			P3dViewerJNIWrapper.begin_model_load(extension, Math.max(modelSize, 0));
+    		}
+    		for(byte[] piece: modelPieces) {
+    			P3dViewerJNIWrapper.append_model_data(piece, piece.length);
+    		}
+    		modelPieces.clear();
+    		if(doFinishLoad) {
+    			doFinishLoad = false;
+    			P3dViewerJNIWrapper.finish_model_load();
+    		}
     	}
     	synchronized (rotateMutex) {
     		if(doStartRotateCam) {
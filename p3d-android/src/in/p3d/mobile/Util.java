@@ -6,8 +6,7 @@ import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.net.HttpURLConnection;
 import java.net.URL;
-import java.nio.ByteBuffer;
-import java.util.ArrayList;
+import java.util.Arrays;
 
 import org.json.JSONException;
 import org.json.JSONObject;
@@ -61,9 +60,16 @@ public class Util {
 		return jsonObject;
 	}
 	
-	public static ByteBuffer getBinary(String url) {
+	public interface BinaryListener {
+		// size is -1 when the server doesn't send it
+		void onBegin(int size);
+		void onData(byte[] data);
+		void onFinish();
+	}
+
+	// hands the data to listener piece by piece while it downloads
+	public static boolean streamBinary(String url, BinaryListener listener) {
 		InputStream is = null;
-		ByteBuffer data = null;
 		
 		// HTTP
 		HttpURLConnection urlConnection;
@@ -71,39 +77,31 @@ public class Util {
 			urlConnection = (HttpURLConnection) new URL(url).openConnection();
 			try {
 				is = new BufferedInputStream(urlConnection.getInputStream());
+				listener.onBegin(urlConnection.getContentLength());
 				
-				int totalLen = 0;
 				int len;
-				ArrayList<byte[]> chunks = new ArrayList<byte[]>();
 				while(true) {
 					byte[] temp = new byte[16384];
 					len = is.read(temp);
 					if(len <= 0) {
 						break;
 					}
-					totalLen += len;
-					chunks.add(temp);
-				}
-				
-				data = ByteBuffer.allocateDirect(totalLen);
-				for(byte[] temp: chunks) {
-					data.put(temp, 0, Math.min(totalLen, temp.length));
-					totalLen -= temp.length;
+					listener.onData(len < temp.length ? Arrays.copyOf(temp, len) : temp);
 				}
+				listener.onFinish();
 				
 				is.close();
 			} catch(Exception e) {
 				Log.e(TAG, "error", e);
-				return null;
+				return false;
 			} finally {
 				urlConnection.disconnect();
 			}
 		} catch (Exception e) {
 			Log.e(TAG, "error", e);
-			return null;
+			return false;
 		}
 
-   
-		return data;
+		return true;
 	}
 }
@@ -1,7 +1,5 @@
 package in.p3d.mobile;
 
-import java.nio.ByteBuffer;
-
 import org.json.JSONException;
 import org.json.JSONObject;
 
@@ -143,26 +141,37 @@ public class ViewerActivity extends Activity {
 
 	private void loadBinary(String binUrl) {
 		Log.d(TAG, "Loading binary: " + binUrl);
-		AsyncTask<String, Void, ByteBuffer> asyncTask = new AsyncTask<String, Void, ByteBuffer>() {
+		final RendererWrapper renderer = glSurfaceView.getRenderer();
+		AsyncTask<String, Void, Boolean> asyncTask = new AsyncTask<String, Void, Boolean>() {
 			@Override
-			protected ByteBuffer doInBackground(String... urls) {
-				return Util.getBinary(urls[0]);
+			protected Boolean doInBackground(String... urls) {
+				// the viewer parses while the rest downloads
+				return Util.streamBinary(urls[0], new Util.BinaryListener() {
+					@Override
+					public void onBegin(int size) {
+						renderer.beginModelLoad(size);
+					}
+
+					@Override
+					public void onData(byte[] data) {
+						renderer.appendModelData(data);
+					}
+
+					@Override
+					public void onFinish() {
+						renderer.finishModelLoad();
+					}
+				});
 			}
 
 			@Override
-			protected void onPostExecute(ByteBuffer result) {
-				if (result == null) {
+			protected void onPostExecute(Boolean result) {
+				if (!result) {
 					// TODO: error msg
 					return;
 				}
-				try {
-					Log.d(TAG, "Got binary: " + result.limit());
-					loadingDialog.cancel();
-					glSurfaceView.getRenderer().loadModel(result);
-				} catch (Exception e) {
-					// TODO Auto-generated catch block
-					e.printStackTrace();
-				}
+				Log.d(TAG, "Got binary");
+				loadingDialog.cancel();
 			}
 		};
 		asyncTask.execute(binUrl);		
@@ -0,0 +1,585 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "PlatformAdapter.h"
+#include "BaseLoader.h"
+#include "ModelLoader.h"
+#include "IMaterialsInfo.h"
+#include "P3dProfiler.h"
+#include "P3dViewer.h"
+#include "P3dStubGL.h"
+#include "CameraNavigation.h"
+
+// p3d-bench: times the loaders and the ModelLoader CPU stages without a GPU,
+// with --frames also drawFrame() on the recording GL stub
+
+#ifndef P3D_BENCH_ASSETS
+#define P3D_BENCH_ASSETS "."
+#endif
+
+//! \brief keeps stdout for results, only warnings and errors go to stderr
+class BenchPlatformAdapter: public PlatformAdapter
+{
+public:
+    //! \brief shaders are loaded relative to P3D_BENCH_ASSETS, the libViewer dir
+    const char* loadAsset(const char* filename, size_t* size) override
+    {
+        std::string path = std::string(P3D_BENCH_ASSETS) + "/" + filename;
+        return PlatformAdapter::loadAsset(path.c_str(), size);
+    }
+
+    void logTag(P3dLogger::Level level, const char* tag, const char* format, va_list args) override
+    {
+        if(level > P3dLogger::LOG_WARN)
+        {
+            return;
+        }
+        fprintf(stderr, "%s: ", tag);
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+    }
+};
+
+//! \brief the bench has no materials, loaders may still set properties
+class NullMaterialsInfo: public IMaterialsInfo
+{
+public:
+    void setMaterialProperty(int, const char*, const char*) override {}
+};
+
+struct BenchOptions
+{
+    int warmup = 2;
+    int iterations = 10;
+    bool json = false;
+    const char* output = 0;
+    bool uint32Indices = false;
+    bool multiDraw = false;
+    int frames = 0;
+    float zoom = 0.0f;
+    float lodPixelError = 1.0f;
+    size_t streamPiece = 0;
+    const char* glLog = 0;
+    const char* cacheDir = 0;
+    LoadOptions loadOptions;
+};
+
+struct FileResult
+{
+    const char* path;
+    size_t size = 0;
+    bool ok = false;
+    // samples[iteration] of total wall time and every stage, in ns
+    std::vector<uint64_t> totalNanos;
+    std::vector<P3dProfiler::Stats> stats;
+    // --frames, GL counts are the same every frame so only the last one is kept
+    bool rendered = false;
+    std::vector<uint64_t> frameNanos;
+    P3dViewer::FrameStats frameStats;
+    // --stream, bytes that had arrived when the first frame drew something
+    size_t firstDrawBytes = 0;
+    P3dStubGL::FrameStats loadGl = P3dStubGL::FrameStats();
+    P3dStubGL::FrameStats frameGl = P3dStubGL::FrameStats();
+    P3dStubGL::MemoryStats memory = P3dStubGL::MemoryStats();
+};
+
+static const char* const WEIGHTING_NAMES[] = {"uniform", "area", "angle"};
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: p3d-bench [options] model.bin|model.blend|model.p3d...\n"
+            "  -w N              warmup loads per file (default 2)\n"
+            "  -n N              measured loads per file (default 10)\n"
+            "  --json            machine readable output\n"
+            "  -o FILE           write results to FILE, the blend parser prints to stdout\n"
+            "  --uint32-indices  load as for contexts with 32 bit indices\n"
+            "  --parallel        LoadOptions::parallelReindex\n"
+            "  --quantize        LoadOptions::quantizeAttributes\n"
+            "  --optimize        LoadOptions::optimizeVertexCache\n"
+            "  --weighting W     LoadOptions::normalWeighting, uniform, area or angle\n"
+            "  --crease DEG      LoadOptions::creaseAngle\n"
+            "  --clusters N      LoadOptions::clusterTriangles, clusters of at most N triangles\n"
+            "  --lods N          LoadOptions::lodLevels, simplified index lists per chunk\n"
+            "  --lod-error PX    P3dViewer::setLodPixelError, pixels a drawn LOD may be off by\n"
+            "  --cache-dir DIR   LoadOptions::cacheNormals with the cache in DIR, warmup loads fill it\n"
+            "  --cache-model     LoadOptions::cacheModel too, needs --cache-dir\n"
+            "  --frames N        also load into a P3dViewer and time N drawFrame calls\n"
+            "  --gl-log FILE     write the GL calls of the last frame to FILE\n"
+            "  --multi-draw      draw as for contexts with EXT_multi_draw_arrays\n"
+            "  --zoom F          CameraNavigation::zoom(F) before drawing, 0.9 and up gets close\n"
+            "  --stream BYTES    load with --frames through the streamed API in pieces of BYTES,\n"
+            "                    drawing a frame after each, firstDrawBytes is when one drew something\n"
+            "  --bounded         LoadOptions::boundedStreaming, for --stream\n");
+}
+
+//! \brief nearest rank percentile of unsorted samples
+static uint64_t percentile(std::vector<uint64_t> samples, int percent)
+{
+    if(samples.empty())
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t rank = (samples.size() * percent + 99) / 100;
+    return samples[rank ? rank - 1 : 0];
+}
+
+static bool loadOnce(const BenchOptions& options, BaseLoader* loader, const MappedFile* file,
+                     uint64_t& totalNanos, P3dProfiler::Stats& stats)
+{
+    NullMaterialsInfo materials;
+    ModelLoader modelLoader(&materials);
+    modelLoader.options() = options.loadOptions;
+    modelLoader.setUint32Indices(options.uint32Indices);
+    loader->setModelLoader(&modelLoader);
+
+    P3dProfiler::reset();
+    uint64_t start = P3dProfiler::nowNanos();
+    modelLoader.setSourceData(file->data(), file->size());
+    bool ok = modelLoader.loadModelCache();
+    if(!ok)
+    {
+        {
+            P3dProfiler::Scope scope(P3dProfiler::STAGE_PARSE);
+            ok = loader->load(file->data(), file->size());
+        }
+        if(ok) modelLoader.saveModelCache();
+    }
+    totalNanos = P3dProfiler::nowNanos() - start;
+    stats = P3dProfiler::stats();
+    return ok;
+}
+
+//! \brief loads the file into a viewer on the stub GL and draws options.frames frames
+static bool renderFile(const BenchOptions& options, const MappedFile* file, FILE* glLog, FileResult& result)
+{
+    P3dStubGL::reset();
+    P3dStubGL::setVersion(options.uint32Indices ? "OpenGL ES 3.0" : "OpenGL ES 2.0");
+    P3dStubGL::setExtensions(options.multiDraw ? "GL_EXT_multi_draw_arrays" : "");
+
+    // the viewer takes over the global adapter and deletes it
+    PlatformAdapter* adapter = PlatformAdapter::adapter;
+    BenchPlatformAdapter* viewerAdapter = new BenchPlatformAdapter();
+    viewerAdapter->setCacheDir(options.cacheDir);
+    P3dViewer* viewer = new P3dViewer(viewerAdapter);
+    viewer->loadOptions() = options.loadOptions;
+    viewer->setLodPixelError(options.lodPixelError);
+    viewer->onSurfaceCreated();
+    viewer->onSurfaceChanged(1280, 720);
+
+    P3dStubGL::beginFrame();
+    bool ok;
+    if(options.streamPiece)
+    {
+        // a slow download, frames keep coming while the pieces arrive
+        ok = viewer->beginModelLoad(strrchr(result.path, '.'), file->size());
+        for(size_t offset = 0; ok && offset < file->size(); offset += options.streamPiece)
+        {
+            size_t piece = std::min(options.streamPiece, file->size() - offset);
+            ok = viewer->appendModelData(file->data() + offset, piece);
+            P3dStubGL::beginFrame();
+            viewer->drawFrame();
+            if(!result.firstDrawBytes && P3dStubGL::frameStats().drawnIndices)
+            {
+                result.firstDrawBytes = offset + piece;
+            }
+        }
+        ok = ok && viewer->finishModelLoad();
+        while(ok && viewer->isLoading())
+        {
+            P3dStubGL::beginFrame();
+            viewer->drawFrame();
+        }
+        // failed parses only log, a created model has counted its chunks
+        ok = ok && viewer->loadStats().counters[P3dProfiler::COUNTER_CHUNKS];
+    }
+    else
+    {
+        ok = viewer->loadModel(file->data(), file->size(), strrchr(result.path, '.'));
+    }
+    result.loadGl = P3dStubGL::frameStats();
+    if(ok && options.zoom != 0.0f)
+    {
+        viewer->cameraNavigation()->zoom(options.zoom);
+    }
+
+    for(int i = 0; i < options.frames && ok; ++i)
+    {
+        bool last = i == options.frames - 1;
+        P3dStubGL::setRecording(glLog && last);
+        P3dStubGL::beginFrame();
+        uint64_t start = P3dProfiler::nowNanos();
+        viewer->drawFrame();
+        result.frameNanos.push_back(P3dProfiler::nowNanos() - start);
+        result.frameGl = P3dStubGL::frameStats();
+        result.frameStats = viewer->frameStats();
+    }
+    P3dStubGL::setRecording(false);
+    result.memory = P3dStubGL::memoryStats();
+    if(glLog)
+    {
+        fprintf(glLog, "# %s\n", result.path);
+        P3dStubGL::writeCommands(glLog);
+        P3dStubGL::clearCommands();
+    }
+
+    delete viewer;
+    PlatformAdapter::adapter = adapter;
+    return ok;
+}
+
+static void benchFile(const BenchOptions& options, FILE* glLog, FileResult& result)
+{
+    const char* extension = strrchr(result.path, '.');
+    BaseLoader* loader = extension ? BaseLoader::loaderFromExtension(extension) : 0;
+    if(!loader)
+    {
+        fprintf(stderr, "%s: unsupported extension\n", result.path);
+        return;
+    }
+    MappedFile* file = PlatformAdapter::adapter->mapModel(result.path);
+    if(!file)
+    {
+        fprintf(stderr, "%s: can't map file\n", result.path);
+        return;
+    }
+    result.size = file->size();
+
+    uint64_t totalNanos;
+    P3dProfiler::Stats stats;
+    result.ok = true;
+    for(int i = 0; i < options.warmup + options.iterations && result.ok; ++i)
+    {
+        result.ok = loadOnce(options, loader, file, totalNanos, stats);
+        if(i >= options.warmup)
+        {
+            result.totalNanos.push_back(totalNanos);
+            result.stats.push_back(stats);
+        }
+    }
+    if(result.ok && options.frames > 0)
+    {
+        result.rendered = renderFile(options, file, glLog, result);
+        result.ok = result.rendered;
+    }
+    if(!result.ok)
+    {
+        fprintf(stderr, "%s: load failed\n", result.path);
+    }
+    delete file;
+}
+
+static std::vector<uint64_t> stageSamples(const FileResult& result, int stage)
+{
+    std::vector<uint64_t> samples;
+    for(const P3dProfiler::Stats& stats: result.stats)
+    {
+        samples.push_back(stats.stageNanos[stage]);
+    }
+    return samples;
+}
+
+static void printText(FILE* out, const std::vector<FileResult>& results)
+{
+    for(const FileResult& result: results)
+    {
+        fprintf(out, "%s: %zu bytes%s\n", result.path, result.size, result.ok ? "" : ", FAILED");
+        if(!result.ok)
+        {
+            continue;
+        }
+        fprintf(out, "  %-20s %12s %12s\n", "stage", "p50 ms", "p95 ms");
+        fprintf(out, "  %-20s %12.3f %12.3f\n", "total",
+                percentile(result.totalNanos, 50) / 1e6, percentile(result.totalNanos, 95) / 1e6);
+        for(int stage = 0; stage < P3dProfiler::STAGE_COUNT; ++stage)
+        {
+            if(!result.stats.back().stageCalls[stage])
+            {
+                continue;
+            }
+            std::vector<uint64_t> samples = stageSamples(result, stage);
+            fprintf(out, "  %-20s %12.3f %12.3f\n", P3dProfiler::stageName(static_cast<P3dProfiler::Stage>(stage)),
+                    percentile(samples, 50) / 1e6, percentile(samples, 95) / 1e6);
+        }
+        for(int counter = 0; counter < P3dProfiler::COUNTER_COUNT; ++counter)
+        {
+            fprintf(out, "  %-20s %12llu\n", P3dProfiler::counterName(static_cast<P3dProfiler::Counter>(counter)),
+                    static_cast<unsigned long long>(result.stats.back().counters[counter]));
+        }
+        if(result.rendered)
+        {
+            const P3dStubGL::FrameStats& frame = result.frameGl;
+            fprintf(out, "  %-20s %12.3f %12.3f\n", "drawFrame",
+                    percentile(result.frameNanos, 50) / 1e6, percentile(result.frameNanos, 95) / 1e6);
+            fprintf(out, "  %-20s %12u\n", "chunks", result.frameStats.chunks);
+            fprintf(out, "  %-20s %12u\n", "culledChunks", result.frameStats.culledChunks);
+            fprintf(out, "  %-20s %12u\n", "lodChunks", result.frameStats.lodChunks);
+            fprintf(out, "  %-20s %12llu\n", "firstDrawBytes", static_cast<unsigned long long>(result.firstDrawBytes));
+            fprintf(out, "  %-20s %12u\n", "glCalls", frame.calls);
+            fprintf(out, "  %-20s %12u\n", "drawCalls", frame.drawCalls);
+            fprintf(out, "  %-20s %12llu\n", "drawnIndices", static_cast<unsigned long long>(frame.drawnIndices));
+            fprintf(out, "  %-20s %12u\n", "stateChanges", frame.stateChanges);
+            fprintf(out, "  %-20s %12u\n", "redundantStates", frame.redundantStateChanges);
+            fprintf(out, "  %-20s %12u\n", "uniformCalls", frame.uniformCalls);
+            fprintf(out, "  %-20s %12u\n", "redundantUniforms", frame.redundantUniformCalls);
+            fprintf(out, "  %-20s %12llu\n", "frameUploadBytes", static_cast<unsigned long long>(frame.uploadBytes));
+            fprintf(out, "  %-20s %12llu\n", "loadUploadBytes", static_cast<unsigned long long>(result.loadGl.uploadBytes));
+            fprintf(out, "  %-20s %12u\n", "buffers", result.memory.buffers);
+            fprintf(out, "  %-20s %12llu\n", "bufferBytes", static_cast<unsigned long long>(result.memory.bufferBytes));
+            fprintf(out, "  %-20s %12u\n", "textures", result.memory.textures);
+            fprintf(out, "  %-20s %12llu\n", "textureBytes", static_cast<unsigned long long>(result.memory.textureBytes));
+        }
+    }
+}
+
+static void printJsonStage(FILE* out, const char* name, const std::vector<uint64_t>& samples, bool first)
+{
+    fprintf(out, "%s\"%s\":{\"p50Us\":%.3f,\"p95Us\":%.3f,\"minUs\":%.3f,\"maxUs\":%.3f}", first ? "" : ",", name,
+            percentile(samples, 50) / 1e3, percentile(samples, 95) / 1e3,
+            percentile(samples, 0) / 1e3, percentile(samples, 100) / 1e3);
+}
+
+static void printJson(FILE* out, const BenchOptions& options, const std::vector<FileResult>& results)
+{
+    // one object, stages are always all listed so the output diffs cleanly between runs
+    fprintf(out, "{\"warmup\":%d,\"iterations\":%d,\"frames\":%d,", options.warmup, options.iterations, options.frames);
+    fprintf(out, "\"options\":{\"uint32Indices\":%s,\"multiDraw\":%s,\"parallelReindex\":%s,\"quantizeAttributes\":%s,"
+            "\"optimizeVertexCache\":%s,\"normalWeighting\":\"%s\",\"creaseAngle\":%.1f,\"clusterTriangles\":%u,\"lodLevels\":%u,"
+            "\"lodPixelError\":%.2f,\"streamPiece\":%llu,\"boundedStreaming\":%s,\"cacheNormals\":%s,\"cacheModel\":%s},",
+            options.uint32Indices ? "true" : "false",
+            options.multiDraw ? "true" : "false",
+            options.loadOptions.parallelReindex ? "true" : "false",
+            options.loadOptions.quantizeAttributes ? "true" : "false",
+            options.loadOptions.optimizeVertexCache ? "true" : "false",
+            WEIGHTING_NAMES[options.loadOptions.normalWeighting],
+            options.loadOptions.creaseAngle,
+            options.loadOptions.clusterTriangles,
+            options.loadOptions.lodLevels,
+            options.lodPixelError,
+            static_cast<unsigned long long>(options.streamPiece),
+            options.loadOptions.boundedStreaming ? "true" : "false",
+            options.loadOptions.cacheNormals ? "true" : "false",
+            options.loadOptions.cacheModel ? "true" : "false");
+    fprintf(out, "\"files\":[");
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const FileResult& result = results[i];
+        fprintf(out, "%s{\"file\":\"", i ? "," : "");
+        for(const char* c = result.path; *c; ++c)
+        {
+            if(*c == '"' || *c == '\\') fputc('\\', out);
+            fputc(*c, out);
+        }
+        fprintf(out, "\",\"bytes\":%zu,\"ok\":%s", result.size, result.ok ? "true" : "false");
+        if(result.ok)
+        {
+            fprintf(out, ",\"stages\":{");
+            printJsonStage(out, "total", result.totalNanos, true);
+            for(int stage = 0; stage < P3dProfiler::STAGE_COUNT; ++stage)
+            {
+                printJsonStage(out, P3dProfiler::stageName(static_cast<P3dProfiler::Stage>(stage)),
+                               stageSamples(result, stage), false);
+            }
+            fprintf(out, "},\"counters\":{");
+            for(int counter = 0; counter < P3dProfiler::COUNTER_COUNT; ++counter)
+            {
+                fprintf(out, "%s\"%s\":%llu", counter ? "," : "",
+                        P3dProfiler::counterName(static_cast<P3dProfiler::Counter>(counter)),
+                        static_cast<unsigned long long>(result.stats.back().counters[counter]));
+            }
+            fprintf(out, "}");
+        }
+        if(result.rendered)
+        {
+            const P3dStubGL::FrameStats& frame = result.frameGl;
+            fprintf(out, ",\"render\":{");
+            printJsonStage(out, "drawFrame", result.frameNanos, true);
+            fprintf(out, ",\"chunks\":%u,\"culledChunks\":%u,\"lodChunks\":%u,\"firstDrawBytes\":%llu",
+                    result.frameStats.chunks, result.frameStats.culledChunks, result.frameStats.lodChunks,
+                    static_cast<unsigned long long>(result.firstDrawBytes));
+            fprintf(out, ",\"glCalls\":%u,\"drawCalls\":%u,\"drawnIndices\":%llu,\"stateChanges\":%u,"
+                    "\"redundantStateChanges\":%u,\"uniformCalls\":%u,\"redundantUniformCalls\":%u,"
+                    "\"frameUploadBytes\":%llu,\"loadUploadBytes\":%llu,\"buffers\":%u,\"bufferBytes\":%llu,"
+                    "\"textures\":%u,\"textureBytes\":%llu}",
+                    frame.calls, frame.drawCalls, static_cast<unsigned long long>(frame.drawnIndices),
+                    frame.stateChanges, frame.redundantStateChanges, frame.uniformCalls, frame.redundantUniformCalls,
+                    static_cast<unsigned long long>(frame.uploadBytes),
+                    static_cast<unsigned long long>(result.loadGl.uploadBytes),
+                    result.memory.buffers, static_cast<unsigned long long>(result.memory.bufferBytes),
+                    result.memory.textures, static_cast<unsigned long long>(result.memory.textureBytes));
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "]}\n");
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    std::vector<FileResult> results;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if(!strcmp(arg, "-w") && i + 1 < argc)
+        {
+            options.warmup = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "-n") && i + 1 < argc)
+        {
+            options.iterations = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "--frames") && i + 1 < argc)
+        {
+            options.frames = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "--gl-log") && i + 1 < argc)
+        {
+            options.glLog = argv[++i];
+        }
+        else if(!strcmp(arg, "-o") && i + 1 < argc)
+        {
+            options.output = argv[++i];
+        }
+        else if(!strcmp(arg, "--json"))
+        {
+            options.json = true;
+        }
+        else if(!strcmp(arg, "--uint32-indices"))
+        {
+            options.uint32Indices = true;
+        }
+        else if(!strcmp(arg, "--zoom") && i + 1 < argc)
+        {
+            options.zoom = atof(argv[++i]);
+        }
+        else if(!strcmp(arg, "--multi-draw"))
+        {
+            options.multiDraw = true;
+        }
+        else if(!strcmp(arg, "--parallel"))
+        {
+            options.loadOptions.parallelReindex = true;
+        }
+        else if(!strcmp(arg, "--quantize"))
+        {
+            options.loadOptions.quantizeAttributes = true;
+        }
+        else if(!strcmp(arg, "--optimize"))
+        {
+            options.loadOptions.optimizeVertexCache = true;
+        }
+        else if(!strcmp(arg, "--weighting") && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            int weighting = NORMALS_UNIFORM;
+            while(weighting <= NORMALS_ANGLE && strcmp(name, WEIGHTING_NAMES[weighting])) ++weighting;
+            if(weighting > NORMALS_ANGLE)
+            {
+                usage();
+                return 2;
+            }
+            options.loadOptions.normalWeighting = NormalWeighting(weighting);
+        }
+        else if(!strcmp(arg, "--crease") && i + 1 < argc)
+        {
+            options.loadOptions.creaseAngle = atof(argv[++i]);
+        }
+        else if(!strcmp(arg, "--clusters") && i + 1 < argc)
+        {
+            options.loadOptions.clusterTriangles = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "--lods") && i + 1 < argc)
+        {
+            options.loadOptions.lodLevels = atoi(argv[++i]);
+        }
+        else if(!strcmp(arg, "--stream") && i + 1 < argc)
+        {
+            options.streamPiece = atol(argv[++i]);
+        }
+        else if(!strcmp(arg, "--bounded"))
+        {
+            options.loadOptions.boundedStreaming = true;
+        }
+        else if(!strcmp(arg, "--lod-error") && i + 1 < argc)
+        {
+            options.lodPixelError = atof(argv[++i]);
+        }
+        else if(!strcmp(arg, "--cache-dir") && i + 1 < argc)
+        {
+            options.cacheDir = argv[++i];
+            options.loadOptions.cacheNormals = true;
+        }
+        else if(!strcmp(arg, "--cache-model"))
+        {
+            options.loadOptions.cacheModel = true;
+        }
+        else if(arg[0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+        {
+            FileResult result;
+            result.path = arg;
+            results.push_back(result);
+        }
+    }
+    if(results.empty() || options.iterations < 1 || options.warmup < 0 || options.frames < 0)
+    {
+        usage();
+        return 2;
+    }
+
+    BenchPlatformAdapter adapter;
+    adapter.setCacheDir(options.cacheDir);
+    PlatformAdapter::adapter = &adapter;
+
+    FILE* glLog = 0;
+    if(options.glLog)
+    {
+        glLog = fopen(options.glLog, "w");
+        if(!glLog)
+        {
+            fprintf(stderr, "can't write %s\n", options.glLog);
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    for(FileResult& result: results)
+    {
+        benchFile(options, glLog, result);
+        ok = ok && result.ok;
+    }
+    if(glLog)
+    {
+        fclose(glLog);
+    }
+
+    FILE* out = options.output ? fopen(options.output, "w") : stdout;
+    if(!out)
+    {
+        fprintf(stderr, "can't write %s\n", options.output);
+        return 2;
+    }
+    if(options.json)
+    {
+        printJson(out, options, results);
+    }
+    else
+    {
+        printText(out, results);
+    }
+    if(out != stdout)
+    {
+        fclose(out);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+
+#include "PlatformAdapter.h"
+#include "BaseLoader.h"
+#include "BinLoader.h"
+#include "BlendLoader.h"
+#include "ModelLoader.h"
+#include "P3dParallel.h"
+
+// p3d-convert: runs the loaders and the ModelLoader CPU stages ahead of time
+// and writes .p3d files, which the viewer uploads without further processing
+
+//! \brief only warnings and errors, the blend parser prints to stdout anyway
+class ConvertPlatformAdapter: public PlatformAdapter
+{
+public:
+    void logTag(P3dLogger::Level level, const char* tag, const char* format, va_list args) override
+    {
+        if(level > P3dLogger::LOG_WARN)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        fprintf(stderr, "%s: ", tag);
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+    }
+
+private:
+    std::mutex m_mutex;
+};
+
+struct ConvertOptions
+{
+    const char* outputDir = 0;
+    unsigned jobs = P3dParallel::workerCount();
+    bool uint32Indices = false;
+    bool verbose = false;
+    LoadOptions loadOptions;
+};
+
+struct FileResult
+{
+    const char* path;
+    std::string output;
+    bool ok = false;
+    size_t inputSize = 0;
+    size_t outputSize = 0;
+    uint64_t millis = 0;
+};
+
+static const char* const WEIGHTING_NAMES[] = {"uniform", "area", "angle"};
+
+// more threads than this only add memory, every job holds a whole model
+static const unsigned MAX_JOBS = 256;
+// a 16 bit bank holds about 130k triangles, bigger clusters never split anything
+static const unsigned MAX_CLUSTER_TRIANGLES = 1 << 20;
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: p3d-convert [options] model.bin|model.blend...\n"
+            "  -o DIR            write DIR/<name>.p3d, default is next to the input\n"
+            "  -j N              files converted at the same time, one thread each, 1 to 256 (default: cores)\n"
+            "  --uint32-indices  for GLES3 and desktop GL only, default files load on every context\n"
+            "  --no-quantize     keep float attributes, LoadOptions::quantizeAttributes\n"
+            "  --no-optimize     keep the file's triangle order, LoadOptions::optimizeVertexCache\n"
+            "  --weighting W     LoadOptions::normalWeighting, uniform, area or angle\n"
+            "  --crease DEG      LoadOptions::creaseAngle\n"
+            "  --clusters N      split chunks into clusters of at most N triangles, LoadOptions::clusterTriangles\n"
+            "  --lods N          N simplified index lists per chunk, 0 to 3, LoadOptions::lodLevels\n"
+            "  -v                print a line per converted file\n");
+}
+
+//! \brief parses a plain decimal number in [min, max], atoi would take "-1" or "x" as a value
+static bool parseCount(const char* text, unsigned min, unsigned max, unsigned* value)
+{
+    if(text[0] < '0' || text[0] > '9')
+    {
+        return false;
+    }
+    char* end;
+    errno = 0;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if(errno || *end || parsed < min || parsed > max)
+    {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+static std::string outputPath(const ConvertOptions& options, const char* path)
+{
+    std::string name = path;
+    if(options.outputDir)
+    {
+        size_t slash = name.find_last_of("/\\");
+        if(slash != std::string::npos) name = name.substr(slash + 1);
+        name = std::string(options.outputDir) + "/" + name;
+    }
+    size_t dot = name.find_last_of('.');
+    size_t slash = name.find_last_of("/\\");
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        name = name.substr(0, dot);
+    }
+    return name + ".p3d";
+}
+
+static bool writeFile(const char* path, const char* data, size_t size)
+{
+    FILE* f = fopen(path, "wb");
+    if(!f)
+    {
+        return false;
+    }
+    bool ok = fwrite(data, size, 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+//! \brief converts one file, runs on its own thread
+static void convertFile(const ConvertOptions& options, FileResult& result)
+{
+    uint64_t start = PlatformAdapter::currentMillis();
+    result.output = outputPath(options, result.path);
+
+    // the registered loaders are shared, every thread needs its own
+    BinLoader binLoader;
+    BlendLoader blendLoader;
+    BaseLoader* loader = 0;
+    const char* extension = strrchr(result.path, '.');
+    if(extension && !strcmp(extension, ".bin"))
+    {
+        loader = &binLoader;
+    }
+    else if(extension && !strcmp(extension, ".blend"))
+    {
+        loader = &blendLoader;
+    }
+    if(!loader)
+    {
+        fprintf(stderr, "%s: unsupported extension\n", result.path);
+        return;
+    }
+
+    MappedFile* file = PlatformAdapter::adapter->mapModel(result.path);
+    if(!file)
+    {
+        return;
+    }
+    result.inputSize = file->size();
+
+    // uploads stay pending, the conversion never touches GL
+    ModelLoader modelLoader;
+    modelLoader.options() = options.loadOptions;
+    modelLoader.setUint32Indices(options.uint32Indices);
+    modelLoader.setDeferUploads(true);
+    modelLoader.setKeepModelFile(true);
+    loader->setModelLoader(&modelLoader);
+    if(loader->load(file->data(), file->size()))
+    {
+        const char* data = modelLoader.modelFile(&result.outputSize);
+        result.ok = data && writeFile(result.output.c_str(), data, result.outputSize);
+        if(!result.ok)
+        {
+            fprintf(stderr, "%s: can't write %s\n", result.path, result.output.c_str());
+        }
+    }
+    else
+    {
+        fprintf(stderr, "%s: load failed\n", result.path);
+    }
+    delete file;
+    result.millis = PlatformAdapter::durationMillis(start);
+}
+
+int main(int argc, char* argv[])
+{
+    ConvertOptions options;
+    options.loadOptions.quantizeAttributes = true;
+    options.loadOptions.optimizeVertexCache = true;
+    std::vector<FileResult> results;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if(!strcmp(arg, "-o") && i + 1 < argc)
+        {
+            options.outputDir = argv[++i];
+        }
+        else if(!strcmp(arg, "-j") && i + 1 < argc)
+        {
+            if(!parseCount(argv[++i], 1, MAX_JOBS, &options.jobs))
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if(!strcmp(arg, "-v"))
+        {
+            options.verbose = true;
+        }
+        else if(!strcmp(arg, "--uint32-indices"))
+        {
+            options.uint32Indices = true;
+        }
+        else if(!strcmp(arg, "--no-quantize"))
+        {
+            options.loadOptions.quantizeAttributes = false;
+        }
+        else if(!strcmp(arg, "--no-optimize"))
+        {
+            options.loadOptions.optimizeVertexCache = false;
+        }
+        else if(!strcmp(arg, "--weighting") && i + 1 < argc)
+        {
+            const char* name = argv[++i];
+            int weighting = NORMALS_UNIFORM;
+            while(weighting <= NORMALS_ANGLE && strcmp(name, WEIGHTING_NAMES[weighting])) ++weighting;
+            if(weighting > NORMALS_ANGLE)
+            {
+                usage();
+                return 2;
+            }
+            options.loadOptions.normalWeighting = NormalWeighting(weighting);
+        }
+        else if(!strcmp(arg, "--crease") && i + 1 < argc)
+        {
+            options.loadOptions.creaseAngle = atof(argv[++i]);
+        }
+        else if(!strcmp(arg, "--clusters") && i + 1 < argc)
+        {
+            unsigned triangles;
+            if(!parseCount(argv[++i], 1, MAX_CLUSTER_TRIANGLES, &triangles))
+            {
+                usage();
+                return 2;
+            }
+            options.loadOptions.clusterTriangles = triangles;
+        }
+        else if(!strcmp(arg, "--lods") && i + 1 < argc)
+        {
+            unsigned levels;
+            if(!parseCount(argv[++i], 0, MeshChunk::MAX_LODS, &levels))
+            {
+                usage();
+                return 2;
+            }
+            options.loadOptions.lodLevels = levels;
+        }
+        else if(arg[0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+        {
+            FileResult result;
+            result.path = arg;
+            results.push_back(result);
+        }
+    }
+    if(results.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    ConvertPlatformAdapter adapter;
+    PlatformAdapter::adapter = &adapter;
+
+    // every file is reindexed on one thread, the threads take files in order
+    // the normals generation still splits big files over all cores, .blend parses run one at a time
+    uint64_t start = PlatformAdapter::currentMillis();
+    std::atomic<size_t> next(0);
+    std::mutex printMutex;
+    auto worker = [&]()
+    {
+        for(size_t i = next++; i < results.size(); i = next++)
+        {
+            FileResult& result = results[i];
+            convertFile(options, result);
+            if(options.verbose && result.ok)
+            {
+                std::lock_guard<std::mutex> lock(printMutex);
+                printf("%s -> %s: %zu -> %zu bytes, %llu ms\n", result.path, result.output.c_str(),
+                       result.inputSize, result.outputSize, static_cast<unsigned long long>(result.millis));
+            }
+        }
+    };
+    size_t threadCount = options.jobs < results.size() ? options.jobs : results.size();
+    std::vector<std::thread> threads;
+    for(size_t t = 1; t < threadCount; ++t)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for(std::thread& thread: threads)
+    {
+        thread.join();
+    }
+
+    int failed = 0;
+    for(const FileResult& result: results)
+    {
+        if(!result.ok) ++failed;
+    }
+    if(options.verbose)
+    {
+        printf("%zu files in %llu ms, %d failed\n", results.size(),
+               static_cast<unsigned long long>(PlatformAdapter::durationMillis(start)), failed);
+    }
+    PlatformAdapter::adapter = 0;
+    return failed ? 1 : 0;
+}
@@ -83,6 +83,21 @@ extern "C" void loadModel(const char* data, int size, const char* extension)
     viewer.loadModel(data, size, extension);
 }
 
+extern "C" int beginModelLoad(const char* extension, int size)
+{
+    return viewer.beginModelLoad(extension, size);
+}
+
+extern "C" int appendModelData(const char* data, int size)
+{
+    return viewer.appendModelData(data, size);
+}
+
+extern "C" int finishModelLoad()
+{
+    return viewer.finishModelLoad();
+}
+
 extern "C" void startRotateCam(float x, float y)
 {
     viewer.cameraNavigation()->startRotate(x, y);
@@ -122,3 +137,8 @@ extern "C" void setUrlPrefix(const char *prefix)
 {
     viewer.setUrlPrefix(prefix);
 }
+
+extern "C" const char* loadStats()
+{
+    return viewer.loadStatsJson();
+}
@@ -95,6 +95,57 @@ var P3DViewer = (function(){
         Module._loadModel(buf, size, Module.allocate(Module.intArrayFromString(extension), 'i8', Module.ALLOC_STACK));
         Module._free(buf);
         Module.print("material count: " + Module._materialCount());
+        Module.print("load stats: " + Module.Pointer_stringify(Module._loadStats()));
+    }
+
+    function appendModelData(bytes) {
+        var buf = Module._malloc(bytes.length);
+        Module.HEAPU8.set(bytes, buf);
+        var ok = Module._appendModelData(buf, bytes.length);
+        Module._free(buf);
+        return ok;
+    }
+
+    // hands the download to the viewer piece by piece, .p3d models are drawn while they arrive;
+    // browsers without streamed fetch load it in one piece when it is complete
+    function streamModel(url, extension, done) {
+        if(!window.fetch || !window.ReadableStream) {
+            var xhr = new XMLHttpRequest();
+            xhr.open('GET', url, true);
+            xhr.responseType = 'arraybuffer';
+            xhr.onload = function(e) {
+                if (this.readyState === 4 && (this.status === 200 || this.status === 0)) {
+                    loadModel(this.response, extension);
+                    done();
+                }
+            };
+            xhr.send();
+            return;
+        }
+        fetch(url).then(function(response) {
+            if(!response.ok) {
+                return;
+            }
+            var size = parseInt(response.headers.get('Content-Length'), 10) || 0;
+            if(!Module.ccall('beginModelLoad', 'number', ['string', 'number'], [extension, size])) {
+                return;
+            }
+            var reader = response.body.getReader();
+            var pump = function() {
+                return reader.read().then(function(result) {
+                    if(result.done) {
+                        Module._finishModelLoad();
+                        done();
+                        return;
+                    }
+                    if(appendModelData(result.value)) {
+                        return pump();
+                    }
+                    reader.cancel();
+                });
+            };
+            return pump();
+        });
     }
 
     function handleMaterials(json)
@@ -157,20 +208,13 @@ var P3DViewer = (function(){
                 }
             }
         };
-        var xhr = new XMLHttpRequest();
-        xhr.open('GET', binUrl, true);
-        xhr.responseType = 'arraybuffer';
-        xhr.onload = function(e) {
-            if (this.readyState === 4 && (this.status === 200 || this.status === 0)) {
-                loadModel(this.response, ".bin");
-                pending.dataDone = true;
-                pending.check();
-            }
-        };
-        xhr.send();
+        streamModel(binUrl, ".bin", function() {
+            pending.dataDone = true;
+            pending.check();
+        });
 
         if(jsonUrl) {
-            xhr = new XMLHttpRequest();
+            var xhr = new XMLHttpRequest();
             xhr.open('GET', jsonUrl, true);
             xhr.responseType = 'json';
             xhr.onload = function(e) {
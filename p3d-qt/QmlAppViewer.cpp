@@ -28,6 +28,10 @@ QmlAppViewer::QmlAppViewer(QObject *parent) :
     connect(this, SIGNAL(windowReady()), SLOT(onWindowReady()));
     m_NetMgr = new QNetworkAccessManager(this);
     m_P3dViewer = new P3dViewer(new QtPlatformAdapter());
+    m_P3dViewer->loadOptions().parallelReindex = true;
+    m_P3dViewer->loadOptions().cacheNormals = true;
+    m_P3dViewer->loadOptions().cacheModel = true;
+    m_P3dViewer->loadOptions().clusterTriangles = 4096;
     m_NetInfoReply = 0;
     m_NetDataReply = 0;
     m_ModelState = MS_NONE;
@@ -37,6 +41,8 @@ QmlAppViewer::QmlAppViewer(QObject *parent) :
 QmlAppViewer::~QmlAppViewer()
 {
     delete m_P3dViewer;
+    delete m_LoadingMapping;
+    delete m_ModelMapping;
 }
 
 void QmlAppViewer::setModelState(ModelState newValue)
@@ -65,6 +71,10 @@ void QmlAppViewer::loadModel(const QUrl &model)
         m_urlPrefix = "file://" + fi.absoluteDir().path() + "/";
         m_P3dViewer->setUrlPrefix(m_urlPrefix.toUtf8().constData());
     }
+    else if(fileName.endsWith(".p3d"))
+    {
+        m_extension = ".p3d";
+    }
     else if(fileName.endsWith(".bin"))
     {
         m_extension = ".bin";
@@ -91,9 +101,23 @@ void QmlAppViewer::loadModel(const QUrl &model)
             return;
         }
 
-        file.open(QFile::ReadOnly);
-        m_ModelData = file.readAll();
-        logger.debug("loaded %d bytes for %s", m_ModelData.size(), m_extension.toUtf8().constData());
+        MappedFile* mapping = PlatformAdapter::adapter->mapModel(path.toLocal8Bit().constData());
+        if(!mapping)
+        {
+            logger.warning("Can't map file: %s", path.toUtf8().constData());
+            setModelState(MS_NONE);
+            return;
+        }
+        logger.debug("mapped %d bytes for %s", mapping->size(), m_extension.toUtf8().constData());
+        // the render thread takes it over, a mapping it hasn't taken yet is replaced
+        MappedFile* replaced;
+        {
+            QMutexLocker lock(&m_StreamMutex);
+            replaced = m_ModelMapping;
+            m_ModelMapping = mapping;
+            m_MappingExtension = m_extension.toLocal8Bit();
+        }
+        delete replaced;
         setModelState(MS_PROCESSING);
         window->update();
 
@@ -110,12 +134,20 @@ void QmlAppViewer::loadModel(const QUrl &model)
 
     if(m_NetDataReply)
     {
+        // an aborted download is no failure of the next one
+        m_NetDataReply->disconnect(this);
         m_NetDataReply->abort();
         m_NetDataReply->deleteLater();
         m_NetDataReply = 0;
     }
 
-    m_ModelData.clear();
+    MappedFile* mapping;
+    {
+        QMutexLocker lock(&m_StreamMutex);
+        mapping = m_ModelMapping;
+        m_ModelMapping = nullptr;
+    }
+    delete mapping;
 
     m_NetInfoReply = m_NetMgr->get(QNetworkRequest(QUrl("http://p3d.in/api/viewer_models/" + fileName)));
     connect(m_NetInfoReply, SIGNAL(finished()), SLOT(onModelInfoReplyDone()));
@@ -127,6 +159,15 @@ void QmlAppViewer::clearModel()
     window->update();
 }
 
+QString QmlAppViewer::loadStats()
+{
+    // called from the GUI thread, don't share the viewer's buffer with the render thread
+    P3dProfiler::Stats stats = m_P3dViewer->loadStats();
+    QByteArray json(P3dProfiler::toJson(stats, 0, 0) + 1, 0);
+    P3dProfiler::toJson(stats, json.data(), json.size());
+    return QString::fromUtf8(json.constData());
+}
+
 void QmlAppViewer::startRotateCamera(float x, float y)
 {
     m_P3dViewer->cameraNavigation()->startRotate(x, y);
@@ -182,74 +223,164 @@ void QmlAppViewer::onGLResize()
 
 void QmlAppViewer::onGLRender()
 {
-    //TODO: threading
-    if(!m_ModelData.isEmpty())
+    MappedFile* mapping;
+    QByteArray mappingExtension;
+    {
+        QMutexLocker lock(&m_StreamMutex);
+        mapping = m_ModelMapping;
+        m_ModelMapping = nullptr;
+        mappingExtension.swap(m_MappingExtension);
+    }
+    if(mapping)
+    {
+        setModelState(MS_PROCESSING);
+
+        // parsing runs on a worker, the data has to outlive it
+        m_P3dViewer->clearModel();
+        m_Streaming = false;
+        delete m_LoadingMapping;
+        m_LoadingMapping = mapping;
+
+        // local files are parsed straight from the mapping
+        m_Loading = m_P3dViewer->loadModelAsync(m_LoadingMapping->data(), m_LoadingMapping->size(),
+                                                mappingExtension.constData());
+        // material properties are queued until the model is parsed
+        setModelInfoProperties();
+    }
+
+    // downloads go to the viewer piece by piece, models that can be drawn early show up while loading
+    QByteArray streamData;
+    bool streamBegin;
+    bool streamEnd;
+    bool streamFailed;
+    qint64 streamSize;
+    {
+        QMutexLocker lock(&m_StreamMutex);
+        streamData.swap(m_StreamData);
+        streamBegin = m_StreamBegin;
+        streamEnd = m_StreamEnd;
+        streamFailed = m_StreamFailed;
+        streamSize = m_StreamSize;
+        m_StreamBegin = false;
+        m_StreamEnd = false;
+        m_StreamFailed = false;
+    }
+    if(streamBegin)
+    {
+        m_Streaming = m_P3dViewer->beginModelLoad(m_extension.toLocal8Bit().constData(), streamSize);
+        m_Loading = m_Streaming;
+        setModelInfoProperties();
+    }
+    if(m_Streaming && !streamData.isEmpty())
+    {
+        m_Streaming = m_P3dViewer->appendModelData(streamData.constData(), streamData.size());
+    }
+    if(m_Streaming && streamEnd)
     {
         setModelState(MS_PROCESSING);
-        m_P3dViewer->loadModel(m_ModelData.constData(), m_ModelData.size(), m_extension.toLocal8Bit().constData());
-        m_ModelData.clear();
-        setModelState(MS_READY);
+        m_Streaming = false;
+        m_P3dViewer->finishModelLoad();
+    }
+    if(m_Streaming && streamFailed)
+    {
+        m_Streaming = false;
+        m_P3dViewer->clearModel();
+        setModelState(MS_NONE);
+    }
 
-        if(m_ModelInfo)
+    if(m_ClearModel)
+    {
+        m_ClearModel = false;
+        m_Streaming = false;
+        m_P3dViewer->clearModel();
+        setModelState(MS_NONE);
+    }
+    window->resetOpenGLState();
+    m_P3dViewer->drawFrame();
+    window->resetOpenGLState();
+
+    if(m_Loading)
+    {
+        if(m_P3dViewer->isLoading())
+        {
+            // nothing else asks for frames while the worker parses and the buffers upload
+            QMetaObject::invokeMethod(window, "update", Qt::QueuedConnection);
+        }
+        else
         {
-            QJsonArray mats = m_ModelInfo->value("materials").toArray();
-            for(int matIndex = 0, matIndexL = mats.size(); matIndex < matIndexL; ++matIndex)
+            m_Loading = false;
+            delete m_LoadingMapping;
+            m_LoadingMapping = nullptr;
+            if(m_ModelState == MS_PROCESSING)
             {
-                QJsonObject mat = mats[matIndex].toObject();
-                QJsonObject matSettings = QJsonDocument::fromJson(mat["settings"].toString().toUtf8()).object();
-                for(auto itr = matSettings.constBegin(); itr != matSettings.constEnd(); ++itr)
-                {
-                    //TODO: separate setMaterialProperty for doubles?
-                    QString value = itr.value().toString();
-                    if(itr.value().isDouble())
-                    {
-                        value = QString::number(itr.value().toDouble());
-                    }
-                    m_P3dViewer->setMaterialProperty(matIndex, itr.key().toUtf8().constData(),
-                                                     value.toUtf8().constData());
-                }
+                setModelState(MS_READY);
+            }
+        }
+    }
+}
 
-                // set diffuse textures
-                //TODO: optimize using maps
-                QJsonArray texAssigns = m_ModelInfo->value("texture_assignments").toArray();
-                QJsonArray texs = m_ModelInfo->value("textures").toArray();
-                for(QJsonValue texAssignId: mat["texture_assignment_ids"].toArray())
+void QmlAppViewer::setModelInfoProperties()
+{
+    if(!m_ModelInfo)
+    {
+        return;
+    }
+    QJsonArray mats = m_ModelInfo->value("materials").toArray();
+    for(int matIndex = 0, matIndexL = mats.size(); matIndex < matIndexL; ++matIndex)
+    {
+        QJsonObject mat = mats[matIndex].toObject();
+        QJsonObject matSettings = QJsonDocument::fromJson(mat["settings"].toString().toUtf8()).object();
+        for(auto itr = matSettings.constBegin(); itr != matSettings.constEnd(); ++itr)
+        {
+            //TODO: separate setMaterialProperty for doubles?
+            QString value = itr.value().toString();
+            if(itr.value().isDouble())
+            {
+                value = QString::number(itr.value().toDouble());
+            }
+            m_P3dViewer->setMaterialProperty(matIndex, itr.key().toUtf8().constData(),
+                                             value.toUtf8().constData());
+        }
+
+        // set diffuse textures
+        //TODO: optimize using maps
+        QJsonArray texAssigns = m_ModelInfo->value("texture_assignments").toArray();
+        QJsonArray texs = m_ModelInfo->value("textures").toArray();
+        for(QJsonValue texAssignId: mat["texture_assignment_ids"].toArray())
+        {
+            for(QJsonValue texAssignValue: texAssigns)
+            {
+                QJsonObject texAssign = texAssignValue.toObject();
+                if(texAssignId.toInt() == texAssign["id"].toInt())
                 {
-                    for(QJsonValue texAssignValue: texAssigns)
+                    int texId = texAssign["texture_id"].toInt();
+                    for(QJsonValue texValue: texs)
                     {
-                        QJsonObject texAssign = texAssignValue.toObject();
-                        if(texAssignId.toInt() == texAssign["id"].toInt())
+                        QJsonObject tex = texValue.toObject();
+                        if(texId == tex["id"].toInt())
                         {
-                            int texId = texAssign["texture_id"].toInt();
-                            for(QJsonValue texValue: texs)
+                            QString texUrl = tex["url"].toString();
+                            QString texType = texAssign["texture_type"].toString();
+                            logger.debug("%d: %s %s", matIndex, texType.toUtf8().constData(), texUrl.toUtf8().constData());
+                            if(texType == "diff")
+                            {
+                                if(m_urlPrefix.startsWith("file://"))
+                                {
+                                    // assume texture file is in same dir as .bin
+                                    texUrl = QFileInfo(texUrl).fileName();
+                                }
+                                QString fullUrl = m_urlPrefix + texUrl;
+                                m_P3dViewer->setMaterialProperty(matIndex, "diffuseTexture", fullUrl.toUtf8().constData());
+                            }
+                            else if(texType == "spec")
                             {
-                                QJsonObject tex = texValue.toObject();
-                                if(texId == tex["id"].toInt())
+                                if(m_urlPrefix.startsWith("file://"))
                                 {
-                                    QString texUrl = tex["url"].toString();
-                                    QString texType = texAssign["texture_type"].toString();
-                                    logger.debug("%d: %s %s", matIndex, texType.toUtf8().constData(), texUrl.toUtf8().constData());
-                                    if(texType == "diff")
-                                    {
-                                        if(m_urlPrefix.startsWith("file://"))
-                                        {
-                                            // assume texture file is in same dir as .bin
-                                            texUrl = QFileInfo(texUrl).fileName();
-                                        }
-                                        QString fullUrl = m_urlPrefix + texUrl;
-                                        m_P3dViewer->setMaterialProperty(matIndex, "diffuseTexture", fullUrl.toUtf8().constData());
-                                    }
-                                    else if(texType == "spec")
-                                    {
-                                        if(m_urlPrefix.startsWith("file://"))
-                                        {
-                                            // assume texture file is in same dir as .bin
-                                            texUrl = QFileInfo(texUrl).fileName();
-                                        }
-                                        QString fullUrl = m_urlPrefix + texUrl;
-                                        m_P3dViewer->setMaterialProperty(matIndex, "specTexture", fullUrl.toUtf8().constData());
-                                    }
+                                    // assume texture file is in same dir as .bin
+                                    texUrl = QFileInfo(texUrl).fileName();
                                 }
+                                QString fullUrl = m_urlPrefix + texUrl;
+                                m_P3dViewer->setMaterialProperty(matIndex, "specTexture", fullUrl.toUtf8().constData());
                             }
                         }
                     }
@@ -257,16 +388,6 @@ void QmlAppViewer::onGLRender()
             }
         }
     }
-
-    if(m_ClearModel)
-    {
-        m_ClearModel = false;
-        m_P3dViewer->clearModel();
-        setModelState(MS_NONE);
-    }
-    window->resetOpenGLState();
-    m_P3dViewer->drawFrame();
-    window->resetOpenGLState();
 }
 
 void QmlAppViewer::onModelInfoReplyDone()
@@ -285,24 +406,58 @@ void QmlAppViewer::onModelInfoReplyDone()
     m_urlPrefix = "http://p3d.in";
     QString binUrl = m_urlPrefix + baseUrl + ".r48.bin";
     logger.debug("bin url: %s", binUrl.toUtf8().constData());
+    m_extension = ".bin";
+    {
+        QMutexLocker lock(&m_StreamMutex);
+        m_StreamData.clear();
+        // the render thread begins the load with the first data, the size is known by then
+        m_StreamSize = -1;
+        m_StreamBegin = false;
+        m_StreamEnd = false;
+        m_StreamFailed = false;
+    }
     m_NetDataReply = m_NetMgr->get(QNetworkRequest(QUrl(binUrl)));
+    connect(m_NetDataReply, SIGNAL(readyRead()), SLOT(onModelDataReadyRead()));
     connect(m_NetDataReply, SIGNAL(finished()), SLOT(onModelDataReplyDone()));
     m_NetInfoReply = 0;
 }
 
-void QmlAppViewer::onModelDataReplyDone()
+void QmlAppViewer::onModelDataReadyRead()
 {
-    m_NetDataReply->deleteLater();
     if(m_NetDataReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200)
     {
-        m_NetDataReply = 0;
         return;
     }
-    //TODO: threading
-    m_extension = ".bin";
-    m_ModelData = m_NetDataReply->readAll();
-    logger.debug("%s returned %d bytes", m_NetDataReply->url().toString().toUtf8().constData(), m_ModelData.size());
-    setModelState(MS_PROCESSING);
+    QByteArray data = m_NetDataReply->readAll();
+    {
+        QMutexLocker lock(&m_StreamMutex);
+        if(m_StreamSize < 0)
+        {
+            m_StreamSize = m_NetDataReply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+            m_StreamBegin = true;
+        }
+        m_StreamData.append(data);
+    }
+    window->update();
+}
+
+void QmlAppViewer::onModelDataReplyDone()
+{
+    m_NetDataReply->deleteLater();
+    bool ok = m_NetDataReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 200;
+    QByteArray data = ok ? m_NetDataReply->readAll() : QByteArray();
+    logger.debug("%s finished, status ok: %d", m_NetDataReply->url().toString().toUtf8().constData(), ok);
+    {
+        QMutexLocker lock(&m_StreamMutex);
+        if(ok && m_StreamSize < 0)
+        {
+            m_StreamSize = data.size();
+            m_StreamBegin = true;
+        }
+        m_StreamData.append(data);
+        m_StreamEnd = ok;
+        m_StreamFailed = !ok;
+    }
     window->update();
     m_NetDataReply = 0;
 }
@@ -2,11 +2,13 @@
 #define QMLAPPVIEWER_H
 
 #include "qtquick2controlsapplicationviewer.h"
+#include <QMutex>
 
 class QNetworkAccessManager;
 class QNetworkReply;
 
 class P3dViewer;
+class MappedFile;
 class QJsonObject;
 
 class QmlAppViewer : public QtQuick2ControlsApplicationViewer
@@ -30,6 +32,7 @@ public:
 
     Q_INVOKABLE void loadModel(const QUrl &model);
     Q_INVOKABLE void clearModel();
+    Q_INVOKABLE QString loadStats();
 
     Q_INVOKABLE void startRotateCamera(float x, float y);
     Q_INVOKABLE void rotateCamera(float x, float y);
@@ -48,14 +51,30 @@ public slots:
 
 private slots:
     void onModelInfoReplyDone();
+    void onModelDataReadyRead();
     void onModelDataReplyDone();
 
 private:
+    void setModelInfoProperties();
+
     P3dViewer* m_P3dViewer;
     QNetworkAccessManager* m_NetMgr;
     QNetworkReply* m_NetInfoReply;
     QNetworkReply* m_NetDataReply;
-    QByteArray m_ModelData;
+    // mapped file and downloaded data the render thread hasn't passed to the viewer yet
+    QMutex m_StreamMutex;
+    MappedFile* m_ModelMapping = nullptr;
+    QByteArray m_MappingExtension;
+    QByteArray m_StreamData;
+    qint64 m_StreamSize = 0;
+    bool m_StreamBegin = false;
+    bool m_StreamEnd = false;
+    bool m_StreamFailed = false;
+    // render thread: a streamed load is between beginModelLoad and finishModelLoad
+    bool m_Streaming = false;
+    // render thread: the async or streamed load in progress and the mapping it parses
+    bool m_Loading = false;
+    MappedFile* m_LoadingMapping = nullptr;
     ModelState m_ModelState;
     bool m_ClearModel;
     QString m_extension;
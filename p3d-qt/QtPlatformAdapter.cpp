@@ -1,5 +1,7 @@
 #include "QtPlatformAdapter.h"
 #include <QFile>
+#include <QDir>
+#include <QStandardPaths>
 #include <QDebug>
 #include <QOpenGLTexture>
 #include <QUrl>
@@ -10,10 +12,60 @@
 
 static P3dLogger logger("qt.QtPlatformAdapter", P3dLogger::LOG_DEBUG);
 
+//! \brief QFile::map based mapping, copies files that can't be mapped (compressed resources)
+class QtMappedFile: public MappedFile
+{
+public:
+    explicit QtMappedFile(const QString& path) : m_file(path)
+    {
+    }
+
+    virtual ~QtMappedFile()
+    {
+        if(m_mapped)
+        {
+            m_file.unmap(m_mapped);
+        }
+    }
+
+    bool open()
+    {
+        if(!m_file.open(QIODevice::ReadOnly) || m_file.size() == 0)
+        {
+            return false;
+        }
+        m_mapped = m_file.map(0, m_file.size());
+        if(m_mapped)
+        {
+            m_data = reinterpret_cast<const char*>(m_mapped);
+            m_size = m_file.size();
+        }
+        else
+        {
+            m_copy = m_file.readAll();
+            m_data = m_copy.constData();
+            m_size = m_copy.size();
+        }
+        return true;
+    }
+
+private:
+    QFile m_file;
+    uchar* m_mapped = nullptr;
+    QByteArray m_copy;
+};
+
 QtPlatformAdapter::QtPlatformAdapter(QObject *parent) :
     QObject(parent)
 {
     m_NetMgr = nullptr;
+
+    // cached load results go with the app's other caches
+    QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if(!cachePath.isEmpty() && QDir().mkpath(cachePath))
+    {
+        setCacheDir(QFile::encodeName(cachePath).constData());
+    }
 }
 
 QtPlatformAdapter::~QtPlatformAdapter()
@@ -105,6 +157,18 @@ const char *QtPlatformAdapter::loadAsset(const char *filename, size_t *size)
     return result;
 }
 
+MappedFile *QtPlatformAdapter::mapModel(const char *path)
+{
+    QtMappedFile* mapping = new QtMappedFile(QString::fromLocal8Bit(path));
+    if(!mapping->open())
+    {
+        P3D_LOGE("Can't map model: %s", path);
+        delete mapping;
+        return 0;
+    }
+    return mapping;
+}
+
 void QtPlatformAdapter::logTag(P3dLogger::Level level, const char *tag, const char *format, va_list args)
 {
     char buf[1024];
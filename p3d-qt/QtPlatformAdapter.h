@@ -20,6 +20,7 @@ public:
     virtual void deleteTexture(uint32_t textureId);
     virtual void cancelTextureLoads();
     virtual const char* loadAsset(const char *filename, size_t *size);
+    virtual MappedFile* mapModel(const char *path);
     virtual void logTag(P3dLogger::Level level, const char* tag, const char* format, va_list args);
 
 signals:
@@ -22,8 +22,16 @@ SOURCES += \
     QtPlatformAdapter.cpp \
     ../libViewer/ModelLoader.cpp \
     ../libViewer/CameraNavigation.cpp \
+    ../libViewer/P3dFrustum.cpp \
+    ../libViewer/P3dBvh.cpp \
     ../libViewer/BaseLoader.cpp \
     ../libViewer/BinLoader.cpp \
+    ../libViewer/P3dParallel.cpp \
+    ../libViewer/P3dProfiler.cpp \
+    ../libViewer/MeshOptimizer.cpp \
+    ../libViewer/MeshSimplifier.cpp \
+    ../libViewer/NormalGenerator.cpp \
+    ../libViewer/P3dLoader.cpp \
     ../libViewer/P3dLogger.cpp
 
 windows {
@@ -52,10 +60,19 @@ HEADERS += \
     ../libViewer/P3dMap.h \
     ../libViewer/P3dVector.h \
     ../libViewer/CameraNavigation.h \
+    ../libViewer/P3dFrustum.h \
+    ../libViewer/P3dBvh.h \
     ../libViewer/GL/gl3w.h \
     ../libViewer/GL/glcorearb.h \
     ../libViewer/BaseLoader.h \
     ../libViewer/BinLoader.h \
+    ../libViewer/P3dParallel.h \
+    ../libViewer/P3dProfiler.h \
+    ../libViewer/P3dSimd.h \
+    ../libViewer/MeshOptimizer.h \
+    ../libViewer/MeshSimplifier.h \
+    ../libViewer/NormalGenerator.h \
+    ../libViewer/P3dLoader.h \
     ../libViewer/P3dLogger.h
 
 RESOURCES += \